@@ -0,0 +1,58 @@
+#!/bin/sh
+# Make a unixODBC data source called rdb_bench, backed by the SQLite
+# ODBC driver (the sqliteodbc package on Debian/Ubuntu, sqliteodbc on
+# Homebrew), for testing and benchmarking the ODBC code without the
+# real server. The ini files and the database go in the directory
+# given as the first argument. Set the environment variables that
+# this prints, so that unixODBC uses the new ini files:
+#
+#     eval "$(scripts/utils/sqlite_dsn.sh /tmp/rdb_odbc)"
+#     rdb-odbc-bench --dsn=rdb_bench
+#
+# Set SQLITE_ODBC_DRIVER to the path of libsqlite3odbc.so if it is
+# not in one of the usual places.
+
+set -e
+
+if [ -z "$1" ]; then
+    echo "Usage: $0 <directory>" >&2
+    exit 1
+fi
+mkdir -p "$1"
+directory=$(cd "$1" && pwd)
+
+driver=${SQLITE_ODBC_DRIVER:-}
+if [ -z "$driver" ]; then
+    for candidate in \
+	/usr/lib/x86_64-linux-gnu/odbc/libsqlite3odbc.so \
+	/usr/lib/aarch64-linux-gnu/odbc/libsqlite3odbc.so \
+	/usr/lib64/libsqlite3odbc.so \
+	/usr/local/lib/libsqlite3odbc.so \
+	/opt/homebrew/lib/libsqlite3odbc.dylib; do
+	if [ -f "$candidate" ]; then
+	    driver=$candidate
+	    break
+	fi
+    done
+fi
+if [ -z "$driver" ]; then
+    echo "Could not find the SQLite ODBC driver (set SQLITE_ODBC_DRIVER)" >&2
+    exit 1
+fi
+
+cat > "$directory/odbcinst.ini" <<INI
+[SQLite3]
+Description = SQLite3 ODBC driver
+Driver = $driver
+INI
+
+cat > "$directory/odbc.ini" <<INI
+[rdb_bench]
+Description = Local SQLite database for rdb tests and benchmarks
+Driver = SQLite3
+Database = $directory/rdb_bench.sqlite
+Timeout = 2000
+INI
+
+echo "export ODBCSYSINI=\"$directory\""
+echo "export ODBCINI=\"$directory/odbc.ini\""
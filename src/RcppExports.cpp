@@ -31,50 +31,113 @@ BEGIN_RCPP
     return R_NilValue;
 END_RCPP
 }
+// convert_records
+void convert_records(const Rcpp::CharacterVector& records_file, const Rcpp::CharacterVector& yaml_file);
+RcppExport SEXP _rdb_convert_records(SEXP records_fileSEXP, SEXP yaml_fileSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Rcpp::CharacterVector& >::type records_file(records_fileSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::CharacterVector& >::type yaml_file(yaml_fileSEXP);
+    convert_records(records_file, yaml_file);
+    return R_NilValue;
+END_RCPP
+}
+// refresh_extract
+Rcpp::NumericVector refresh_extract(const Rcpp::CharacterVector& config_path);
+RcppExport SEXP _rdb_refresh_extract(SEXP config_pathSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Rcpp::CharacterVector& >::type config_path(config_pathSEXP);
+    rcpp_result_gen = Rcpp::wrap(refresh_extract(config_path));
+    return rcpp_result_gen;
+END_RCPP
+}
 // make_acs_dataset
-Rcpp::List make_acs_dataset(const Rcpp::CharacterVector& config_path);
-RcppExport SEXP _rdb_make_acs_dataset(SEXP config_pathSEXP) {
+Rcpp::List make_acs_dataset(const Rcpp::CharacterVector& config_path, Rcpp::Nullable<Rcpp::NumericVector> only_nhs_numbers, SEXP arrow_schema, SEXP arrow_array);
+RcppExport SEXP _rdb_make_acs_dataset(SEXP config_pathSEXP, SEXP only_nhs_numbersSEXP, SEXP arrow_schemaSEXP, SEXP arrow_arraySEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< const Rcpp::CharacterVector& >::type config_path(config_pathSEXP);
-    rcpp_result_gen = Rcpp::wrap(make_acs_dataset(config_path));
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::NumericVector> >::type only_nhs_numbers(only_nhs_numbersSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type arrow_schema(arrow_schemaSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type arrow_array(arrow_arraySEXP);
+    rcpp_result_gen = Rcpp::wrap(make_acs_dataset(config_path, only_nhs_numbers, arrow_schema, arrow_array));
     return rcpp_result_gen;
 END_RCPP
 }
 // get_flat_codes
-Rcpp::List get_flat_codes(const Rcpp::CharacterVector& codes_file_path);
-RcppExport SEXP _rdb_get_flat_codes(SEXP codes_file_pathSEXP) {
+Rcpp::List get_flat_codes(const Rcpp::CharacterVector& codes_file_path, SEXP arrow_schema, SEXP arrow_array);
+RcppExport SEXP _rdb_get_flat_codes(SEXP codes_file_pathSEXP, SEXP arrow_schemaSEXP, SEXP arrow_arraySEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< const Rcpp::CharacterVector& >::type codes_file_path(codes_file_pathSEXP);
-    rcpp_result_gen = Rcpp::wrap(get_flat_codes(codes_file_path));
+    Rcpp::traits::input_parameter< SEXP >::type arrow_schema(arrow_schemaSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type arrow_array(arrow_arraySEXP);
+    rcpp_result_gen = Rcpp::wrap(get_flat_codes(codes_file_path, arrow_schema, arrow_array));
     return rcpp_result_gen;
 END_RCPP
 }
 // dump_groups
-Rcpp::List dump_groups(const Rcpp::CharacterVector& file);
-RcppExport SEXP _rdb_dump_groups(SEXP fileSEXP) {
+Rcpp::List dump_groups(const Rcpp::CharacterVector& file, SEXP arrow_schema, SEXP arrow_array);
+RcppExport SEXP _rdb_dump_groups(SEXP fileSEXP, SEXP arrow_schemaSEXP, SEXP arrow_arraySEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< const Rcpp::CharacterVector& >::type file(fileSEXP);
-    rcpp_result_gen = Rcpp::wrap(dump_groups(file));
+    Rcpp::traits::input_parameter< SEXP >::type arrow_schema(arrow_schemaSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type arrow_array(arrow_arraySEXP);
+    rcpp_result_gen = Rcpp::wrap(dump_groups(file, arrow_schema, arrow_array));
+    return rcpp_result_gen;
+END_RCPP
+}
+
+// get_patient_spells
+Rcpp::List get_patient_spells(const Rcpp::CharacterVector& config_path, const Rcpp::NumericVector& nhs_numbers, bool print);
+RcppExport SEXP _rdb_get_patient_spells(SEXP config_pathSEXP, SEXP nhs_numbersSEXP, SEXP printSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Rcpp::CharacterVector& >::type config_path(config_pathSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type nhs_numbers(nhs_numbersSEXP);
+    Rcpp::traits::input_parameter< bool >::type print(printSEXP);
+    rcpp_result_gen = Rcpp::wrap(get_patient_spells(config_path, nhs_numbers, print));
+    return rcpp_result_gen;
+END_RCPP
+}
+
+// query_patient_spells
+Rcpp::List query_patient_spells(const Rcpp::CharacterVector& config_path, const Rcpp::NumericVector& nhs_numbers, bool print);
+RcppExport SEXP _rdb_query_patient_spells(SEXP config_pathSEXP, SEXP nhs_numbersSEXP, SEXP printSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Rcpp::CharacterVector& >::type config_path(config_pathSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type nhs_numbers(nhs_numbersSEXP);
+    Rcpp::traits::input_parameter< bool >::type print(printSEXP);
+    rcpp_result_gen = Rcpp::wrap(query_patient_spells(config_path, nhs_numbers, print));
     return rcpp_result_gen;
 END_RCPP
 }
 
+void init_altrep_classes(DllInfo* dll);
 static const R_CallMethodDef CallEntries[] = {
     {"_rdb_test_cpp", (DL_FUNC) &_rdb_test_cpp, 1},
     {"_rdb_print_sql_query", (DL_FUNC) &_rdb_print_sql_query, 1},
-    {"_rdb_make_acs_dataset", (DL_FUNC) &_rdb_make_acs_dataset, 1},
-    {"_rdb_get_flat_codes", (DL_FUNC) &_rdb_get_flat_codes, 1},
-    {"_rdb_dump_groups", (DL_FUNC) &_rdb_dump_groups, 1},
+    {"_rdb_convert_records", (DL_FUNC) &_rdb_convert_records, 2},
+    {"_rdb_refresh_extract", (DL_FUNC) &_rdb_refresh_extract, 1},
+    {"_rdb_make_acs_dataset", (DL_FUNC) &_rdb_make_acs_dataset, 4},
+    {"_rdb_get_flat_codes", (DL_FUNC) &_rdb_get_flat_codes, 3},
+    {"_rdb_dump_groups", (DL_FUNC) &_rdb_dump_groups, 3},
+    {"_rdb_get_patient_spells", (DL_FUNC) &_rdb_get_patient_spells, 3},
+    {"_rdb_query_patient_spells", (DL_FUNC) &_rdb_query_patient_spells, 3},
     {NULL, NULL, 0}
 };
 
 RcppExport void R_init_rdb(DllInfo *dll) {
     R_registerRoutines(dll, NULL, CallEntries, NULL, NULL);
     R_useDynamicSymbols(dll, FALSE);
+    init_altrep_classes(dll);
 }
@@ -26,7 +26,7 @@ auto primary_pci(const Episode & episode, const ClinicalCodeMetagroup & pci_grou
 
 /// Is index event if there is a primary ACS or PCI
 /// in the _first_ episode of the spell
-auto get_acs_and_pci_spells(const std::vector<Spell> & spells,
+auto get_acs_and_pci_spells(const std::pmr::vector<Spell> & spells,
 			  const ClinicalCodeMetagroup & acs_group,
 			  const ClinicalCodeMetagroup & pci_group) {
     auto is_acs_index_spell{[&](const Spell &spell) {
@@ -59,7 +59,7 @@ auto get_index_secondaries(const Spell & index_spell, CodeType type) {
 /// Get all the spells whose start date is strictly between
 /// the time of the base spell and an offset in seconds (positive
 /// for after, negative for before). The base spell is not included.
-auto get_spells_in_window(const std::vector<Spell> & all_spells,
+auto get_spells_in_window(const std::pmr::vector<Spell> & all_spells,
 			  const Spell & base_spell,
 			  int offset_seconds) {
     auto in_window{[&base_spell, offset_seconds](const Spell & other_spell) {
@@ -81,6 +81,24 @@ auto get_spells_in_window(const std::vector<Spell> & all_spells,
 
 }
 
+/// True if the spell is one of the index spells, or starts strictly
+/// within the window (in either direction) of the start of one of them.
+/// Only these spells can contribute to the record of an index event.
+bool near_index_spell(const Spell & spell, std::ranges::range auto && index_spells,
+		      const TimestampOffset & window) {
+    return std::ranges::any_of(index_spells, [&](const Spell & index_spell) {
+	if (&spell == &index_spell) {
+	    return true;
+	}
+	auto spell_start{spell.start_date()};
+	auto index_start{index_spell.start_date()};
+	if (spell_start.null() or index_start.null()) {
+	    return false;
+	}
+	return std::abs((spell_start - index_start).value()) < window.value();
+    });
+}
+
 /// Fetch all the code groups present in the primary
 /// and secondary diagnoses and procedures of all the
 /// episodes in a vector of spells
@@ -0,0 +1,305 @@
+#include "acs_dataset.h"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <optional>
+#include <ranges>
+#include <set>
+#include <stdexcept>
+
+#include "acs.h"
+#include "event_counter.h"
+
+AcsDataset::AcsDataset(const YAML::Node & config, std::shared_ptr<ClinicalCodeParser> parser,
+		       std::shared_ptr<StringLookup> lookup, std::ostream & os)
+    : parser_{parser}, lookup_{lookup}, os_{os},
+      acs_metagroup_{config["code_groups"]["acs"], lookup},
+      pci_metagroup_{config["code_groups"]["pci"], lookup},
+      cardiac_death_metagroup_{config["code_groups"]["cardiac_death"], lookup},
+      stemi_metagroup_{config["code_groups"]["stemi"], lookup},
+      group_columns_{parser->all_groups(lookup)},
+      nhs_numbers_{table_.factor("nhs_number")},
+      index_dates_{table_.numeric("index_date")},
+      index_types_{table_.factor("index_type")},
+      ages_at_index_{table_.numeric("age_at_index")},
+      stemi_presentations_{table_.factor("stemi_presentation")},
+      survival_times_{table_.numeric("survival_time")},
+      causes_of_death_{table_.factor("cause_of_death")} {
+
+    // In lazy mode, only the primary codes are parsed up front (enough to
+    // find the index spells), and the secondaries are parsed only for the
+    // spells near an index spell
+    if (config["lazy_decode"] and config["lazy_decode"].as<bool>()) {
+	decode_mode_ = DecodeMode::Primary;
+    }
+
+    // The <group>_before and <group>_after columns count events in a
+    // one-year window. Each window (in days) in the optional count_windows
+    // list adds another pair of <group>_before_<n>d and <group>_after_<n>d
+    // columns. All windows are answered from the same per-patient timeline.
+    count_windows_.push_back({"", years(1)});
+    if (config["count_windows"]) {
+	std::set<long long> seen;
+	for (const auto & window : config["count_windows"]) {
+	    auto num_days{window.as<long long>()};
+	    // A repeated window would give two columns the same name
+	    if (num_days <= 0) {
+		throw std::runtime_error("count_windows must be positive (got "
+					 + std::to_string(num_days) + ")");
+	    }
+	    if (not seen.insert(num_days).second) {
+		throw std::runtime_error("Repeated window " + std::to_string(num_days)
+					 + " in count_windows");
+	    }
+	    count_windows_.push_back({"_" + std::to_string(num_days) + "d", days(num_days)});
+	}
+    }
+
+    // Spells further than this from every index spell are not counted
+    max_window_ = std::ranges::max(count_windows_ | std::views::values);
+
+    // Only index spells starting in [start_date, end_date) make rows
+    if (const auto & index_event{config["index_event"]}) {
+	if (index_event["start_date"]) {
+	    index_start_date_ = parse_date(index_event["start_date"].as<std::string>());
+	}
+	if (index_event["end_date"]) {
+	    index_end_date_ = parse_date(index_event["end_date"].as<std::string>());
+	}
+    }
+
+    // The count columns are added to the table in order of column name
+    counts_before_.resize(count_windows_.size() * group_columns_.size());
+    counts_after_.resize(count_windows_.size() * group_columns_.size());
+    std::map<std::string, NumericColumn **> count_columns;
+    for (std::size_t w{0}; w < count_windows_.size(); w++) {
+	const auto & suffix{count_windows_[w].first};
+	for (std::size_t c{0}; c < group_columns_.size(); c++) {
+	    auto n{w * group_columns_.size() + c};
+	    auto group_name{group_columns_.groups()[c].name(lookup)};
+	    count_columns[group_name + "_before" + suffix] = &counts_before_[n];
+	    count_columns[group_name + "_after" + suffix] = &counts_after_[n];
+	}
+    }
+    for (const auto & [column_name, column] : count_columns) {
+	*column = &table_.numeric(column_name);
+    }
+
+    // Printing every record to the console is slow, so a record is only
+    // printed if print_records_interval (in seconds) has passed since the
+    // last one printed
+    print_records_ = static_cast<bool>(config["print_records_interval"]);
+    if (print_records_) {
+	std::chrono::duration<double> seconds{config["print_records_interval"].as<double>()};
+	print_interval_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(seconds);
+    }
+    next_record_print_ = std::chrono::steady_clock::now();
+}
+
+std::pair<std::optional<Timestamp>, std::optional<Timestamp>>
+AcsDataset::spell_date_range() const {
+    auto window{static_cast<unsigned long long>(max_window_.value())};
+    std::pair<std::optional<Timestamp>, std::optional<Timestamp>> range;
+    // Timestamps are unsigned, so a start within the window of the epoch
+    // leaves the range open below (instead of wrapping round)
+    if (index_start_date_ and index_start_date_->read() >= window) {
+	range.first = Timestamp{index_start_date_->read() - window};
+    }
+    if (index_end_date_) {
+	range.second = Timestamp{index_end_date_->read() + window};
+    }
+    return range;
+}
+
+void AcsDataset::add_patient(Patient & patient, PipelineStats & stats, RecordSink * records) {
+
+    // Everything in this function is index logic, apart from the
+    // nested stages
+    ScopedStage index_stage{&stats.clock, Stage::Index};
+    stats.patients++;
+
+    // The date checked is the index_date reported for the spell (the
+    // start of its first episode)
+    auto in_date_range = [&](const Spell & spell) {
+	if (not index_start_date_ and not index_end_date_) {
+	    return true;
+	}
+	auto start{get_first_episode(spell).episode_start()};
+	return not start.null()
+	    and (not index_start_date_ or start >= *index_start_date_)
+	    and (not index_end_date_ or start < *index_end_date_);
+    };
+    auto index_spells{get_acs_and_pci_spells(patient.spells(), acs_metagroup_, pci_metagroup_)
+		      | std::views::filter(in_date_range)};
+    if (index_spells.empty()) {
+	return;
+    }
+
+    if (decode_mode_ == DecodeMode::Primary) {
+	patient.decode(parser_, [&](const Spell & spell) {
+	    return near_index_spell(spell, index_spells, max_window_);
+	});
+    }
+
+    auto nhs_number{patient.nhs_number()};
+    const auto & mortality{patient.mortality()};
+    const auto timeline{make_event_timeline(patient.spells(), group_columns_)};
+
+    for (const auto & index_spell : index_spells) {
+
+	if (index_spell.empty()) {
+	    continue;
+	}
+
+	const auto & first_episode_of_index{get_first_episode(index_spell)};
+	const auto pci_triggered{primary_pci(first_episode_of_index, pci_metagroup_)};
+	auto age_at_index{first_episode_of_index.age_at_episode()};
+	auto date_of_index{first_episode_of_index.episode_start()};
+	auto stemi_flag{get_stemi_presentation(index_spell, stemi_metagroup_)};
+
+	// Count events before/after
+	// Do not add secondary procedures into the counts, because they
+	// often represent the current index procedure (not prior procedures)
+	std::vector<std::size_t> index_secondary_counts(group_columns_.size(), 0);
+	for (const auto & group : get_index_secondaries(index_spell, CodeType::Diagnosis)) {
+	    index_secondary_counts[group_columns_.column(group)]++;
+	}
+
+	// Get the counts before and after for this record, in each window
+	std::vector<double> record_before(counts_before_.size());
+	std::vector<double> record_after(counts_after_.size());
+	auto index_start{index_spell.start_date()};
+	for (std::size_t w{0}; w < count_windows_.size(); w++) {
+	    const auto & window{count_windows_[w].second};
+	    for (std::size_t c{0}; c < group_columns_.size(); c++) {
+		auto n{w * group_columns_.size() + c};
+		auto before{timeline.count(c, index_start, TimestampOffset{-window.value()})};
+		auto after{timeline.count(c, index_start, window)};
+		record_before[n] = index_secondary_counts[c] + before;
+		record_after[n] = after;
+	    }
+	}
+
+	// Record mortality info
+	auto death_after{false};
+	auto cardiac_death{false};
+	std::optional<TimestampOffset> survival_time;
+	if (not mortality.alive()) {
+	    auto date_of_death{mortality.date_of_death()};
+	    if (not date_of_death.null() and not date_of_index.null()) {
+
+		if (date_of_death < date_of_index) {
+		    throw std::runtime_error("Unexpected date of death before index date at patient"
+					     + std::to_string(nhs_number));
+		}
+
+		// Check if death occurs in window after (hardcoded for now)
+		survival_time = date_of_death - date_of_index;
+		if (survival_time.value() < years(1)) {
+		    death_after = true;
+		    auto cause_of_death{mortality.cause_of_death()};
+		    if (cause_of_death.has_value()) {
+			cardiac_death = cardiac_death_metagroup_.contains(cause_of_death.value());
+		    }
+		}
+	    }
+	}
+	{
+	    ScopedStage append_stage{&stats.clock, Stage::Append};
+	    nhs_numbers_.push_back(std::to_string(nhs_number));
+	    index_types_.push_back(pci_triggered ? "PCI" : "ACS");
+	    try {
+		ages_at_index_.push_back(age_at_index.read());
+	    } catch (const Integer::Null &) {
+		ages_at_index_.push_back(std::numeric_limits<double>::quiet_NaN());
+	    }
+	    index_dates_.push_back(date_of_index.read());
+	    stemi_presentations_.push_back(stemi_flag ? "STEMI" : "NSTEMI");
+	    for (std::size_t n{0}; n < counts_before_.size(); n++) {
+		counts_before_[n]->push_back(record_before[n]);
+		counts_after_[n]->push_back(record_after[n]);
+	    }
+	    if (death_after) {
+		survival_times_.push_back(survival_time.value().value());
+		causes_of_death_.push_back(cardiac_death ? "cardiac" : "all_cause");
+	    } else {
+		survival_times_.push_back(std::numeric_limits<double>::quiet_NaN());
+		causes_of_death_.push_back("no_death");
+	    }
+	    stats.index_records++;
+	}
+
+	if (records) {
+
+	    ScopedStage records_stage{&stats.clock, Stage::Records};
+
+	    // The records show the spells and counts in the one-year window
+	    EventCounter event_counter{patient.spells().get_allocator().resource()};
+	    for (const auto & group : get_index_secondaries(index_spell, CodeType::Diagnosis)) {
+		event_counter.push_before(group);
+	    }
+
+	    auto spells_before{get_spells_in_window(patient.spells(), index_spell, -365*24*60*60)};
+	    for (const auto & group : get_all_groups(spells_before)) {
+		event_counter.push_before(group);
+	    }
+
+	    auto spells_after{get_spells_in_window(patient.spells(), index_spell, 365*24*60*60)};
+	    for (const auto & group : get_all_groups(spells_after)) {
+		event_counter.push_after(group);
+	    }
+
+	    RecordEncoder record;
+	    record.number(nhs_number);
+	    record.integer(age_at_index);
+	    record.timestamp(date_of_index);
+	    record.flag(stemi_flag);
+	    record.flag(pci_triggered);
+	    record.mortality(mortality);
+	    record.spell(index_spell);
+	    record.spells(spells_after);
+	    record.spells(spells_before);
+	    record.event_counts(event_counter);
+	    records->push(record.release());
+
+	    auto now{std::chrono::steady_clock::now()};
+	    if (print_records_ and now >= next_record_print_) {
+		next_record_print_ = now + print_interval_;
+		os_ << "====================================" << std::endl;
+		os_ << "PCI/ACS RECORD" << std::endl;
+		os_ << "------------------------------------" << std::endl;
+		os_ << "Pseudo NHS Number: " << nhs_number << std::endl;
+		os_ << "Age at index: " << age_at_index << std::endl;
+		os_ << "Index date: " << date_of_index << std::endl;
+		if (stemi_flag) {
+		    os_ << "Presentation: STEMI" << std::endl;
+		} else {
+		    os_ << "Presentation: NSTEMI" << std::endl;
+		}
+		if (pci_triggered) {
+		    os_ << "Inclusion trigger: PCI" << std::endl;
+		} else {
+		    os_ << "Inclusion trigger: ACS" << std::endl;
+		}
+		mortality.print(os_, lookup_);
+		if (survival_time.has_value()) {
+		    os_ << "Survival time: " << survival_time.value() << std::endl;
+		}
+		os_ << "EVENT COUNTS" << std::endl;
+		event_counter.print(os_, lookup_);
+		os_ << "INDEX SPELL" << std::endl;
+		index_spell.print(os_, lookup_, 4);
+		os_ << std::endl;
+		os_ << "SPELLS AFTER" << std::endl;
+		for (const auto & spell : spells_after) {
+		    spell.print(os_, lookup_, 4);
+		}
+		os_ << "SPELLS BEFORE" << std::endl;
+		for (const auto & spell : spells_before) {
+		    spell.print(os_, lookup_, 4);
+		}
+	    }
+	}
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef ACS_DATASET_HPP
+#define ACS_DATASET_HPP
+
+/**
+ * \file acs_dataset.h
+ * \brief Makes the rows of the ACS dataset from patients
+ *
+ * This is the part of make_acs_dataset that does not depend on R
+ * (everything apart from reading the arguments, checkpointing and
+ * converting the table to R vectors), so that the same logic can be
+ * run by the pipeline benchmark.
+ */
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "yaml.h"
+#include "clinical_code.h"
+#include "event_timeline.h"
+#include "patient.h"
+#include "pipeline_stats.h"
+#include "record_sink.h"
+#include "result_table.h"
+
+class AcsDataset {
+public:
+    /// Read the code groups, the count_windows, index_event dates,
+    /// lazy_decode and print_records_interval settings from the config,
+    /// and add the
+    /// (empty) columns to the table. Records are printed to os.
+    AcsDataset(const YAML::Node & config, std::shared_ptr<ClinicalCodeParser> parser,
+	       std::shared_ptr<StringLookup> lookup, std::ostream & os);
+
+    AcsDataset(const AcsDataset &) = delete;
+    AcsDataset & operator=(const AcsDataset &) = delete;
+
+    /// The rows made so far (checkpoints are loaded into this table)
+    ResultTable & table() {
+	return table_;
+    }
+
+    /// How much of each patient to parse when it is read. In Primary
+    /// mode, add_patient() parses the rest of the spells it needs.
+    DecodeMode decode_mode() const {
+	return decode_mode_;
+    }
+
+    /// The spell start dates [first, end) that can affect a row, either
+    /// of which is missing if the index_event block does not set it
+    /// (first is also missing if the widened start is before 1970):
+    /// the index_event date range, widened by the longest count window
+    /// on both sides (spells outside it are never counted). This assumes
+    /// that a spell does not start more than that window before its
+    /// first episode. Use it to fetch fewer rows; add_patient() does not
+    /// depend on it.
+    std::pair<std::optional<Timestamp>, std::optional<Timestamp>> spell_date_range() const;
+
+    /// Add a row to the table for each index spell of the patient (only
+    /// the index spells whose index_date, the start of the first
+    /// episode, is in the index_event date range), and
+    /// push its record to records (unless records is null). The time is
+    /// charged to the Index, Append and Records stages of stats.clock,
+    /// and the patient and index record counts in stats are updated.
+    void add_patient(Patient & patient, PipelineStats & stats, RecordSink * records);
+
+private:
+    std::shared_ptr<ClinicalCodeParser> parser_;
+    std::shared_ptr<StringLookup> lookup_;
+    std::ostream & os_;
+
+    ClinicalCodeMetagroup acs_metagroup_;
+    ClinicalCodeMetagroup pci_metagroup_;
+    ClinicalCodeMetagroup cardiac_death_metagroup_;
+    ClinicalCodeMetagroup stemi_metagroup_;
+    GroupColumns group_columns_;
+    DecodeMode decode_mode_{DecodeMode::Full};
+
+    // The window suffix (for the column names) and length of each
+    // count window, and the longest window
+    std::vector<std::pair<std::string, TimestampOffset>> count_windows_;
+    TimestampOffset max_window_{0};
+
+    // The index_event start_date and end_date (index spells must start
+    // on or after the first and before the second)
+    std::optional<Timestamp> index_start_date_;
+    std::optional<Timestamp> index_end_date_;
+
+    ResultTable table_;
+    FactorColumn & nhs_numbers_;
+    NumericColumn & index_dates_;
+    FactorColumn & index_types_;
+    NumericColumn & ages_at_index_;
+    FactorColumn & stemi_presentations_;
+    NumericColumn & survival_times_;
+    FactorColumn & causes_of_death_;
+
+    // One column of counts for each window and group, indexed by
+    // window * group_columns_.size() + group column
+    std::vector<NumericColumn *> counts_before_;
+    std::vector<NumericColumn *> counts_after_;
+
+    bool print_records_{false};
+    std::chrono::steady_clock::duration print_interval_{0};
+    std::chrono::steady_clock::time_point next_record_print_;
+};
+
+#endif
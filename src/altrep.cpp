@@ -0,0 +1,237 @@
+#include "altrep.h"
+
+#include <R_ext/Altrep.h>
+
+#include <algorithm>
+
+namespace {
+
+/// The ALTREP classes, made by init_altrep_classes
+R_altrep_class_t numeric_class;
+R_altrep_class_t factor_class;
+R_altrep_class_t strings_class;
+
+/// Free the C++ object owned by an external pointer (this is the
+/// finalizer, and is also called once the strings have been converted)
+template<typename T>
+void free_owned(SEXP ptr) {
+    delete static_cast<T *>(R_ExternalPtrAddr(ptr));
+    R_ClearExternalPtr(ptr);
+}
+
+/// An external pointer that owns the object (moved to the heap)
+template<typename T>
+SEXP make_owner(T && object) {
+    SEXP ptr{PROTECT(R_MakeExternalPtr(new T{std::move(object)}, R_NilValue, R_NilValue))};
+    R_RegisterCFinalizerEx(ptr, free_owned<T>, TRUE);
+    UNPROTECT(1);
+    return ptr;
+}
+
+double * vector_data(double *, SEXP x) {
+    return REAL(x);
+}
+
+int * vector_data(int *, SEXP x) {
+    return INTEGER(x);
+}
+
+/**
+ * \brief The methods of the numeric and factor classes
+ *
+ * data1 is an external pointer to the values (a std::vector of the
+ * numbers or the factor codes). The vector is the only owner of the
+ * values, and R only writes to a vector that is not shared (it
+ * duplicates a shared one first), so R reads and writes the values in
+ * place, through any pointer it asks for. Only a duplicate is copied.
+ */
+template<typename T, SEXPTYPE Type>
+struct ColumnVector {
+
+    using Values = std::vector<T>;
+
+    static Values & values(SEXP x) {
+	return *static_cast<Values *>(R_ExternalPtrAddr(R_altrep_data1(x)));
+    }
+
+    static R_xlen_t length(SEXP x) {
+	return static_cast<R_xlen_t>(values(x).size());
+    }
+
+    static void * dataptr(SEXP x, Rboolean) {
+	return values(x).data();
+    }
+
+    static const void * dataptr_or_null(SEXP x) {
+	return values(x).data();
+    }
+
+    static T elt(SEXP x, R_xlen_t i) {
+	return values(x)[static_cast<std::size_t>(i)];
+    }
+
+    static R_xlen_t get_region(SEXP x, R_xlen_t start, R_xlen_t size, T * buffer) {
+	auto count{std::min(size, length(x) - start)};
+	std::copy_n(values(x).data() + start, count, buffer);
+	return count;
+    }
+
+    /// A duplicate is an ordinary vector (R copies the attributes)
+    static SEXP duplicate(SEXP x, Rboolean) {
+	auto size{length(x)};
+	SEXP copy{PROTECT(Rf_allocVector(Type, size))};
+	std::copy_n(values(x).data(), size, vector_data(static_cast<T *>(nullptr), copy));
+	UNPROTECT(1);
+	return copy;
+    }
+
+    static Rboolean inspect(SEXP x, int, int, int, void (*)(SEXP, int, int, int)) {
+	Rprintf(" rdb column (%lld values)\n", static_cast<long long>(length(x)));
+	return TRUE;
+    }
+
+    /// Make a vector owning the values
+    static SEXP make(R_altrep_class_t c, Values && values) {
+	// R expects a data pointer even for an empty vector
+	values.reserve(1);
+	SEXP owner{PROTECT(make_owner(std::move(values)))};
+	SEXP x{R_new_altrep(c, owner, R_NilValue)};
+	UNPROTECT(1);
+	return x;
+    }
+
+    static void register_methods(R_altrep_class_t c) {
+	R_set_altrep_Length_method(c, length);
+	R_set_altrep_Duplicate_method(c, duplicate);
+	R_set_altrep_Inspect_method(c, inspect);
+	R_set_altvec_Dataptr_method(c, dataptr);
+	R_set_altvec_Dataptr_or_null_method(c, dataptr_or_null);
+	if constexpr (Type == REALSXP) {
+	    R_set_altreal_Elt_method(c, elt);
+	    R_set_altreal_Get_region_method(c, get_region);
+	} else {
+	    R_set_altinteger_Elt_method(c, elt);
+	    R_set_altinteger_Get_region_method(c, get_region);
+	}
+    }
+};
+
+using NumericAltrep = ColumnVector<double, REALSXP>;
+using FactorAltrep = ColumnVector<int, INTSXP>;
+
+/**
+ * \brief The methods of the character vector class
+ *
+ * data1 is an external pointer to the strings. R strings are made one
+ * at a time as the elements are read (R keeps its own cache of them).
+ * The first time R asks for a pointer to the data or sets an element,
+ * all the strings are converted into an ordinary vector in data2, and
+ * the C++ strings are freed.
+ */
+struct StringsAltrep {
+
+    using Strings = std::vector<std::string>;
+
+    static const Strings & strings(SEXP x) {
+	return *static_cast<const Strings *>(R_ExternalPtrAddr(R_altrep_data1(x)));
+    }
+
+    static bool copied(SEXP x) {
+	return R_altrep_data2(x) != R_NilValue;
+    }
+
+    static R_xlen_t length(SEXP x) {
+	if (copied(x)) {
+	    return XLENGTH(R_altrep_data2(x));
+	}
+	return static_cast<R_xlen_t>(strings(x).size());
+    }
+
+    static SEXP make_string(const std::string & string) {
+	return Rf_mkCharLenCE(string.data(), static_cast<int>(string.size()), CE_UTF8);
+    }
+
+    /// Convert all the strings to an ordinary vector in data2
+    static SEXP copy(SEXP x) {
+	if (not copied(x)) {
+	    const auto & source{strings(x)};
+	    SEXP copy{PROTECT(Rf_allocVector(STRSXP, static_cast<R_xlen_t>(source.size())))};
+	    for (std::size_t n{0}; n < source.size(); n++) {
+		SET_STRING_ELT(copy, static_cast<R_xlen_t>(n), make_string(source[n]));
+	    }
+	    R_set_altrep_data2(x, copy);
+	    UNPROTECT(1);
+	    free_owned<Strings>(R_altrep_data1(x));
+	}
+	return R_altrep_data2(x);
+    }
+
+    static void * dataptr(SEXP x, Rboolean) {
+	return const_cast<SEXP *>(STRING_PTR_RO(copy(x)));
+    }
+
+    static const void * dataptr_or_null(SEXP x) {
+	if (copied(x)) {
+	    return STRING_PTR_RO(R_altrep_data2(x));
+	}
+	return nullptr;
+    }
+
+    static SEXP elt(SEXP x, R_xlen_t i) {
+	if (copied(x)) {
+	    return STRING_ELT(R_altrep_data2(x), i);
+	}
+	return make_string(strings(x)[static_cast<std::size_t>(i)]);
+    }
+
+    static void set_elt(SEXP x, R_xlen_t i, SEXP value) {
+	SET_STRING_ELT(copy(x), i, value);
+    }
+
+    static Rboolean inspect(SEXP x, int, int, int, void (*)(SEXP, int, int, int)) {
+	Rprintf(" rdb strings (%s)\n", copied(x) ? "copied" : "in place");
+	return TRUE;
+    }
+
+    static void register_methods(R_altrep_class_t c) {
+	R_set_altrep_Length_method(c, length);
+	R_set_altrep_Inspect_method(c, inspect);
+	R_set_altvec_Dataptr_method(c, dataptr);
+	R_set_altvec_Dataptr_or_null_method(c, dataptr_or_null);
+	R_set_altstring_Elt_method(c, elt);
+	R_set_altstring_Set_elt_method(c, set_elt);
+    }
+};
+
+}
+
+// [[Rcpp::init]]
+void init_altrep_classes(DllInfo * dll) {
+    numeric_class = R_make_altreal_class("rdb_numeric", "rdb", dll);
+    NumericAltrep::register_methods(numeric_class);
+    factor_class = R_make_altinteger_class("rdb_factor", "rdb", dll);
+    FactorAltrep::register_methods(factor_class);
+    strings_class = R_make_altstring_class("rdb_strings", "rdb", dll);
+    StringsAltrep::register_methods(strings_class);
+}
+
+SEXP make_altrep_numeric(NumericColumn && column) {
+    return NumericAltrep::make(numeric_class, std::move(column));
+}
+
+SEXP make_altrep_factor(FactorColumn && column) {
+    auto levels{column.levels()};
+    SEXP levels_r{PROTECT(make_altrep_strings(std::vector<std::string>(levels.begin(), levels.end())))};
+    SEXP x{PROTECT(FactorAltrep::make(factor_class, column.take_codes()))};
+    Rf_setAttrib(x, R_LevelsSymbol, levels_r);
+    Rf_setAttrib(x, R_ClassSymbol, Rf_mkString("factor"));
+    UNPROTECT(2);
+    return x;
+}
+
+SEXP make_altrep_strings(std::vector<std::string> && strings) {
+    SEXP owner{PROTECT(make_owner(std::move(strings)))};
+    SEXP x{R_new_altrep(strings_class, owner, R_NilValue)};
+    UNPROTECT(1);
+    return x;
+}
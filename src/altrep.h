@@ -0,0 +1,46 @@
+#ifndef ALTREP_HPP
+#define ALTREP_HPP
+
+/**
+ * \file altrep.h
+ * \brief R vectors that read the columns of a ResultTable in place
+ *
+ * make_acs_dataset returns columns with millions of rows, and copying
+ * each one into a new R vector doubles the peak memory at the end of
+ * the run. The vectors made here are ALTREP vectors which own the C++
+ * column (moved into an external pointer, freed by the R garbage
+ * collector) and hand R a pointer to its data. R reads and writes the
+ * numeric and factor columns in place (even through REAL() and
+ * INTEGER(), which always ask for a writeable pointer), so they are
+ * only copied when R duplicates them. Character vectors are different:
+ * R needs its own strings, so the first pointer access converts them
+ * all into an ordinary vector.
+ *
+ * This file is only compiled into the R package.
+ */
+
+#include <Rcpp.h>
+
+#include <string>
+#include <vector>
+
+#include "result_table.h"
+
+/// Register the ALTREP classes. Called from R_init_rdb when the
+/// package is loaded.
+void init_altrep_classes(DllInfo * dll);
+
+/// A numeric vector over the column. NaN values must already have
+/// been replaced by NA_REAL.
+SEXP make_altrep_numeric(NumericColumn && column);
+
+/// A factor over the level numbers of the column. The levels are a
+/// character vector made by make_altrep_strings.
+SEXP make_altrep_factor(FactorColumn && column);
+
+/// A character vector over the strings. Elements are made into R
+/// strings when they are read, so a long vector that is only
+/// partly read is never converted in full.
+SEXP make_altrep_strings(std::vector<std::string> && strings);
+
+#endif
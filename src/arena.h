@@ -0,0 +1,131 @@
+/**
+ * \file arena.h
+ * \brief Memory resources for the per-patient objects
+ *
+ * The containers in Patient, Spell, Episode, EventCounter and
+ * EventTimeline are std::pmr containers, and the strings they keep
+ * (the spell id and the raw secondary codes) are std::pmr::strings. A PatientRange made with a
+ * PatientArena gives each patient it reads the arena's resource, and
+ * the spells and episodes pass it on to their own containers (they
+ * are allocator-aware, so a std::pmr::vector of them does this). The
+ * event timeline and counts made for a patient use the resource of
+ * its spells.
+ *
+ * The arena turns those allocations into pointer bumps in a monotonic
+ * buffer, which is released in one go before the next patient is
+ * read. Nothing allocated from the arena may be kept beyond the
+ * patient it was made for. The arena is never made the default
+ * resource, so nothing else allocates from it.
+ */
+
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <memory_resource>
+#include <memory>
+#include <vector>
+#include <ostream>
+
+/// Passes allocations through to another resource, counting them
+class CountingResource : public std::pmr::memory_resource {
+public:
+    explicit CountingResource(std::pmr::memory_resource * upstream)
+	: upstream_{upstream} {}
+
+    /// The number of calls to allocate
+    std::size_t num_allocations() const {
+	return num_allocations_;
+    }
+
+    /// The total number of bytes requested
+    std::size_t bytes_allocated() const {
+	return bytes_allocated_;
+    }
+
+private:
+    void * do_allocate(std::size_t bytes, std::size_t alignment) override {
+	num_allocations_++;
+	bytes_allocated_ += bytes;
+	return upstream_->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void * p, std::size_t bytes, std::size_t alignment) override {
+	upstream_->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource & other) const noexcept override {
+	return this == &other;
+    }
+
+    std::pmr::memory_resource * upstream_;
+    std::size_t num_allocations_{0};
+    std::size_t bytes_allocated_{0};
+};
+
+/**
+ * \brief Monotonic arena for the objects of one patient
+ *
+ * If use_arena is false, allocations go straight to new/delete.
+ * Either way, the allocations are counted, so that the two modes
+ * can be compared. With the arena on, the objects of a patient that
+ * fits in the initial buffer make no calls to new at all. Only the
+ * patient objects are counted: the strings read from the row buffer
+ * while making them are not.
+ */
+class PatientArena {
+public:
+    explicit PatientArena(bool use_arena, std::size_t initial_size = 256*1024)
+	: upstream_{std::pmr::new_delete_resource()} {
+	if (use_arena) {
+	    buffer_.resize(initial_size);
+	    arena_ = std::make_unique<std::pmr::monotonic_buffer_resource>(buffer_.data(),
+									   buffer_.size(),
+									   &upstream_);
+	    requests_ = std::make_unique<CountingResource>(arena_.get());
+	} else {
+	    requests_ = std::make_unique<CountingResource>(&upstream_);
+	}
+    }
+
+    // Containers hold pointers to the resources
+    PatientArena(const PatientArena &) = delete;
+    PatientArena & operator=(const PatientArena &) = delete;
+
+    /// The resource to allocate the patient objects from
+    std::pmr::memory_resource * resource() {
+	return requests_.get();
+    }
+
+    /// Release everything allocated since the last reset. All the
+    /// objects using the arena must have been destroyed first.
+    void reset() {
+	if (arena_) {
+	    arena_->release();
+	}
+    }
+
+    /// Allocations requested by the patient objects
+    std::size_t num_allocations() const {
+	return requests_->num_allocations();
+    }
+
+    /// Allocations that reached new/delete
+    std::size_t num_upstream_allocations() const {
+	return upstream_.num_allocations();
+    }
+
+    void print(std::ostream & os) const {
+	os << "Patient object allocations: " << num_allocations()
+	   << " (" << requests_->bytes_allocated() << " bytes), of which "
+	   << num_upstream_allocations() << " reached the system allocator"
+	   << std::endl;
+    }
+
+private:
+    CountingResource upstream_;
+    std::vector<std::byte> buffer_;
+    std::unique_ptr<std::pmr::monotonic_buffer_resource> arena_;
+    std::unique_ptr<CountingResource> requests_;
+};
+
+#endif
@@ -0,0 +1,249 @@
+#include "arrow_export.h"
+
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+
+namespace {
+
+static_assert(sizeof(int) == sizeof(std::int32_t), "Factor codes are exported as int32");
+
+/// What an exported schema owns
+struct SchemaData {
+    std::string format;
+    std::string name;
+    std::vector<ArrowSchema *> children;
+    ArrowSchema * dictionary{nullptr};
+};
+
+/// What an exported array owns. Only the members used by the type
+/// of the array are filled in.
+struct ArrayData {
+    NumericColumn values;
+    std::vector<int> indices;
+    std::vector<std::uint8_t> validity;
+    std::vector<std::int32_t> offsets;
+    std::string chars;
+    std::vector<const void *> buffers;
+    std::vector<ArrowArray *> children;
+    ArrowArray * dictionary{nullptr};
+};
+
+// A consumer may move a child out of a parent (leaving the child's
+// release callback null), so only children that are still owned are
+// released
+
+void release_schema(ArrowSchema * schema) {
+    auto * data{static_cast<SchemaData *>(schema->private_data)};
+    for (auto * child : data->children) {
+	if (child->release) {
+	    child->release(child);
+	}
+	delete child;
+    }
+    if (data->dictionary) {
+	if (data->dictionary->release) {
+	    data->dictionary->release(data->dictionary);
+	}
+	delete data->dictionary;
+    }
+    delete data;
+    schema->release = nullptr;
+}
+
+void release_array(ArrowArray * array) {
+    auto * data{static_cast<ArrayData *>(array->private_data)};
+    for (auto * child : data->children) {
+	if (child->release) {
+	    child->release(child);
+	}
+	delete child;
+    }
+    if (data->dictionary) {
+	if (data->dictionary->release) {
+	    data->dictionary->release(data->dictionary);
+	}
+	delete data->dictionary;
+    }
+    delete data;
+    array->release = nullptr;
+}
+
+SchemaData * init_schema(ArrowSchema * schema, const std::string & format,
+			 const std::string & name, std::int64_t flags) {
+    auto * data{new SchemaData};
+    data->format = format;
+    data->name = name;
+    schema->format = data->format.c_str();
+    schema->name = data->name.c_str();
+    schema->metadata = nullptr;
+    schema->flags = flags;
+    schema->n_children = 0;
+    schema->children = nullptr;
+    schema->dictionary = nullptr;
+    schema->release = release_schema;
+    schema->private_data = data;
+    return data;
+}
+
+ArrayData * init_array(ArrowArray * array, std::size_t length) {
+    auto * data{new ArrayData};
+    array->length = static_cast<std::int64_t>(length);
+    array->null_count = 0;
+    array->offset = 0;
+    array->n_buffers = 0;
+    array->n_children = 0;
+    array->buffers = nullptr;
+    array->children = nullptr;
+    array->dictionary = nullptr;
+    array->release = release_array;
+    array->private_data = data;
+    return data;
+}
+
+/// Point the schema at the children and dictionary in its data
+/// (once they have all been added)
+void finish_schema(ArrowSchema * schema) {
+    auto * data{static_cast<SchemaData *>(schema->private_data)};
+    schema->n_children = static_cast<std::int64_t>(data->children.size());
+    schema->children = data->children.data();
+    schema->dictionary = data->dictionary;
+}
+
+/// Point the array at the buffers, children and dictionary in its data
+void finish_array(ArrowArray * array) {
+    auto * data{static_cast<ArrayData *>(array->private_data)};
+    array->n_buffers = static_cast<std::int64_t>(data->buffers.size());
+    array->buffers = data->buffers.data();
+    array->n_children = static_cast<std::int64_t>(data->children.size());
+    array->children = data->children.data();
+    array->dictionary = data->dictionary;
+}
+
+/// A float64 array over the column, with NaN values null
+void export_numeric(NumericColumn && column, const std::string & name,
+		    ArrowSchema * schema, ArrowArray * array) {
+    init_schema(schema, "g", name, ARROW_FLAG_NULLABLE);
+    auto * data{init_array(array, column.size())};
+    data->values = std::move(column);
+
+    // The validity bitmap (least significant bit first) is only made
+    // if there are nulls
+    std::size_t num_null{0};
+    for (std::size_t n{0}; n < data->values.size(); n++) {
+	if (std::isnan(data->values[n])) {
+	    if (num_null == 0) {
+		data->validity.assign((data->values.size() + 7) / 8, 0xff);
+	    }
+	    data->validity[n / 8] &= static_cast<std::uint8_t>(~(1u << (n % 8)));
+	    num_null++;
+	}
+    }
+    array->null_count = static_cast<std::int64_t>(num_null);
+    data->buffers = {num_null > 0 ? data->validity.data() : nullptr, data->values.data()};
+    finish_array(array);
+}
+
+/// A utf8 array of the strings (with 32-bit offsets)
+template<typename Strings>
+void export_strings(const Strings & strings, const std::string & name,
+		    ArrowSchema * schema, ArrowArray * array) {
+    init_schema(schema, "u", name, 0);
+    auto * data{init_array(array, 0)};
+    data->offsets.push_back(0);
+    for (const auto & string : strings) {
+	data->chars += string;
+	if (data->chars.size() > static_cast<std::size_t>(std::numeric_limits<std::int32_t>::max())) {
+	    array->release(array);
+	    schema->release(schema);
+	    throw std::runtime_error("Too many characters in string column " + name);
+	}
+	data->offsets.push_back(static_cast<std::int32_t>(data->chars.size()));
+    }
+    array->length = static_cast<std::int64_t>(data->offsets.size() - 1);
+    data->buffers = {nullptr, data->offsets.data(), data->chars.data()};
+    finish_array(array);
+}
+
+/// An int32 array of indices (from 0) into a utf8 dictionary of the levels
+void export_factor(FactorColumn && column, const std::string & name,
+		   ArrowSchema * schema, ArrowArray * array) {
+    auto * schema_data{init_schema(schema, "i", name, 0)};
+    auto * data{init_array(array, column.size())};
+    schema_data->dictionary = new ArrowSchema;
+    data->dictionary = new ArrowArray;
+    export_strings(column.levels(), "", schema_data->dictionary, data->dictionary);
+
+    // Level numbers count from 1
+    data->indices = column.take_codes();
+    for (auto & index : data->indices) {
+	index--;
+    }
+    data->buffers = {nullptr, data->indices.data()};
+    finish_schema(schema);
+    finish_array(array);
+}
+
+/// Add a child schema and array to a struct, and return them
+std::pair<ArrowSchema *, ArrowArray *> add_child(ArrowSchema * schema, ArrowArray * array) {
+    auto * schema_data{static_cast<SchemaData *>(schema->private_data)};
+    auto * array_data{static_cast<ArrayData *>(array->private_data)};
+    schema_data->children.push_back(new ArrowSchema);
+    array_data->children.push_back(new ArrowArray);
+    // Children that are never exported must not be released
+    schema_data->children.back()->release = nullptr;
+    array_data->children.back()->release = nullptr;
+    return {schema_data->children.back(), array_data->children.back()};
+}
+
+/// Start a struct array with the given number of rows
+void init_struct(ArrowSchema * schema, ArrowArray * array, std::size_t num_rows) {
+    init_schema(schema, "+s", "", 0);
+    auto * data{init_array(array, num_rows)};
+    data->buffers = {nullptr};
+}
+
+void finish_struct(ArrowSchema * schema, ArrowArray * array) {
+    finish_schema(schema);
+    finish_array(array);
+}
+
+}
+
+void export_arrow(ResultTable && table, ArrowSchema * schema, ArrowArray * array) {
+    init_struct(schema, array, table.num_rows());
+    for (const auto & name : table.names()) {
+	auto [child_schema, child_array] = add_child(schema, array);
+	auto column{table.take(name)};
+	if (auto * numeric = std::get_if<NumericColumn>(&column)) {
+	    export_numeric(std::move(*numeric), name, child_schema, child_array);
+	} else {
+	    export_factor(std::get<FactorColumn>(std::move(column)), name,
+			  child_schema, child_array);
+	}
+    }
+    finish_struct(schema, array);
+}
+
+void export_arrow(const StringColumns & columns, ArrowSchema * schema, ArrowArray * array) {
+    std::size_t num_rows{columns.empty() ? 0 : columns.front().second.size()};
+    for (const auto & [name, values] : columns) {
+	if (values.size() != num_rows) {
+	    throw std::runtime_error("String column " + name + " has a different length");
+	}
+    }
+    init_struct(schema, array, num_rows);
+    for (const auto & [name, values] : columns) {
+	auto [child_schema, child_array] = add_child(schema, array);
+	try {
+	    export_strings(values, name, child_schema, child_array);
+	} catch (const std::runtime_error &) {
+	    finish_struct(schema, array);
+	    schema->release(schema);
+	    array->release(array);
+	    throw;
+	}
+    }
+    finish_struct(schema, array);
+}
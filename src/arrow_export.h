@@ -0,0 +1,87 @@
+#ifndef ARROW_EXPORT_HPP
+#define ARROW_EXPORT_HPP
+
+/**
+ * \file arrow_export.h
+ * \brief Export tables through the Arrow C data interface
+ *
+ * The Arrow C data interface is a C ABI (the ArrowSchema and
+ * ArrowArray structs below, copied from the Arrow specification),
+ * so no Arrow library is needed to produce it. Any consumer that
+ * implements it (the arrow and nanoarrow R packages, DuckDB, Polars,
+ * pyarrow) can take the table without copying it, and call the
+ * release callbacks when it is finished with it.
+ *
+ * A table is exported as a struct array with one child array per
+ * column. Numeric columns are float64 arrays over the moved column,
+ * with NaN exported as null. Factor columns are dictionary-encoded
+ * (int32 indices into a utf8 dictionary of the levels).
+ */
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "result_table.h"
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+extern "C" {
+
+struct ArrowSchema {
+    // Array type description
+    const char * format;
+    const char * name;
+    const char * metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema ** children;
+    struct ArrowSchema * dictionary;
+
+    // Release callback
+    void (*release)(struct ArrowSchema *);
+    // Opaque producer-specific data
+    void * private_data;
+};
+
+struct ArrowArray {
+    // Array data description
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void ** buffers;
+    struct ArrowArray ** children;
+    struct ArrowArray * dictionary;
+
+    // Release callback
+    void (*release)(struct ArrowArray *);
+    // Opaque producer-specific data
+    void * private_data;
+};
+
+}
+
+#endif
+
+/// Columns of strings, as (column name, values) pairs
+using StringColumns = std::vector<std::pair<std::string, std::vector<std::string>>>;
+
+/// Move the columns of the table into schema and array (the table
+/// is left with empty columns). The caller owns schema and array,
+/// and must call their release callbacks.
+void export_arrow(ResultTable && table, ArrowSchema * schema, ArrowArray * array);
+
+/// Export columns of strings (which must all be the same length) as
+/// utf8 columns. Throws std::runtime_error if they are not the same
+/// length, or are too long for 32-bit offsets.
+void export_arrow(const StringColumns & columns, ArrowSchema * schema, ArrowArray * array);
+
+#endif
@@ -0,0 +1,205 @@
+/**
+ * \file kernels.cpp
+ * \brief Microbenchmarks for the functions on the hot path of
+ * make_acs_dataset
+ *
+ * Run from the build directory (like the tests), so that the relative
+ * paths in scripts/config.yaml resolve. Use the bench-json target, or
+ * pass --benchmark_out=<file> --benchmark_out_format=json, to save the
+ * results for comparison.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "config.h"
+#include "category.h"
+#include "clinical_code.h"
+#include "episode.h"
+#include "episode_row.h"
+#include "acs.h"
+#include "patient.h"
+#include "synthetic_row_buffer.h"
+
+namespace {
+
+const YAML::Node & bench_config() {
+    static const auto config{load_config_file("../../scripts/config.yaml")};
+    return config;
+}
+
+/// All the codes in the diagnosis codes file, with some whitespace
+/// and punctuation as in the raw data
+std::vector<std::string> raw_diagnosis_codes() {
+    TopLevelCategory diagnoses{YAML::LoadFile(
+	    bench_config()["parser"]["diagnosis_file"].as<std::string>())};
+    std::vector<std::string> codes;
+    for (const auto & [code, docs] : diagnoses.all_codes_and_docs()) {
+	codes.push_back(" " + code + "  ");
+    }
+    return codes;
+}
+
+}
+
+static void BM_Preprocess(benchmark::State & state) {
+    auto codes{raw_diagnosis_codes()};
+    std::size_t n{0};
+    for (auto _ : state) {
+	benchmark::DoNotOptimize(preprocess(codes[n++ % codes.size()]));
+    }
+}
+BENCHMARK(BM_Preprocess);
+
+/// Parse codes that are already in the cache
+static void BM_CachingParserHit(benchmark::State & state) {
+    TopLevelCategory diagnoses{YAML::LoadFile(
+	    bench_config()["parser"]["diagnosis_file"].as<std::string>())};
+    auto codes{raw_diagnosis_codes()};
+    codes.resize(std::min<std::size_t>(codes.size(), 200));
+    for (const auto & code : codes) {
+	diagnoses.parse(code);
+    }
+    std::size_t n{0};
+    for (auto _ : state) {
+	benchmark::DoNotOptimize(diagnoses.parse(codes[n++ % codes.size()]));
+    }
+}
+BENCHMARK(BM_CachingParserHit);
+
+/// Parse codes that are not in the cache yet. When every code has
+/// been parsed once, the parser is remade (outside the timing)
+static void BM_CachingParserMiss(benchmark::State & state) {
+    auto file{bench_config()["parser"]["diagnosis_file"].as<std::string>()};
+    auto codes{raw_diagnosis_codes()};
+    auto diagnoses{std::make_unique<TopLevelCategory>(YAML::LoadFile(file))};
+    std::size_t n{0};
+    for (auto _ : state) {
+	if (n == codes.size()) {
+	    state.PauseTiming();
+	    diagnoses = std::make_unique<TopLevelCategory>(YAML::LoadFile(file));
+	    n = 0;
+	    state.ResumeTiming();
+	}
+	benchmark::DoNotOptimize(diagnoses->parse(codes[n++]));
+    }
+}
+BENCHMARK(BM_CachingParserMiss);
+
+/// Parse a code that is not valid (these are never cached)
+static void BM_CachingParserInvalid(benchmark::State & state) {
+    auto lookup{new_string_lookup()};
+    auto parser{new_clinical_code_parser(bench_config()["parser"], lookup)};
+    for (auto _ : state) {
+	benchmark::DoNotOptimize(parser->parse(CodeType::Diagnosis, "XX12"));
+    }
+}
+BENCHMARK(BM_CachingParserInvalid);
+
+static void BM_StringLookupInsert(benchmark::State & state) {
+    StringLookup lookup;
+    std::vector<std::string> strings;
+    for (std::size_t n{0}; n < 1000; n++) {
+	strings.push_back("string_" + std::to_string(n));
+    }
+    std::size_t n{0};
+    for (auto _ : state) {
+	benchmark::DoNotOptimize(lookup.insert_string(strings[n++ % strings.size()]));
+    }
+}
+BENCHMARK(BM_StringLookupInsert);
+
+static void BM_StringLookupAt(benchmark::State & state) {
+    StringLookup lookup;
+    for (std::size_t n{0}; n < 1000; n++) {
+	lookup.insert_string("string_" + std::to_string(n));
+    }
+    std::size_t n{0};
+    for (auto _ : state) {
+	benchmark::DoNotOptimize(lookup.at(n++ % 1000));
+    }
+}
+BENCHMARK(BM_StringLookupAt);
+
+/// Check codes (about 1 in 10 in the group) against the acs metagroup
+static void BM_MetagroupContains(benchmark::State & state) {
+    auto lookup{new_string_lookup()};
+    auto parser{new_clinical_code_parser(bench_config()["parser"], lookup)};
+    ClinicalCodeMetagroup acs{bench_config()["code_groups"]["acs"], lookup};
+    std::vector<ClinicalCode> codes;
+    for (const auto & raw : raw_diagnosis_codes()) {
+	codes.push_back(parser->parse(CodeType::Diagnosis, raw));
+    }
+    std::vector<ClinicalCode> sample;
+    for (std::size_t n{0}; n < 900; n++) {
+	sample.push_back(codes[(n * 7919) % codes.size()]);
+    }
+    for (const auto * raw : {"I210", "I211", "I219", "I220", "I214"}) {
+	for (std::size_t n{0}; n < 20; n++) {
+	    sample.push_back(parser->parse(CodeType::Diagnosis, raw));
+	}
+    }
+    std::size_t n{0};
+    for (auto _ : state) {
+	benchmark::DoNotOptimize(acs.contains(sample[n++ % sample.size()]));
+    }
+}
+BENCHMARK(BM_MetagroupContains);
+
+/// Convert an ODBC date/time to a Timestamp (this calls mktime)
+static void BM_TimestampConversion(benchmark::State & state) {
+    SQL_TIMESTAMP_STRUCT datetime{};
+    datetime.year = 2015;
+    datetime.month = 6;
+    datetime.hour = 12;
+    unsigned day{0};
+    for (auto _ : state) {
+	datetime.day = static_cast<SQLUSMALLINT>(1 + day++ % 28);
+	benchmark::DoNotOptimize(Timestamp{datetime});
+    }
+}
+BENCHMARK(BM_TimestampConversion);
+
+/// Make an Episode from a row with the given number of secondaries
+static void BM_EpisodeFromRow(benchmark::State & state) {
+    auto lookup{new_string_lookup()};
+    auto parser{new_clinical_code_parser(bench_config()["parser"], lookup)};
+    EpisodeRowBuffer row;
+    row.set_primary_diagnosis("I210");
+    row.set_primary_procedure("K432");
+    auto num_secondaries{static_cast<std::size_t>(state.range(0))};
+    for (std::size_t n{0}; n < num_secondaries; n++) {
+	row.push_secondary_diagnosis(n % 2 == 0 ? "I209" : "E119");
+	row.push_secondary_procedure("K111");
+    }
+    for (auto _ : state) {
+	Episode episode{row, parser};
+	benchmark::DoNotOptimize(episode);
+    }
+}
+BENCHMARK(BM_EpisodeFromRow)->Arg(0)->Arg(4)->Arg(23);
+
+/// Find the spells in a one-year window of a patient's spells
+static void BM_SpellsInWindow(benchmark::State & state) {
+    auto lookup{new_string_lookup()};
+    auto parser{new_clinical_code_parser(bench_config()["parser"], lookup)};
+    auto synthetic{read_synthetic_config(bench_config())};
+    synthetic.num_patients = 1;
+    synthetic.spells_per_patient = static_cast<double>(state.range(0));
+    synthetic.days_between_spells = 60;
+    SyntheticRowBuffer row{synthetic, parser};
+    Patient patient{row, parser};
+    const auto & spells{patient.spells()};
+    const auto & base{spells[spells.size() / 2]};
+    for (auto _ : state) {
+	// The result is a lazy view, so walk it to do the filtering
+	std::size_t count{0};
+	for ([[maybe_unused]] const auto & spell : get_spells_in_window(spells, base, 365*24*60*60)) {
+	    count++;
+	}
+	benchmark::DoNotOptimize(count);
+    }
+    state.counters["spells"] = static_cast<double>(spells.size());
+}
+BENCHMARK(BM_SpellsInWindow)->Arg(5)->Arg(50);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,184 @@
+/**
+ * \file odbc_fetch.cpp
+ * \brief Benchmark of the ODBC fetch path against a local database
+ *
+ * Loads synthetic HES rows (see synthetic_row_buffer.h) into a table
+ * in the data source, then times execute_direct and fetching every
+ * row through SqlRowBuffer, reading every column of each row (as the
+ * Patient constructor does). This measures the overhead of the driver
+ * and the column bindings without the latency of the real server.
+ * The only fetch mode is one row at a time (SQLFetch into the bound
+ * buffers); the mode column of the output is there so that other
+ * modes can be compared with it.
+ *
+ * Use scripts/utils/sqlite_dsn.sh to make a unixODBC data source
+ * backed by the SQLite ODBC driver (the bench-odbc target does this
+ * and runs the benchmark). Run from the build directory, so that the
+ * relative paths in scripts/config.yaml resolve.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <vector>
+#include <string>
+
+#include "config.h"
+#include "clinical_code.h"
+#include "pipeline_stats.h"
+#include "synthetic_row_buffer.h"
+#include "sql_connection.h"
+#include "sql_load.h"
+#include "bench/sizes.h"
+
+#include "cmdline/cmdline.hpp"
+
+namespace {
+
+/// The timing of one query
+struct FetchRun {
+    std::string mode;
+    std::size_t table_rows{0};
+    std::size_t code_columns{0};
+    std::size_t rows{0};
+    double execute_seconds{0};
+    double fetch_seconds{0};
+    double convert_seconds{0};
+};
+
+/// Read every column of the current row
+template<typename R>
+void read_all_columns(const R & row, const std::vector<ColumnSpec> & columns) {
+    for (const auto & column : columns) {
+	switch (column.type) {
+	case ColumnType::Varchar:
+	    row.template at<Varchar>(column.name);
+	    break;
+	case ColumnType::Integer:
+	    row.template at<Integer>(column.name);
+	    break;
+	case ColumnType::Timestamp:
+	    row.template at<Timestamp>(column.name);
+	    break;
+	}
+    }
+}
+
+/// Run the query and fetch every row, one row at a time
+FetchRun fetch_row_at_a_time(SQLConnection & connection, const std::string & query) {
+    FetchRun run;
+    run.mode = "row_at_a_time";
+    StageClock clock;
+    clock.enter(Stage::Query);
+    auto row{connection.execute_direct(query)};
+    clock.enter(Stage::Other);
+    auto columns{row.columns()};
+    TimedRowBuffer timed_row{row, clock, true};
+    while (not timed_row.end()) {
+	read_all_columns(timed_row, columns);
+	timed_row.try_fetch_next_row();
+    }
+    clock.enter(Stage::Other);
+    run.rows = timed_row.rows_read();
+    run.execute_seconds = clock.time(Stage::Query).count();
+    run.fetch_seconds = clock.time(Stage::Fetch).count();
+    run.convert_seconds = clock.time(Stage::Convert).count();
+    return run;
+}
+
+void print_header(std::ostream & os) {
+    os << "mode,table_rows,code_columns,rows,execute_seconds,fetch_seconds,"
+       << "convert_seconds,rows_per_second" << std::endl;
+}
+
+void print_run(std::ostream & os, const FetchRun & run) {
+    auto seconds{run.execute_seconds + run.fetch_seconds + run.convert_seconds};
+    os << run.mode << "," << run.table_rows << "," << run.code_columns << ","
+       << run.rows << "," << run.execute_seconds << "," << run.fetch_seconds << ","
+       << run.convert_seconds << "," << (seconds > 0 ? run.rows / seconds : 0) << std::endl;
+}
+
+}
+
+int main(int argc, char ** argv) {
+
+    CommandLine cmd;
+
+    const std::string program_name{ "rdb-odbc-bench" };
+    const std::string version{ "v0.1.0" };
+    const std::string short_desc{"A benchmark of fetching rows over ODBC"};
+    const std::string long_desc{R"xyz(rdb-odbc-bench loads synthetic HES rows into a table in an ODBC data source (for example a local SQLite database), and times executing a query and fetching all the rows, printing the results as CSV.)xyz"};
+
+    cmd.addOption<std::string>('d', "dsn", "The data source name (e.g. rdb_bench)");
+    cmd.addOption<std::string>('c', "config",
+			       "The config file (default: ../../scripts/config.yaml)");
+    cmd.addOption<std::string>('r', "rows",
+			       "Comma-separated numbers of rows (default: 10k,100k,1M)");
+    cmd.addOption<std::string>('k', "columns",
+			       "Comma-separated numbers of code columns (default: 47)");
+    cmd.addOption<std::size_t>('n', "repeat",
+			       "The number of times to run each query (default: 3)");
+    cmd.addOption<std::string>('t', "table",
+			       "The table to load (default: rdb_bench_hes, which is replaced)");
+    cmd.addOption<std::string>('o', "output",
+			       "Also write the CSV to this file");
+
+    if(cmd.parse(argc, argv) != 0) {
+	std::cerr << "An error occurred while parsing the command line arguments"
+		  << std::endl;
+	return 1;
+    }
+
+    auto dsn{cmd.get<std::string>('d')};
+    if (not dsn) {
+	std::cerr << "Missing the data source name (--dsn)" << std::endl;
+	return 1;
+    }
+
+    try {
+	auto config{load_config_file(cmd.get<std::string>('c').value_or("../../scripts/config.yaml"))};
+	auto table{cmd.get<std::string>('t').value_or("rdb_bench_hes")};
+	auto repeat{cmd.get<std::size_t>('n').value_or(3)};
+	auto all_rows{parse_sizes(cmd.get<std::string>('r').value_or("10k,100k,1M"))};
+	auto all_columns{parse_sizes(cmd.get<std::string>('k').value_or("47"))};
+
+	SQLConnection connection{dsn.value()};
+	auto lookup{new_string_lookup()};
+	auto parser{new_clinical_code_parser(config["parser"], lookup)};
+	auto query{"SELECT * FROM " + table + " ORDER BY nhs_number, spell_id"};
+
+	std::vector<FetchRun> runs;
+	for (auto code_columns : all_columns) {
+	    for (auto num_rows : all_rows) {
+		SyntheticRowBuffer rows{synthetic_size(config, num_rows, code_columns), parser};
+		auto load_start{std::chrono::steady_clock::now()};
+		auto table_rows{load_table(connection, table, rows)};
+		std::chrono::duration<double> load_time{std::chrono::steady_clock::now() - load_start};
+		std::cerr << "Loaded " << table_rows << " rows with " << code_columns
+			  << " code columns in " << load_time.count() << " s" << std::endl;
+
+		for (std::size_t n{0}; n < repeat; n++) {
+		    auto run{fetch_row_at_a_time(connection, query)};
+		    run.table_rows = table_rows;
+		    run.code_columns = code_columns;
+		    runs.push_back(run);
+		}
+	    }
+	}
+
+	print_header(std::cout);
+	for (const auto & run : runs) {
+	    print_run(std::cout, run);
+	}
+	if (auto output_path{cmd.get<std::string>('o')}) {
+	    std::ofstream output{output_path.value()};
+	    print_header(output);
+	    for (const auto & run : runs) {
+		print_run(output, run);
+	    }
+	}
+    } catch (const std::exception & e) {
+	std::cerr << "Failed with error: " << e.what() << std::endl;
+	return 1;
+    }
+}
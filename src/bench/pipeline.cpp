@@ -0,0 +1,229 @@
+/**
+ * \file pipeline.cpp
+ * \brief End-to-end benchmark of the make_acs_dataset pipeline
+ *
+ * Runs everything that make_acs_dataset does apart from converting
+ * the table to R vectors (reading the rows, assembling patients,
+ * parsing codes, finding index spells and appending rows) over the
+ * synthetic row buffer, or over a local extract, for each number of
+ * rows and code columns. The defaults give the scaling curve for
+ * 10k, 100k, 1M and 10M rows at 4, 10 and 47 code columns (the two
+ * scenarios in profiles/README.md are 500k rows with 4 columns and
+ * 1.5M rows with 10 columns).
+ *
+ * The number of code columns is the total number of diagnosis and
+ * procedure columns, including the two primary columns, so 47 is
+ * close to the real query (which has 48). The synthetic rows use the
+ * synthetic block of the config file, apart from num_patients (set
+ * from the number of rows) and the numbers of secondary columns.
+ *
+ * The peak memory is the peak of the whole process so far (it cannot
+ * be reset), so every run after the largest one reports the largest
+ * one's peak. The bench-pipeline target therefore runs each size in
+ * a new process (with --rows and --columns), appending each result
+ * to pipeline.csv with --append. Run from the build directory (like
+ * the tests), so that the relative paths in scripts/config.yaml
+ * resolve.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <optional>
+#include <filesystem>
+
+#include "config.h"
+#include "clinical_code.h"
+#include "patient.h"
+#include "acs_dataset.h"
+#include "pipeline_stats.h"
+#include "extract.h"
+#include "synthetic_row_buffer.h"
+#include "bench/sizes.h"
+
+#include "cmdline/cmdline.hpp"
+
+namespace {
+
+/// The result of one run of the pipeline
+struct PipelineRun {
+    std::string source;
+    std::size_t code_columns{0};
+    double seconds{0};
+    PipelineStats stats;
+};
+
+/// Run the pipeline over all the rows, as make_acs_dataset does (the
+/// time making the row buffer and the dataset columns is charged to
+/// the query stage, and is not counted in the throughput)
+template<RowBuffer R>
+void run_pipeline(R & row, const YAML::Node & config,
+		  std::shared_ptr<ClinicalCodeParser> parser,
+		  std::shared_ptr<StringLookup> lookup, PipelineRun & run) {
+
+    AcsDataset dataset{config, parser, lookup, std::cout};
+    auto & stats{run.stats};
+    auto start{std::chrono::steady_clock::now()};
+    if (config["time_parsing"] and config["time_parsing"].as<bool>()) {
+	parser->set_stage_clock(&stats.clock);
+    }
+    stats.clock.enter(Stage::Assemble);
+    TimedRowBuffer timed_row{row, stats.clock};
+    for (auto & patient : patients(timed_row, parser, dataset.decode_mode())) {
+	dataset.add_patient(patient, stats, nullptr);
+    }
+    stats.clock.enter(Stage::Other);
+    parser->set_stage_clock(nullptr);
+    run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    stats.rows = timed_row.rows_read();
+    stats.procedures = parser->parse_counts(CodeType::Procedure);
+    stats.diagnoses = parser->parse_counts(CodeType::Diagnosis);
+    stats.peak_rss = peak_rss_bytes();
+}
+
+/// Make about num_rows synthetic rows with the given number of code
+/// columns, and run the pipeline over them
+PipelineRun run_synthetic(const YAML::Node & config, std::size_t num_rows,
+			  std::size_t code_columns) {
+    // Each run has its own parser, so that the cache starts empty
+    auto lookup{new_string_lookup()};
+    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+
+    auto synthetic{synthetic_size(config, num_rows, code_columns)};
+    PipelineRun run;
+    run.source = "synthetic";
+    run.code_columns = code_columns;
+    run.stats.clock.enter(Stage::Query);
+    SyntheticRowBuffer row{synthetic, parser};
+    run_pipeline(row, config, parser, lookup, run);
+    return run;
+}
+
+/// Run the pipeline over the rows of a local extract
+PipelineRun run_extract(const YAML::Node & config, const std::string & file_path) {
+    auto lookup{new_string_lookup()};
+    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+    PipelineRun run;
+    run.source = file_path;
+    run.stats.clock.enter(Stage::Query);
+    ExtractRowBuffer row{file_path};
+    for (const auto & column : row.columns()) {
+	if (column.name.starts_with("primary_diagnosis")
+	    or column.name.starts_with("primary_procedure")
+	    or column.name.starts_with("secondary_")) {
+	    run.code_columns++;
+	}
+    }
+    run_pipeline(row, config, parser, lookup, run);
+    return run;
+}
+
+void print_header(std::ostream & os) {
+    os << "source,code_columns,rows,patients,index_records,seconds,rows_per_second,"
+       << "diagnosis_hit_rate,procedure_hit_rate,peak_rss_mb";
+    for (std::size_t n{0}; n < static_cast<std::size_t>(Stage::Count); n++) {
+	os << "," << stage_name(static_cast<Stage>(n)) << "_seconds";
+    }
+    os << std::endl;
+}
+
+void print_run(std::ostream & os, const PipelineRun & run) {
+    const auto & stats{run.stats};
+    os << run.source << "," << run.code_columns << "," << stats.rows << ","
+       << stats.patients << "," << stats.index_records << "," << run.seconds << ","
+       << (run.seconds > 0 ? stats.rows / run.seconds : 0) << ","
+       << stats.diagnoses.hit_rate() << "," << stats.procedures.hit_rate() << ","
+       << static_cast<double>(stats.peak_rss) / (1024 * 1024);
+    for (std::size_t n{0}; n < static_cast<std::size_t>(Stage::Count); n++) {
+	os << "," << stats.clock.time(static_cast<Stage>(n)).count();
+    }
+    os << std::endl;
+}
+
+}
+
+int main(int argc, char ** argv) {
+
+    CommandLine cmd;
+
+    const std::string program_name{ "rdb-pipeline-bench" };
+    const std::string version{ "v0.1.0" };
+    const std::string short_desc{"An end-to-end benchmark of make_acs_dataset"};
+    const std::string long_desc{R"xyz(rdb-pipeline-bench runs the make_acs_dataset pipeline (without R) over synthetic rows, or a local extract, and prints the throughput, parse cache hit rate, peak memory and time in each stage of each run as CSV.)xyz"};
+
+    cmd.addOption<std::string>('c', "config",
+			       "The config file (default: ../../scripts/config.yaml)");
+    cmd.addOption<std::string>('r', "rows",
+			       "Comma-separated numbers of rows (default: 10k,100k,1M,10M)");
+    cmd.addOption<std::string>('k', "columns",
+			       "Comma-separated numbers of code columns (default: 4,10,47)");
+    cmd.addOption<std::string>('e', "extract",
+			       "Read the rows from this extract instead of making them up");
+    cmd.addOption<std::string>('o', "output",
+			       "Also write the CSV to this file");
+    cmd.addOption<std::string>('a', "append",
+			       "Append the CSV rows to this file (with the header if it is new)");
+
+    if(cmd.parse(argc, argv) != 0) {
+	std::cerr << "An error occurred while parsing the command line arguments"
+		  << std::endl;
+	return 1;
+    }
+
+    try {
+	auto config{load_config_file(cmd.get<std::string>('c').value_or("../../scripts/config.yaml"))};
+
+	std::vector<PipelineRun> runs;
+	auto report = [&](PipelineRun run) {
+	    std::cerr << "Finished " << run.source << " with " << run.stats.rows << " rows and "
+		      << run.code_columns << " code columns in " << run.seconds << " s" << std::endl;
+	    run.stats.print_stage_times(std::cerr);
+	    runs.push_back(std::move(run));
+	};
+
+	if (auto extract{cmd.get<std::string>('e')}) {
+	    report(run_extract(config, extract.value()));
+	} else {
+	    auto rows{parse_sizes(cmd.get<std::string>('r').value_or("10k,100k,1M,10M"))};
+	    auto columns{parse_sizes(cmd.get<std::string>('k').value_or("4,10,47"))};
+	    for (auto code_columns : columns) {
+		for (auto num_rows : rows) {
+		    report(run_synthetic(config, num_rows, code_columns));
+		}
+	    }
+	    if (runs.size() > 1) {
+		std::cerr << "Note: the peak memory of each run includes the runs "
+			  << "before it (run each size on its own to measure it)" << std::endl;
+	    }
+	}
+
+	print_header(std::cout);
+	for (const auto & run : runs) {
+	    print_run(std::cout, run);
+	}
+	if (auto output_path{cmd.get<std::string>('o')}) {
+	    std::ofstream output{output_path.value()};
+	    print_header(output);
+	    for (const auto & run : runs) {
+		print_run(output, run);
+	    }
+	}
+	if (auto append_path{cmd.get<std::string>('a')}) {
+	    auto is_new{not std::filesystem::exists(append_path.value())
+			or std::filesystem::file_size(append_path.value()) == 0};
+	    std::ofstream output{append_path.value(), std::ios::app};
+	    if (is_new) {
+		print_header(output);
+	    }
+	    for (const auto & run : runs) {
+		print_run(output, run);
+	    }
+	}
+    } catch (const std::exception & e) {
+	std::cerr << "Failed with error: " << e.what() << std::endl;
+	return 1;
+    }
+}
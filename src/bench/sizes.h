@@ -0,0 +1,47 @@
+#ifndef BENCH_SIZES_HPP
+#define BENCH_SIZES_HPP
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "synthetic_row_buffer.h"
+
+/// Parse a comma-separated list of sizes, which may end in k or M
+/// (for example "10k,100k,1M")
+inline std::vector<std::size_t> parse_sizes(const std::string & list) {
+    std::vector<std::size_t> sizes;
+    std::stringstream ss{list};
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+	std::size_t multiplier{1};
+	if (not item.empty() and item.back() == 'k') {
+	    multiplier = 1000;
+	    item.pop_back();
+	} else if (not item.empty() and item.back() == 'M') {
+	    multiplier = 1000000;
+	    item.pop_back();
+	}
+	sizes.push_back(std::stoull(item) * multiplier);
+    }
+    return sizes;
+}
+
+/// The synthetic block of the config, changed to make about num_rows
+/// rows with code_columns diagnosis and procedure columns in all
+/// (including the two primary columns, so 47 is close to the real
+/// query). The secondary columns are split evenly between diagnoses
+/// and procedures.
+inline SyntheticConfig synthetic_size(const YAML::Node & config, std::size_t num_rows,
+				      std::size_t code_columns) {
+    auto synthetic{read_synthetic_config(config)};
+    auto rows_per_patient{synthetic.spells_per_patient * synthetic.episodes_per_spell};
+    synthetic.num_patients = std::max<std::size_t>(1, num_rows / rows_per_patient);
+    auto secondary_columns{code_columns > 2 ? code_columns - 2 : 0};
+    synthetic.secondary_diagnosis_columns = (secondary_columns + 1) / 2;
+    synthetic.secondary_procedure_columns = secondary_columns / 2;
+    return synthetic;
+}
+
+#endif
@@ -1,5 +1,6 @@
 #include <iostream>
 #include "category.h"
+#include "trace.h"
 #include <ranges>
 #include "yaml.h"
 
@@ -222,8 +223,12 @@ CacheEntry CachingParser::parse(const std::string & code,
 				const std::vector<Category> & categories,
 				const std::set<std::string> & all_groups) {
     try {
-	return cache_.at(code);
+	auto & entry{cache_.at(code)};
+	hits_++;
+	return entry;
     } catch (const std::out_of_range &) {
+	misses_++;
+	RDB_TRACE_SPAN("parse_miss");
 	auto result{get_code_prop(code, categories, all_groups)};
 	cache_.insert({code, result});
 	return result;
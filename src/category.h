@@ -15,12 +15,14 @@
 
 #include <yaml-cpp/yaml.h>
 
-/// Select a random element from a vector
+#include "random.h"
+
+/// Select a random element from a vector (the same element for the
+/// same generator state on every platform)
 template<typename T>
 const T & select_random(const std::vector<T> & in,
 		std::uniform_random_bit_generator auto & gen) {
-    std::uniform_int_distribution<> rnd(0, in.size()-1);
-    return in[rnd(gen)];
+    return in[uniform_below(gen, in.size())];
 }
 
 /// Indexes the categories
@@ -181,8 +183,15 @@ public:
 		     const std::vector<Category> & categories,
 		     const std::set<std::string> & all_groups);
     std::size_t cache_size() const { return cache_.size(); }
+    /// The number of parses answered from the cache
+    std::size_t hits() const { return hits_; }
+    /// The number of parses that searched the tree (including
+    /// invalid codes, which are not cached)
+    std::size_t misses() const { return misses_; }
 private:
     std::map<std::string, CacheEntry> cache_;
+    std::size_t hits_{0};
+    std::size_t misses_{0};
 };
 
 /// Do some initial checks on the code (remove whitespace
@@ -211,6 +220,14 @@ public:
     std::size_t cache_size() const {
 	return parser_.cache_size();
     }
+
+    std::size_t cache_hits() const {
+	return parser_.hits();
+    }
+
+    std::size_t cache_misses() const {
+	return parser_.misses();
+    }
     
     void print(std::ostream & os) const;
 
@@ -0,0 +1,163 @@
+#include "checkpoint.h"
+#include "trace.h"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <limits>
+#include <cmath>
+#include "synthetic_row_buffer.h"
+
+namespace {
+
+/// Write a value to the rows file. Factor levels must not contain
+/// the separator or a newline
+void write_value(std::ostream & os, const ResultTable::Column & column, std::size_t row) {
+    if (const auto * numeric = std::get_if<NumericColumn>(&column)) {
+	auto value{(*numeric)[row]};
+	if (std::isnan(value)) {
+	    os << "NA";
+	} else {
+	    os << value;
+	}
+    } else {
+	auto value{std::get<FactorColumn>(column).at(row)};
+	if (value.find_first_of(",\n") != std::string::npos) {
+	    throw std::runtime_error("Cannot save the value '" + value + "' in a checkpoint");
+	}
+	os << value;
+    }
+}
+
+}
+
+std::string checkpoint_source(const YAML::Node & config) {
+    std::stringstream source;
+    if (config["synthetic"] and config["synthetic"]["enabled"]
+	and config["synthetic"]["enabled"].as<bool>()) {
+	auto synthetic{read_synthetic_config(config)};
+	source << "synthetic rows (seed " << synthetic.seed << ", "
+	       << synthetic.num_patients << " patients)";
+    } else if (config["extract"] and config["extract"]["mode"]
+	       and config["extract"]["mode"].as<std::string>() == "read") {
+	std::string file_path{"gendata/extract.rdbx"};
+	if (config["extract"]["file"]) {
+	    file_path = config["extract"]["file"].as<std::string>();
+	}
+	source << "extract " << file_path << " (" << std::filesystem::file_size(file_path)
+	       << " bytes, modified at "
+	       << std::filesystem::last_write_time(file_path).time_since_epoch().count() << ")";
+    } else {
+	source << "database";
+	if (config["connection"] and config["connection"]["dsn"]) {
+	    source << " " << config["connection"]["dsn"].as<std::string>();
+	}
+    }
+    return source.str();
+}
+
+Checkpoint::Checkpoint(const std::string & directory, const std::string & source)
+    : directory_{directory}, source_{source} {
+    std::filesystem::create_directories(directory_);
+}
+
+void Checkpoint::save(const ResultTable & table, unsigned long long last_nhs_number) {
+    RDB_TRACE_SPAN("checkpoint_save");
+    auto num_rows{table.num_rows()};
+    {
+	std::ofstream rows{rows_path(), rows_saved_ == 0 ? std::ios::trunc : std::ios::app};
+	rows << std::setprecision(std::numeric_limits<double>::max_digits10);
+	if (rows_saved_ == 0) {
+	    for (std::size_t c{0}; c < table.names().size(); c++) {
+		rows << (c > 0 ? "," : "") << table.names()[c];
+	    }
+	    rows << "\n";
+	}
+	for (std::size_t row{rows_saved_}; row < num_rows; row++) {
+	    for (std::size_t c{0}; c < table.names().size(); c++) {
+		if (c > 0) {
+		    rows << ",";
+		}
+		write_value(rows, table.at(table.names()[c]), row);
+	    }
+	    rows << "\n";
+	}
+	rows.flush();
+	if (not rows) {
+	    throw std::runtime_error("Failed to write the checkpoint rows");
+	}
+    }
+
+    YAML::Emitter state;
+    state << YAML::BeginMap
+	  << YAML::Key << "source" << YAML::Value << source_
+	  << YAML::Key << "last_nhs_number" << YAML::Value << last_nhs_number
+	  << YAML::Key << "num_rows" << YAML::Value << num_rows
+	  << YAML::Key << "columns" << YAML::Value << table.names()
+	  << YAML::EndMap;
+    auto temporary{state_path()};
+    temporary += ".tmp";
+    {
+	std::ofstream state_file{temporary};
+	state_file << state.c_str() << std::endl;
+	if (not state_file) {
+	    throw std::runtime_error("Failed to write the checkpoint state");
+	}
+    }
+    std::filesystem::rename(temporary, state_path());
+    rows_saved_ = num_rows;
+}
+
+std::optional<unsigned long long> Checkpoint::load(ResultTable & table) {
+    rows_saved_ = 0;
+    if (not std::filesystem::exists(state_path())) {
+	return std::nullopt;
+    }
+    auto state{YAML::LoadFile(state_path().string())};
+    auto num_rows{state["num_rows"].as<std::size_t>()};
+    auto source{state["source"] ? state["source"].as<std::string>() : "an unknown source"};
+    if (source != source_) {
+	throw std::runtime_error("The checkpoint was made from " + source + ", not from "
+				 + source_ + " (set resume to false to start again)");
+    }
+    if (state["columns"].as<std::vector<std::string>>() != table.names()) {
+	throw std::runtime_error("The checkpoint columns do not match the dataset "
+				 "columns (has the config file changed?)");
+    }
+
+    std::ifstream rows{rows_path()};
+    std::string line;
+    std::getline(rows, line);
+    for (std::size_t row{0}; row < num_rows; row++) {
+	if (not std::getline(rows, line)) {
+	    throw std::runtime_error("The checkpoint has fewer rows than expected");
+	}
+	std::stringstream values{line};
+	for (const auto & name : table.names()) {
+	    std::string value;
+	    std::getline(values, value, ',');
+	    if (std::holds_alternative<NumericColumn>(table.at(name))) {
+		table.numeric(name).push_back(value == "NA"
+					      ? std::numeric_limits<double>::quiet_NaN()
+					      : std::stod(value));
+	    } else {
+		table.factor(name).push_back(value);
+	    }
+	}
+    }
+
+    // Drop any rows appended after the state was last saved
+    auto end_of_rows{rows.tellg()};
+    rows.close();
+    if (end_of_rows >= 0) {
+	std::filesystem::resize_file(rows_path(), static_cast<std::uintmax_t>(end_of_rows));
+    }
+    rows_saved_ = num_rows;
+    return state["last_nhs_number"].as<unsigned long long>();
+}
+
+void Checkpoint::clear() {
+    std::filesystem::remove(rows_path());
+    std::filesystem::remove(state_path());
+    rows_saved_ = 0;
+}
@@ -0,0 +1,106 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <string>
+#include <optional>
+#include <filesystem>
+#include <stdexcept>
+
+#include "result_table.h"
+#include "yaml.h"
+
+/// Describe where the rows of a run come from, so that a checkpoint
+/// is only resumed against the same rows: the database (and its
+/// dsn), the extract (its path, size and modification time, which
+/// change when it is rewritten or refreshed), or the synthetic rows
+/// (their seed and number of patients). config is the whole config.
+std::string checkpoint_source(const YAML::Node & config);
+
+/**
+ * \brief Saves a partly made ResultTable, to resume after a failure
+ *
+ * The rows are appended to rows.csv in the checkpoint directory, and
+ * state.yaml records how many rows are complete and the nhs_number of
+ * the last patient whose rows are all saved, and the source of the
+ * rows (see checkpoint_source). The state file is only
+ * replaced (atomically) after the rows are written, so a failure
+ * part way through a save leaves the previous checkpoint valid.
+ *
+ * Because the query is ordered by nhs_number, a resumed run only has
+ * to fetch the patients after the last one saved.
+ */
+class Checkpoint {
+public:
+    /// Use the checkpoint files in directory (created if needed), for
+    /// a run reading its rows from source (see checkpoint_source)
+    Checkpoint(const std::string & directory, const std::string & source);
+
+    /// Append the rows of the table that are not saved yet, and
+    /// record the last patient whose rows are all in the table
+    void save(const ResultTable & table, unsigned long long last_nhs_number);
+
+    /// Read the saved rows into a table, which must already have the
+    /// same columns as the saved table (but no rows). Returns the last
+    /// nhs_number saved, or nullopt if there is no checkpoint. Throws
+    /// runtime_error if the saved columns or the source are different.
+    std::optional<unsigned long long> load(ResultTable & table);
+
+    /// Delete the saved checkpoint
+    void clear();
+
+private:
+    std::filesystem::path rows_path() const {
+	return directory_ / "rows.csv";
+    }
+
+    std::filesystem::path state_path() const {
+	return directory_ / "state.yaml";
+    }
+
+    std::filesystem::path directory_;
+    std::string source_;
+    std::size_t rows_saved_{0};
+};
+
+/**
+ * \brief Skips the patients already saved in a checkpoint
+ *
+ * The extract and the synthetic rows are read from the start when a
+ * run is resumed, so the patients up to and including the last one
+ * saved are skipped. If that patient never turns up, the rows are not
+ * the ones the checkpoint was made from, and finish() throws (rather
+ * than returning only the saved rows as if the run had finished).
+ */
+class SkipSavedPatients {
+public:
+    /// Skip nothing if last_saved is nullopt
+    explicit SkipSavedPatients(std::optional<unsigned long long> last_saved)
+	: last_saved_{last_saved} {}
+
+    /// Whether the patient with this nhs_number is already saved
+    bool skip(unsigned long long nhs_number) {
+	if (not last_saved_) {
+	    return false;
+	}
+	if (nhs_number == *last_saved_) {
+	    last_saved_.reset();
+	}
+	return true;
+    }
+
+    /// Call after the last patient. Throws runtime_error if the last
+    /// patient saved was never seen.
+    void finish() const {
+	if (last_saved_) {
+	    throw std::runtime_error("The last patient saved in the checkpoint ("
+				     + std::to_string(*last_saved_)
+				     + ") was not found in the rows (set resume "
+				     "to false to start again)");
+	}
+    }
+
+private:
+    std::optional<unsigned long long> last_saved_;
+};
+
+#endif
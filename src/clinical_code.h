@@ -14,6 +14,8 @@
 
 #include "string_lookup.h"
 
+class StageClock;
+
 class ClinicalCode;
 
 /// A wrapper for the set of IDs that describe a code
@@ -53,6 +55,11 @@ public:
     ClinicalCodeGroup(const std::string & group, std::shared_ptr<StringLookup> lookup);
     std::string name(std::shared_ptr<StringLookup> lookup) const;
 
+    /// The lookup id of the group name
+    std::size_t id() const {
+	return group_id_;
+    }
+
     bool contains(const ClinicalCode & code) const;
 
     void print(std::ostream & os, std::shared_ptr<StringLookup> lookup) const {
@@ -150,6 +157,12 @@ public:
     auto null() const {
 	return not data_.has_value();
     }
+
+    /// True for a code whose raw string was not found by the
+    /// parser (note that such a code is also null())
+    auto invalid() const {
+	return invalid_.has_value();
+    }
     
     const auto & group_ids() const {
 	if (not valid()) {
@@ -159,6 +172,27 @@ public:
 	}
     }
 
+    /// Get the lookup id of the code name, or of the raw string
+    /// for an invalid code. Throws Invalid for a null code
+    std::size_t name_id() const {
+	if (valid()) {
+	    return data_->name_id();
+	} else if (invalid()) {
+	    return *invalid_;
+	} else {
+	    throw Invalid{};
+	}
+    }
+
+    /// Get the lookup id of the docs string. Throws Invalid if
+    /// the code is not valid
+    std::size_t docs_id() const {
+	if (not valid()) {
+	    throw Invalid{};
+	}
+	return data_->docs_id();
+    }
+
 private:
     std::optional<std::size_t> invalid_{std::nullopt};
     std::optional<ClinicalCodeData> data_{std::nullopt};
@@ -200,6 +234,25 @@ enum class CodeType {
     Procedure
 };
 
+/// Cache use of the parser for one kind of code
+struct ParseCounts {
+    std::size_t cache_hits{0};
+    std::size_t cache_misses{0};
+    std::size_t invalid{0};
+
+    void add(const ParseCounts & other) {
+	cache_hits += other.cache_hits;
+	cache_misses += other.cache_misses;
+	invalid += other.invalid;
+    }
+
+    /// The share of the parses (valid or not) answered from the cache
+    double hit_rate() const {
+	auto total{cache_hits + cache_misses};
+	return total > 0 ? static_cast<double>(cache_hits) / total : 0;
+    }
+};
+
 /// Deals with both procedures and diagnoses, but stores
 /// all the results in the same string pool, so no ids will
 /// ever accidentally overlap. This means that you should not
@@ -242,6 +295,11 @@ public:
 	    // If the code is empty, return the null-clinical code
 	    return ClinicalCode{};
 	} catch (const ParserException::CodeNotFound &) {
+	    if (type == CodeType::Procedure) {
+		invalid_procedures_++;
+	    } else {
+		invalid_diagnoses_++;
+	    }
 	    // Store the invalid raw code in the lookup
 	    auto raw_string_id{lookup_->insert_string(raw_code)};
 	    // Makes an invalid code
@@ -249,6 +307,30 @@ public:
 	}
     }
 
+    /// Set the clock that the callers of parse() charge the parsing
+    /// time to (see timed_parse() in episode.h), or pass nullptr to
+    /// stop timing
+    void set_stage_clock(StageClock * clock) {
+	stage_clock_ = clock;
+    }
+
+    /// The clock set by set_stage_clock() (null if parsing is not timed)
+    StageClock * stage_clock() const {
+	return stage_clock_;
+    }
+
+    /// The cache hits and misses, and the number of invalid codes,
+    /// for one type of code
+    ParseCounts parse_counts(CodeType type) const {
+	if (type == CodeType::Procedure) {
+	    return {procedure_parser_.cache_hits(), procedure_parser_.cache_misses(),
+		    invalid_procedures_};
+	} else {
+	    return {diagnosis_parser_.cache_hits(), diagnosis_parser_.cache_misses(),
+		    invalid_diagnoses_};
+	}
+    }
+
     auto all_groups(std::shared_ptr<StringLookup> lookup) const {
 	std::set<ClinicalCodeGroup> groups;
 	for (const auto & group_name : procedure_parser_.all_groups()) {
@@ -277,6 +359,9 @@ private:
     std::shared_ptr<StringLookup> lookup_;
     TopLevelCategory procedure_parser_;
     TopLevelCategory diagnosis_parser_;
+    std::size_t invalid_procedures_{0};
+    std::size_t invalid_diagnoses_{0};
+    StageClock * stage_clock_{nullptr};
 };
 
 /// Make a new parser from a configuration block
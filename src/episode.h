@@ -6,16 +6,28 @@
 
 #include "set_utils.h"
 #include "clinical_code.h"
+#include "pipeline_stats.h"
 
 #include "sql_types.h"
 
+#include <cctype>
+#include <memory_resource>
+
+/// Parse a code, charging the time to Stage::Parse of the parser's
+/// stage clock (if it has one)
+inline ClinicalCode timed_parse(ClinicalCodeParser & parser, CodeType code_type,
+				const std::string & raw) {
+    ScopedStage stage{parser.stage_clock(), Stage::Parse};
+    return parser.parse(code_type, raw);
+}
+
 ClinicalCode
 read_clinical_code_column(const std::string & column_name,
 			  CodeType code_type, RowBuffer auto & row,
 			  std::shared_ptr<ClinicalCodeParser> parser) {
     try {
 	auto raw{column<Varchar>(column_name, row).read()};
-	return parser->parse(code_type, raw);
+	return timed_parse(*parser, code_type, raw);
     } catch (const Varchar::Null &) {
 	// Column is null, record empty code
 	return ClinicalCode{};
@@ -26,11 +38,13 @@ read_clinical_code_column(const std::string & column_name,
 
 /// Read columns named prefix<n>, where <n> is a non-negative
 /// number. Short-circuit on the first empty or NULL. Throw
-/// runtime error for missing columns or invalid types.
-std::vector<ClinicalCode>
+/// runtime error for missing columns or invalid types. The
+/// result is allocated with alloc.
+std::pmr::vector<ClinicalCode>
 read_secondary_columns(const std::string & prefix, CodeType code_type,
-		       RowBuffer auto & row, std::shared_ptr<ClinicalCodeParser> parser) {
-    std::vector<ClinicalCode> secondaries;
+		       RowBuffer auto & row, std::shared_ptr<ClinicalCodeParser> parser,
+		       const std::pmr::polymorphic_allocator<> & alloc = {}) {
+    std::pmr::vector<ClinicalCode> secondaries{alloc};
     for (std::size_t n{0}; true; n++) {
 	auto column_name{prefix + std::to_string(n)};
 
@@ -54,12 +68,104 @@ read_secondary_columns(const std::string & prefix, CodeType code_type,
     return secondaries;
 }
 
+/// Read the raw strings in columns named prefix<n> without parsing
+/// them. Stops at the first NULL, empty (whitespace) or missing
+/// column, which is where read_secondary_columns also stops. The
+/// vector and the strings are allocated with alloc.
+std::pmr::vector<std::pmr::string>
+read_raw_secondary_columns(const std::string & prefix, RowBuffer auto & row,
+			   const std::pmr::polymorphic_allocator<> & alloc = {}) {
+    std::pmr::vector<std::pmr::string> raw_secondaries{alloc};
+    for (std::size_t n{0}; true; n++) {
+	auto column_name{prefix + std::to_string(n)};
+	try {
+	    auto raw{column<Varchar>(column_name, row).read()};
+	    if (std::ranges::all_of(raw, [](unsigned char c) { return std::isspace(c); })) {
+		break;
+	    }
+	    raw_secondaries.emplace_back(raw);
+	} catch (const Varchar::Null &) {
+	    break;
+	} catch (const RowBufferException::ColumnNotFound &) {
+	    break;
+	} catch (const RowBufferException::WrongColumnType &) {
+	    throw std::runtime_error("Column '" + column_name + "' must have type Varchar");
+	}
+    }
+    return raw_secondaries;
+}
+
+/// Parse raw secondary codes read by read_raw_secondary_columns. As
+/// in read_secondary_columns, stop at the first code that is not valid.
+inline std::pmr::vector<ClinicalCode>
+parse_secondary_codes(const std::pmr::vector<std::pmr::string> & raw_secondaries,
+		      CodeType code_type, std::shared_ptr<ClinicalCodeParser> parser,
+		      const std::pmr::polymorphic_allocator<> & alloc = {}) {
+    std::pmr::vector<ClinicalCode> secondaries{alloc};
+    for (const auto & raw : raw_secondaries) {
+	auto secondary{timed_parse(*parser, code_type, std::string{raw})};
+	if (not secondary.valid()) {
+	    break;
+	}
+	secondaries.push_back(secondary);
+    }
+    return secondaries;
+}
+
+/// How much of each episode row to parse on construction. In
+/// Primary mode, only the primary diagnosis and procedure are
+/// parsed, and the secondary columns are kept as raw strings
+/// until decode() is called. This avoids parsing the secondary
+/// columns of patients that are not needed.
+enum class DecodeMode {
+    Full,
+    Primary
+};
+
 class Episode {
 public:
 
+    /// The secondary code vectors are allocated with this allocator,
+    /// which a std::pmr::vector<Episode> passes to each element it
+    /// makes (see PatientRange)
+    using allocator_type = std::pmr::polymorphic_allocator<>;
+
     /// Create an episode with all empty (null) fields
     Episode() = default;
 
+    explicit Episode(const allocator_type & alloc)
+	: secondary_procedures_{alloc}, secondary_diagnoses_{alloc},
+	  raw_secondary_procedures_{alloc}, raw_secondary_diagnoses_{alloc} { }
+
+    Episode(const Episode &) = default;
+    Episode(Episode &&) = default;
+    Episode & operator=(const Episode &) = default;
+    Episode & operator=(Episode &&) = default;
+
+    Episode(const Episode & other, const allocator_type & alloc)
+	: age_at_episode_{other.age_at_episode_},
+	  episode_start_{other.episode_start_},
+	  episode_end_{other.episode_end_},
+	  primary_diagnosis_{other.primary_diagnosis_},
+	  primary_procedure_{other.primary_procedure_},
+	  secondary_procedures_{other.secondary_procedures_, alloc},
+	  secondary_diagnoses_{other.secondary_diagnoses_, alloc},
+	  raw_secondary_procedures_{other.raw_secondary_procedures_, alloc},
+	  raw_secondary_diagnoses_{other.raw_secondary_diagnoses_, alloc},
+	  decoded_{other.decoded_} { }
+
+    Episode(Episode && other, const allocator_type & alloc)
+	: age_at_episode_{other.age_at_episode_},
+	  episode_start_{other.episode_start_},
+	  episode_end_{other.episode_end_},
+	  primary_diagnosis_{std::move(other.primary_diagnosis_)},
+	  primary_procedure_{std::move(other.primary_procedure_)},
+	  secondary_procedures_{std::move(other.secondary_procedures_), alloc},
+	  secondary_diagnoses_{std::move(other.secondary_diagnoses_), alloc},
+	  raw_secondary_procedures_{std::move(other.raw_secondary_procedures_), alloc},
+	  raw_secondary_diagnoses_{std::move(other.raw_secondary_diagnoses_), alloc},
+	  decoded_{other.decoded_} { }
+
     /// Read the data in the row into the episode structue. Assume
     /// that the following fields are present in the row:
     ///
@@ -73,7 +179,12 @@ public:
     /// <n> is a non-negative integer. The first column that is not found
     /// signals the end of the block of secondary columns. The function will
     /// short circuit on a NULL or empty (whitespace) secondary column.
-    Episode(RowBuffer auto & row, std::shared_ptr<ClinicalCodeParser> parser) {
+    ///
+    /// In DecodeMode::Primary, the secondary columns are stored unparsed,
+    /// and the secondaries are empty until decode() is called.
+    Episode(RowBuffer auto & row, std::shared_ptr<ClinicalCodeParser> parser,
+	    DecodeMode mode = DecodeMode::Full, const allocator_type & alloc = {})
+	: Episode{alloc} {
 
 	try {
 	    age_at_episode_ = column<Integer>("age_at_episode", row);
@@ -96,20 +207,51 @@ public:
 	} catch (const RowBufferException::ColumnNotFound &) {
 	    throw std::runtime_error("Missing required primary diagnosis or procedure column");
 	}
-	    
+
+	if (mode == DecodeMode::Primary) {
+	    raw_secondary_procedures_ = read_raw_secondary_columns("secondary_procedure_", row,
+								   alloc);
+	    raw_secondary_diagnoses_ = read_raw_secondary_columns("secondary_diagnosis_", row,
+								  alloc);
+	    decoded_ = false;
+	    return;
+	}
+	
 	// Get secondary procedures -- needs refactoring, but need to fix parse_procedure/
 	// parse_diagnosis first (i.e. merge them)
 	secondary_procedures_ = read_secondary_columns("secondary_procedure_",
 						       CodeType::Procedure,
-						       row, parser);
+						       row, parser, alloc);
 	
 	// Get secondary diagnoses
 	secondary_diagnoses_ = read_secondary_columns("secondary_diagnosis_",
 						      CodeType::Diagnosis,
-						      row, parser);
+						      row, parser, alloc);
 	
     }
 
+    /// Parse the secondary columns stored by the DecodeMode::Primary
+    /// constructor. Does nothing if the episode is already decoded.
+    void decode(std::shared_ptr<ClinicalCodeParser> parser) {
+	if (decoded_) {
+	    return;
+	}
+	secondary_procedures_ = parse_secondary_codes(raw_secondary_procedures_,
+						      CodeType::Procedure, parser,
+						      secondary_procedures_.get_allocator());
+	secondary_diagnoses_ = parse_secondary_codes(raw_secondary_diagnoses_,
+						     CodeType::Diagnosis, parser,
+						     secondary_diagnoses_.get_allocator());
+	raw_secondary_procedures_.clear();
+	raw_secondary_diagnoses_.clear();
+	decoded_ = true;
+    }
+
+    /// False if the secondaries are still waiting to be parsed
+    bool decoded() const {
+	return decoded_;
+    }
+
     void set_primary_procedure(const ClinicalCode & clinical_code) {
 	primary_procedure_ = clinical_code;
     }
@@ -135,7 +277,8 @@ public:
     }
 
     auto all_procedures_and_diagnosis() const {
-	auto all_codes{secondary_diagnoses_};
+	std::pmr::vector<ClinicalCode> all_codes{secondary_diagnoses_,
+						 secondary_diagnoses_.get_allocator()};
 	
         all_codes.insert(all_codes.end(), secondary_procedures_.begin(),
 			 secondary_procedures_.end());
@@ -224,8 +367,13 @@ private:
     ClinicalCode primary_procedure_;
 
     // Use vector to keep the order of the secondaries.
-    std::vector<ClinicalCode> secondary_procedures_;
-    std::vector<ClinicalCode> secondary_diagnoses_;
+    std::pmr::vector<ClinicalCode> secondary_procedures_;
+    std::pmr::vector<ClinicalCode> secondary_diagnoses_;
+
+    // Unparsed secondaries, in DecodeMode::Primary
+    std::pmr::vector<std::pmr::string> raw_secondary_procedures_;
+    std::pmr::vector<std::pmr::string> raw_secondary_diagnoses_;
+    bool decoded_{true};
 };
 
 
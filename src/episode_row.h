@@ -4,10 +4,9 @@
 #include <map>
 #include <vector>
 #include "sql_types.h"
-#include <random>
+#include "random.h"
 #include "clinical_code.h"
 
-#include "random.h"
 
 /// A mock row for testing the Episode row constructor
 class EpisodeRowBuffer {
@@ -32,12 +31,13 @@ public:
 	set_primary_procedure(parser->random_code(CodeType::Procedure, gen));
 	set_primary_diagnosis(parser->random_code(CodeType::Diagnosis, gen));
 
-	Random<std::size_t> rnd{1, 10, Seed{}};	
-	auto num_secondary_diagnoses{rnd()};
+	// Draw the counts from gen too, so that they change from one
+	// episode to the next (but are repeatable for the same seed)
+	auto num_secondary_diagnoses{1 + uniform_below(gen, 10)};
 	for (std::size_t n{0}; n < num_secondary_diagnoses; n++) {
 	    push_secondary_diagnosis(parser->random_code(CodeType::Diagnosis, gen));
 	}
-	auto num_secondary_procedures{rnd()};
+	auto num_secondary_procedures{1 + uniform_below(gen, 10)};
 	for (std::size_t n{0}; n < num_secondary_procedures; n++) {
 	    push_secondary_procedure(parser->random_code(CodeType::Procedure, gen));
 	}
@@ -63,6 +63,11 @@ public:
 	}
     }
     
+    /// Set any column (for example, a null secondary column)
+    void set_column(const std::string & column_name, const SqlType & value) {
+	columns_[column_name] = value;
+    }
+
     void push_secondary_procedure(const std::string & raw) {
 	auto column_name{"secondary_procedure_"
 			 + std::to_string(num_secondary_procedures_++)};
@@ -1,10 +1,18 @@
 #ifndef EVENT_COUNTER_HPP
 #define EVENT_COUNTER_HPP
 
+#include <map>
+#include <memory_resource>
 #include "clinical_code.h"
 
 class EventCounter {
 public:
+
+    EventCounter() = default;
+
+    /// Allocate the counts from resource
+    explicit EventCounter(std::pmr::memory_resource * resource)
+	: before_counts_{resource}, after_counts_{resource} {}
     
     /// Increment a group counter in the before map
     void push_before(const ClinicalCodeGroup & group) {
@@ -41,8 +49,8 @@ public:
     }
 
 private:
-    std::map<ClinicalCodeGroup, std::size_t> before_counts_;
-    std::map<ClinicalCodeGroup, std::size_t> after_counts_;
+    std::pmr::map<ClinicalCodeGroup, std::size_t> before_counts_;
+    std::pmr::map<ClinicalCodeGroup, std::size_t> after_counts_;
 };
 
 
@@ -0,0 +1,151 @@
+#ifndef EVENT_TIMELINE_HPP
+#define EVENT_TIMELINE_HPP
+
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <memory_resource>
+
+#include "clinical_code.h"
+#include "sql_types.h"
+#include "spell.h"
+
+/// Assigns a dense column number to each code group, so that
+/// counts for all the groups can be stored in a flat array
+class GroupColumns {
+public:
+    GroupColumns(const std::set<ClinicalCodeGroup> & groups) {
+	for (const auto & group : groups) {
+	    columns_.insert({group, groups_.size()});
+	    groups_.push_back(group);
+	}
+    }
+
+    /// The number of groups (columns)
+    std::size_t size() const {
+	return groups_.size();
+    }
+
+    /// The groups, in column order
+    const auto & groups() const {
+	return groups_;
+    }
+
+    /// Get the column number of a group. Throws out_of_range
+    /// if the group is not present
+    std::size_t column(const ClinicalCodeGroup & group) const {
+	return columns_.at(group);
+    }
+
+private:
+    std::vector<ClinicalCodeGroup> groups_;
+    std::map<ClinicalCodeGroup, std::size_t> columns_;
+};
+
+/**
+ * \brief Time-sorted code group events for one patient
+ *
+ * Events are (timestamp, group) pairs. After all the events
+ * are pushed, finalise() sorts them and stores running totals
+ * for each group at each distinct timestamp. The number of
+ * events in a group strictly inside any time window is then
+ * found with two binary searches, so adding more windows does
+ * not require another pass over the spells.
+ */
+class EventTimeline {
+public:
+
+    /// The events and counts are allocated from resource
+    EventTimeline(std::size_t num_columns,
+		  std::pmr::memory_resource * resource = std::pmr::get_default_resource())
+	: num_columns_{num_columns}, events_{resource}, times_{resource},
+	  prefix_counts_{resource} {}
+
+    /// Record an event in a group column at a time. Events
+    /// pushed after finalise() are not counted until the
+    /// next call to finalise().
+    void push(const Timestamp & time, std::size_t column) {
+	if (column >= num_columns_) {
+	    throw std::out_of_range("Group column out of range in EventTimeline");
+	}
+	// Events with no date cannot be placed in any window
+	if (not time.null()) {
+	    events_.push_back({static_cast<long long>(time.read()), column});
+	}
+    }
+
+    /// Sort the events and compute the per-group prefix counts
+    void finalise() {
+	std::ranges::sort(events_);
+	times_.clear();
+	prefix_counts_.assign(num_columns_, 0);
+	for (const auto & [time, column] : events_) {
+	    if (times_.empty() or times_.back() != time) {
+		times_.push_back(time);
+		// Start a new row of running totals from the previous row
+		auto previous_row{prefix_counts_.size() - num_columns_};
+		prefix_counts_.resize(prefix_counts_.size() + num_columns_);
+		std::copy_n(prefix_counts_.begin() + previous_row, num_columns_,
+			    prefix_counts_.begin() + previous_row + num_columns_);
+	    }
+	    prefix_counts_[times_.size() * num_columns_ + column]++;
+	}
+    }
+
+    /// Count the events in a group column whose time is strictly
+    /// between base and base + offset. The offset is negative for
+    /// a window before base. Returns zero if base is null.
+    std::size_t count(std::size_t column, const Timestamp & base,
+		      const TimestampOffset & offset) const {
+	if (base.null()) {
+	    return 0;
+	}
+	auto start{static_cast<long long>(base.read())};
+	auto end{start + offset.value()};
+	if (end < start) {
+	    std::swap(start, end);
+	}
+	// Row n of prefix_counts_ is the total of all events before times_[n]
+	auto first{std::ranges::upper_bound(times_, start) - times_.begin()};
+	auto last{std::ranges::lower_bound(times_, end) - times_.begin()};
+	if (last <= first) {
+	    return 0;
+	}
+	return prefix_counts_[last * num_columns_ + column]
+	    - prefix_counts_[first * num_columns_ + column];
+    }
+
+private:
+    std::size_t num_columns_;
+    std::pmr::vector<std::pair<long long, std::size_t>> events_;
+    std::pmr::vector<long long> times_;
+    // (times_.size() + 1) rows of num_columns_ running totals
+    std::pmr::vector<std::size_t> prefix_counts_;
+};
+
+/// Make the timeline of all the code groups in all the spells of a
+/// patient. Every valid code in an episode (primary or secondary)
+/// contributes one event per group at the start date of its spell.
+/// The timeline is allocated from the same resource as the spells.
+inline EventTimeline make_event_timeline(const std::pmr::vector<Spell> & spells,
+					 const GroupColumns & columns) {
+    EventTimeline timeline{columns.size(), spells.get_allocator().resource()};
+    for (const auto & spell : spells) {
+	auto spell_start{spell.start_date()};
+	for (const auto & episode : spell.episodes()) {
+	    for (const auto & code : episode.all_procedures_and_diagnosis()) {
+		if (not code.valid()) {
+		    continue;
+		}
+		for (const auto group_id : code.group_ids()) {
+		    timeline.push(spell_start, columns.column(group_id));
+		}
+	    }
+	}
+    }
+    timeline.finalise();
+    return timeline;
+}
+
+#endif
@@ -0,0 +1,519 @@
+#include "extract.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <filesystem>
+
+#ifdef _WIN64
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const std::string extract_magic{"RDBXTR02"};
+
+/// The magic of the files with the first and last nhs_number of each
+/// row group (instead of the smallest and largest)
+const std::string extract_magic_v1{"RDBXTR01"};
+
+void append_uint(std::string & bytes, std::uint64_t value, std::size_t width) {
+    for (std::size_t n{0}; n < width; n++) {
+	bytes.push_back(static_cast<char>((value >> (8*n)) & 0xff));
+    }
+}
+
+void append_string(std::string & bytes, std::string_view value) {
+    append_uint(bytes, value.size(), 4);
+    bytes.append(value);
+}
+
+/// Write the values as a base and the smallest fixed-width offsets
+/// that fit. Null rows are written as the base.
+void append_packed(std::string & bytes, const std::vector<std::uint64_t> & values,
+		   const std::vector<bool> & nulls) {
+    std::uint64_t base{0}, max{0};
+    bool first{true};
+    for (std::size_t n{0}; n < values.size(); n++) {
+	if (not nulls[n]) {
+	    base = first ? values[n] : std::min(base, values[n]);
+	    max = first ? values[n] : std::max(max, values[n]);
+	    first = false;
+	}
+    }
+    auto range{max - base};
+    std::size_t width{0};
+    if (range > 0xffffffff) {
+	width = 8;
+    } else if (range > 0xffff) {
+	width = 4;
+    } else if (range > 0xff) {
+	width = 2;
+    } else if (range > 0) {
+	width = 1;
+    }
+    append_uint(bytes, base, 8);
+    bytes.push_back(static_cast<char>(width));
+    for (std::size_t n{0}; n < values.size(); n++) {
+	append_uint(bytes, nulls[n] ? 0 : values[n] - base, width);
+    }
+}
+
+/// Reads fields from a range of the extract file
+class ExtractReader {
+public:
+    ExtractReader(std::string_view bytes) : bytes_{bytes} {}
+
+    std::string_view bytes(std::size_t length) {
+	if (length > bytes_.size()) {
+	    throw ExtractException::BadFile{"Truncated extract file"};
+	}
+	auto result{bytes_.substr(0, length)};
+	bytes_.remove_prefix(length);
+	return result;
+    }
+
+    std::uint64_t uint(std::size_t width) {
+	auto data{bytes(width)};
+	std::uint64_t value{0};
+	for (std::size_t n{0}; n < width; n++) {
+	    value |= static_cast<std::uint64_t>(static_cast<unsigned char>(data[n])) << (8*n);
+	}
+	return value;
+    }
+
+    std::string_view string() {
+	return bytes(uint(4));
+    }
+
+    void packed(std::vector<std::uint64_t> & values, std::size_t num_rows) {
+	auto base{uint(8)};
+	auto width{uint(1)};
+	if (width != 0 and width != 1 and width != 2 and width != 4 and width != 8) {
+	    throw ExtractException::BadFile{"Bad packed value width in extract file"};
+	}
+	values.resize(num_rows);
+	for (auto & value : values) {
+	    value = base + uint(width);
+	}
+    }
+
+private:
+    std::string_view bytes_;
+};
+
+}
+
+#ifdef _WIN64
+
+MappedFile::MappedFile(const std::string & file_path) {
+    file_ = CreateFileA(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE) {
+	file_ = nullptr;
+	throw std::runtime_error("Could not open file " + file_path);
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(file_, &size);
+    size_ = static_cast<std::size_t>(size.QuadPart);
+    if (size_ > 0) {
+	mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping_ == nullptr) {
+	    CloseHandle(file_);
+	    throw std::runtime_error("Could not map file " + file_path);
+	}
+	data_ = static_cast<const char *>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (data_) {
+	UnmapViewOfFile(data_);
+    }
+    if (mapping_) {
+	CloseHandle(mapping_);
+    }
+    if (file_) {
+	CloseHandle(file_);
+    }
+}
+
+MappedFile::MappedFile(MappedFile && other) noexcept
+    : data_{std::exchange(other.data_, nullptr)}, size_{std::exchange(other.size_, 0)},
+      file_{std::exchange(other.file_, nullptr)}, mapping_{std::exchange(other.mapping_, nullptr)} {}
+
+#else
+
+MappedFile::MappedFile(const std::string & file_path) {
+    int fd{open(file_path.c_str(), O_RDONLY)};
+    if (fd < 0) {
+	throw std::runtime_error("Could not open file " + file_path);
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+	::close(fd);
+	throw std::runtime_error("Could not get the size of file " + file_path);
+    }
+    size_ = static_cast<std::size_t>(status.st_size);
+    if (size_ > 0) {
+	void * data{mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0)};
+	if (data == MAP_FAILED) {
+	    ::close(fd);
+	    throw std::runtime_error("Could not map file " + file_path);
+	}
+	// The rows are read in order
+	madvise(data, size_, MADV_SEQUENTIAL);
+	data_ = static_cast<const char *>(data);
+    }
+    // The mapping stays valid after the file is closed
+    ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data_) {
+	munmap(const_cast<char *>(data_), size_);
+    }
+}
+
+MappedFile::MappedFile(MappedFile && other) noexcept
+    : data_{std::exchange(other.data_, nullptr)}, size_{std::exchange(other.size_, 0)} {}
+
+#endif
+
+ExtractWriter::ExtractWriter(const std::string & file_path,
+			     const std::vector<ColumnSpec> & columns,
+			     std::size_t rows_per_group)
+    : file_path_{file_path}, temp_path_{file_path + ".tmp"},
+      file_{temp_path_, std::ios::binary},
+      rows_per_group_{std::max<std::size_t>(rows_per_group, 1)} {
+    if (not file_) {
+	throw std::runtime_error("Could not open extract file " + temp_path_);
+    }
+    std::string header{extract_magic};
+    append_uint(header, columns.size(), 4);
+    for (const auto & spec : columns) {
+	header.push_back(static_cast<char>(spec.type));
+	append_string(header, spec.name);
+	if (spec.name == "nhs_number" and spec.type == ColumnType::Integer) {
+	    nhs_number_column_ = columns_.size();
+	}
+	ColumnBuilder column_data;
+	column_data.spec = spec;
+	columns_.push_back(std::move(column_data));
+    }
+    file_.write(header.data(), header.size());
+}
+
+ExtractWriter::~ExtractWriter() {
+    // A file that was not closed has no directory, and cannot be read
+    if (not closed_) {
+	file_.close();
+	std::error_code error;
+	std::filesystem::remove(temp_path_, error);
+    }
+}
+
+void ExtractWriter::ColumnBuilder::push(const Varchar & value) {
+    nulls.push_back(value.null());
+    if (value.null()) {
+	values.push_back(0);
+	return;
+    }
+    auto [it, inserted] = dictionary.try_emplace(value.read(), strings.size());
+    if (inserted) {
+	strings.push_back(it->first);
+    }
+    values.push_back(it->second);
+}
+
+void ExtractWriter::ColumnBuilder::push(const Integer & value) {
+    nulls.push_back(value.null());
+    values.push_back(value.null() ? 0 : value.read());
+}
+
+void ExtractWriter::ColumnBuilder::push(const Timestamp & value) {
+    nulls.push_back(value.null());
+    values.push_back(value.null() ? 0 : value.read());
+}
+
+void ExtractWriter::ColumnBuilder::encode(std::string & bytes) const {
+    std::string bitmap((nulls.size() + 7) / 8, '\0');
+    for (std::size_t n{0}; n < nulls.size(); n++) {
+	if (nulls[n]) {
+	    bitmap[n / 8] |= static_cast<char>(1 << (n % 8));
+	}
+    }
+    bytes.append(bitmap);
+    if (spec.type == ColumnType::Varchar) {
+	append_uint(bytes, strings.size(), 4);
+	for (const auto & string : strings) {
+	    append_string(bytes, string);
+	}
+    }
+    append_packed(bytes, values, nulls);
+}
+
+std::uint64_t ExtractWriter::ColumnBuilder::max_value() const {
+    std::uint64_t max{0};
+    if (spec.type != ColumnType::Varchar) {
+	for (std::size_t n{0}; n < values.size(); n++) {
+	    if (not nulls[n]) {
+		max = std::max(max, values[n]);
+	    }
+	}
+    }
+    return max;
+}
+
+void ExtractWriter::ColumnBuilder::clear() {
+    nulls.clear();
+    values.clear();
+    dictionary.clear();
+    strings.clear();
+}
+
+void ExtractWriter::write_row_group() {
+    RDB_TRACE_SPAN("extract_write_row_group");
+    if (num_group_rows_ == 0) {
+	return;
+    }
+    RowGroupInfo group{
+	.offset = static_cast<std::uint64_t>(file_.tellp()),
+	.num_rows = num_group_rows_,
+	.min_nhs_number = min_nhs_number_.value_or(0),
+	.max_nhs_number = max_nhs_number_.value_or(0),
+	.column_max = {},
+    };
+    bytes_.clear();
+    append_uint(bytes_, num_group_rows_, 8);
+    for (auto & column_data : columns_) {
+	column_data.encode(bytes_);
+	group.column_max.push_back(column_data.max_value());
+	column_data.clear();
+    }
+    row_groups_.push_back(std::move(group));
+    file_.write(bytes_.data(), bytes_.size());
+    if (not file_) {
+	throw std::runtime_error("Failed to write to the extract file");
+    }
+    num_group_rows_ = 0;
+    min_nhs_number_.reset();
+    max_nhs_number_.reset();
+}
+
+void ExtractWriter::close() {
+    if (closed_) {
+	return;
+    }
+    write_row_group();
+    std::string directory;
+    auto directory_offset{static_cast<std::uint64_t>(file_.tellp())};
+    append_uint(directory, row_groups_.size(), 8);
+    for (const auto & group : row_groups_) {
+	append_uint(directory, group.offset, 8);
+	append_uint(directory, group.num_rows, 8);
+	append_uint(directory, group.min_nhs_number, 8);
+	append_uint(directory, group.max_nhs_number, 8);
+	for (const auto max : group.column_max) {
+	    append_uint(directory, max, 8);
+	}
+    }
+    append_uint(directory, directory_offset, 8);
+    file_.write(directory.data(), directory.size());
+    file_.close();
+    if (not file_) {
+	throw std::runtime_error("Failed to finish writing the extract file");
+    }
+    std::filesystem::rename(temp_path_, file_path_);
+    closed_ = true;
+}
+
+ExtractRowBuffer::ExtractRowBuffer(const std::string & file_path, std::size_t first_group,
+				   std::size_t end_group,
+				   const std::set<std::uint64_t> * nhs_numbers)
+    : file_{file_path} {
+
+    auto bytes{file_.bytes()};
+    auto version_1{bytes.starts_with(extract_magic_v1)};
+    if (not (version_1 or bytes.starts_with(extract_magic))
+	or bytes.size() < extract_magic.size() + 8) {
+	throw ExtractException::BadFile{"Not a complete extract file: " + file_path};
+    }
+
+    ExtractReader header{bytes.substr(extract_magic.size())};
+    auto num_columns{header.uint(4)};
+    for (std::size_t n{0}; n < num_columns; n++) {
+	auto type{header.uint(1)};
+	if (type > static_cast<std::uint64_t>(ColumnType::Timestamp)) {
+	    throw ExtractException::BadFile{"Bad column type in extract file"};
+	}
+	ColumnData column_data;
+	column_data.type = static_cast<ColumnType>(type);
+	column_data.name = header.string();
+	column_index_[column_data.name] = columns_.size();
+	columns_.push_back(std::move(column_data));
+    }
+
+    ExtractReader footer{bytes.substr(bytes.size() - 8)};
+    auto directory_offset{footer.uint(8)};
+    if (directory_offset > bytes.size() - 8) {
+	throw ExtractException::BadFile{"Bad directory offset in extract file"};
+    }
+    ExtractReader directory{bytes.substr(directory_offset, bytes.size() - 8 - directory_offset)};
+    auto num_groups{directory.uint(8)};
+    for (std::size_t n{0}; n < num_groups; n++) {
+	RowGroupInfo group;
+	group.offset = directory.uint(8);
+	group.num_rows = directory.uint(8);
+	group.min_nhs_number = directory.uint(8);
+	group.max_nhs_number = directory.uint(8);
+	if (version_1) {
+	    group.min_nhs_number = 0;
+	    group.max_nhs_number = std::numeric_limits<std::uint64_t>::max();
+	}
+	for (std::size_t c{0}; c < columns_.size(); c++) {
+	    group.column_max.push_back(directory.uint(8));
+	}
+	if (group.offset >= directory_offset) {
+	    throw ExtractException::BadFile{"Bad row group offset in extract file"};
+	}
+	auto has_patient = [&] {
+	    auto it{nhs_numbers->lower_bound(group.min_nhs_number)};
+	    return it != nhs_numbers->end() and *it <= group.max_nhs_number;
+	};
+	if (n >= first_group and n < end_group and (not nhs_numbers or has_patient())) {
+	    row_groups_.push_back(group);
+	}
+    }
+
+    if (row_groups_.empty()) {
+	end_ = true;
+    } else {
+	load_row_group(0);
+    }
+}
+
+void ExtractRowBuffer::load_row_group(std::size_t index) {
+    RDB_TRACE_SPAN("extract_load_row_group");
+    const auto & group{row_groups_.at(index)};
+    ExtractReader reader{file_.bytes().substr(group.offset)};
+    auto num_rows{reader.uint(8)};
+    if (num_rows != group.num_rows or num_rows == 0) {
+	throw ExtractException::BadFile{"Row group size does not match the directory"};
+    }
+    for (auto & column_data : columns_) {
+	auto bitmap{reader.bytes((num_rows + 7) / 8)};
+	column_data.nulls.resize(num_rows);
+	for (std::size_t n{0}; n < num_rows; n++) {
+	    column_data.nulls[n] = (static_cast<unsigned char>(bitmap[n / 8]) >> (n % 8)) & 1;
+	}
+	column_data.dictionary.clear();
+	if (column_data.type == ColumnType::Varchar) {
+	    auto dictionary_size{reader.uint(4)};
+	    for (std::size_t n{0}; n < dictionary_size; n++) {
+		column_data.dictionary.push_back(reader.string());
+	    }
+	}
+	reader.packed(column_data.values, num_rows);
+	if (column_data.type == ColumnType::Varchar) {
+	    for (std::size_t n{0}; n < num_rows; n++) {
+		if (not column_data.nulls[n]
+		    and column_data.values[n] >= column_data.dictionary.size()) {
+		    throw ExtractException::BadFile{"Dictionary index out of range in extract file"};
+		}
+	    }
+	}
+    }
+    group_ = index;
+    group_row_ = 0;
+}
+
+bool ExtractRowBuffer::try_fetch_next_row() {
+    if (end_) {
+	return false;
+    }
+    if (group_row_ + 1 < row_groups_[group_].num_rows) {
+	group_row_++;
+    } else if (group_ + 1 < row_groups_.size()) {
+	load_row_group(group_ + 1);
+    } else {
+	end_ = true;
+	return false;
+    }
+    current_row_++;
+    return true;
+}
+
+void ExtractRowBuffer::seek(std::size_t group, std::size_t row) {
+    if (group >= row_groups_.size() or row >= row_groups_[group].num_rows) {
+	throw std::out_of_range("No such row in the extract");
+    }
+    if (group != group_ or end_) {
+	load_row_group(group);
+    }
+    group_row_ = row;
+    current_row_ = row;
+    for (std::size_t n{0}; n < group; n++) {
+	current_row_ += row_groups_[n].num_rows;
+    }
+    end_ = false;
+}
+
+std::vector<ColumnSpec> ExtractRowBuffer::columns() const {
+    std::vector<ColumnSpec> columns;
+    for (const auto & column_data : columns_) {
+	columns.push_back({column_data.name, column_data.type});
+    }
+    return columns;
+}
+
+std::size_t ExtractRowBuffer::num_rows() const {
+    std::size_t total{0};
+    for (const auto & group : row_groups_) {
+	total += group.num_rows;
+    }
+    return total;
+}
+
+std::uint64_t ExtractRowBuffer::column_max(const std::string & column_name) const {
+    auto it{column_index_.find(column_name)};
+    if (it == column_index_.end()) {
+	throw RowBufferException::ColumnNotFound{};
+    }
+    std::uint64_t max{0};
+    for (const auto & group : row_groups_) {
+	max = std::max(max, group.column_max[it->second]);
+    }
+    return max;
+}
+
+std::set<std::uint64_t> merge_extract(const std::string & file_path,
+				      const std::string & update_path) {
+    std::set<std::uint64_t> updated;
+    const std::string merged_path{file_path + ".merge"};
+    {
+	ExtractRowBuffer update{update_path};
+	for (; not update.end(); update.try_fetch_next_row()) {
+	    auto nhs_number{column<Integer>("nhs_number", update)};
+	    if (not nhs_number.null()) {
+		updated.insert(nhs_number.read());
+	    }
+	}
+
+	ExtractRowBuffer base{file_path};
+	ExtractWriter writer{merged_path, base.columns()};
+	copy_rows(base, writer, updated);
+	ExtractRowBuffer update_rows{update_path};
+	copy_rows(update_rows, writer);
+	writer.close();
+    }
+    // The files must be unmapped before renaming on Windows
+    std::filesystem::rename(merged_path, file_path);
+    return updated;
+}
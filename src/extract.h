@@ -0,0 +1,436 @@
+/**
+ * \file extract.h
+ * \brief Local columnar copy of the raw query result
+ *
+ * An extract file holds the rows returned by make_acs_sql_query(),
+ * so that the whole pipeline (Patient, Spell, Episode and the index
+ * logic) can be rerun without the database. ExtractWriter saves
+ * rows from any RowBuffer, and ExtractRowBuffer is a RowBuffer that
+ * reads them back from a memory-mapped extract file.
+ *
+ * The rows are stored in row groups. A row group is only ended
+ * between two different nhs_number values, so each row group holds
+ * a complete range of patients. Within a row group, each column is
+ * stored separately:
+ *
+ * - a null bitmap (one bit per row, set for null)
+ * - Varchar columns: a dictionary of the distinct strings in the
+ *   row group, and a packed dictionary index for each row
+ * - Integer and Timestamp (unix time) columns: packed values
+ *
+ * Packed values are stored as a base (the minimum non-null value)
+ * and an offset from the base for each row, using the smallest
+ * of 0, 1, 2, 4 or 8 bytes that fits all the offsets.
+ *
+ * File layout (integers are little-endian):
+ *
+ * - magic "RDBXTR02"
+ * - u32 number of columns, then for each: u8 ColumnType, string name
+ * - the row groups: u64 number of rows, then each column chunk
+ * - directory: u64 number of row groups, then for each: u64 offset,
+ *   u64 number of rows, u64 smallest nhs_number, u64 largest
+ *   nhs_number, and u64 maximum value of each column
+ * - u64 offset of the directory
+ *
+ * Strings are a u32 length followed by the bytes. Files with the
+ * magic "RDBXTR01" can still be read. They have the first and last
+ * nhs_number of each row group instead, which is not a range once
+ * the patients are out of order (after merge_extract), so the range
+ * of their row groups is taken to be unknown.
+ */
+
+#ifndef EXTRACT_HPP
+#define EXTRACT_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <cstdint>
+
+#include "row_buffer.h"
+#include "sql_types.h"
+
+namespace ExtractException {
+
+    /// Thrown if the file is not a complete extract file
+    struct BadFile : std::runtime_error {
+	using std::runtime_error::runtime_error;
+    };
+
+}
+
+/// A read-only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile(const std::string & file_path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+    MappedFile(MappedFile && other) noexcept;
+    MappedFile & operator=(MappedFile && other) = delete;
+
+    std::string_view bytes() const {
+	return {data_, size_};
+    }
+
+private:
+    const char * data_{nullptr};
+    std::size_t size_{0};
+#ifdef _WIN64
+    void * file_{nullptr};
+    void * mapping_{nullptr};
+#endif
+};
+
+/// The position and patient range of a row group
+struct RowGroupInfo {
+    std::uint64_t offset;
+    std::uint64_t num_rows;
+    /// The smallest and largest non-null nhs_number in the row group
+    std::uint64_t min_nhs_number;
+    std::uint64_t max_nhs_number;
+    /// The largest non-null value in each Integer or Timestamp
+    /// column (zero for Varchar columns, or if all values are null)
+    std::vector<std::uint64_t> column_max;
+};
+
+/**
+ * \brief Writes rows to an extract file
+ *
+ * Rows are collected in memory until the row group has at least
+ * rows_per_group rows and the nhs_number changes, and then the row
+ * group is encoded and written. Call close() after the last row to
+ * write the directory. The rows are written to file_path + ".tmp",
+ * which close() renames to file_path, so an existing file is only
+ * replaced by a finished one. If the writer is destroyed without
+ * being closed, the temporary file is deleted.
+ */
+class ExtractWriter {
+public:
+    ExtractWriter(const std::string & file_path, const std::vector<ColumnSpec> & columns,
+		  std::size_t rows_per_group = 1 << 16);
+
+    ~ExtractWriter();
+
+    ExtractWriter(const ExtractWriter &) = delete;
+    ExtractWriter & operator=(const ExtractWriter &) = delete;
+
+    /// Copy the current row of a row buffer. The row buffer must
+    /// have all the columns passed to the constructor.
+    void push_row(const RowBuffer auto & row) {
+	std::optional<std::uint64_t> nhs_number;
+	if (nhs_number_column_) {
+	    auto value{column<Integer>(columns_[*nhs_number_column_].spec.name, row)};
+	    if (not value.null()) {
+		nhs_number = value.read();
+	    }
+	}
+	// Only end a row group between patients (if there is an nhs_number)
+	if (num_group_rows_ >= rows_per_group_
+	    and (not nhs_number_column_ or nhs_number != last_nhs_number_)) {
+	    write_row_group();
+	}
+	if (nhs_number) {
+	    min_nhs_number_ = std::min(min_nhs_number_.value_or(*nhs_number), *nhs_number);
+	    max_nhs_number_ = std::max(max_nhs_number_.value_or(*nhs_number), *nhs_number);
+	}
+	last_nhs_number_ = nhs_number;
+
+	for (auto & column_data : columns_) {
+	    const auto & name{column_data.spec.name};
+	    switch (column_data.spec.type) {
+	    case ColumnType::Varchar:
+		column_data.push(column<Varchar>(name, row));
+		break;
+	    case ColumnType::Integer:
+		column_data.push(column<Integer>(name, row));
+		break;
+	    case ColumnType::Timestamp:
+		column_data.push(column<Timestamp>(name, row));
+		break;
+	    }
+	}
+	num_group_rows_++;
+	num_rows_++;
+    }
+
+    /// Write the last row group and the directory, and move the file
+    /// to file_path
+    void close();
+
+    /// The number of rows pushed
+    std::size_t num_rows() const {
+	return num_rows_;
+    }
+
+    /// The row group (counting from 0) and the row within it of the
+    /// last row pushed, for seeking to it with ExtractRowBuffer::seek()
+    std::pair<std::size_t, std::size_t> last_row_position() const {
+	return {row_groups_.size(), num_group_rows_ - 1};
+    }
+
+private:
+
+    /// The values of one column in the current row group
+    struct ColumnBuilder {
+	ColumnSpec spec;
+	std::vector<bool> nulls;
+	std::vector<std::uint64_t> values;
+	std::unordered_map<std::string, std::uint64_t> dictionary;
+	std::vector<std::string> strings;
+
+	void push(const Varchar & value);
+	void push(const Integer & value);
+	void push(const Timestamp & value);
+	void encode(std::string & bytes) const;
+	std::uint64_t max_value() const;
+	void clear();
+    };
+
+    void write_row_group();
+
+    std::string file_path_;
+    std::string temp_path_;
+    std::ofstream file_;
+    std::vector<ColumnBuilder> columns_;
+    std::optional<std::size_t> nhs_number_column_;
+    std::size_t rows_per_group_;
+    std::size_t num_group_rows_{0};
+    std::size_t num_rows_{0};
+    std::optional<std::uint64_t> min_nhs_number_;
+    std::optional<std::uint64_t> max_nhs_number_;
+    std::optional<std::uint64_t> last_nhs_number_;
+    std::vector<RowGroupInfo> row_groups_;
+    std::string bytes_;
+    bool closed_{false};
+};
+
+/**
+ * \brief A RowBuffer reading an extract file
+ *
+ * The file is memory-mapped, and one row group at a time is decoded
+ * into column arrays. Like SqlRowBuffer, the first row is current
+ * after construction, and end() is true straight away if there are
+ * no rows.
+ *
+ * Only the row groups from first_group up to (not including)
+ * end_group are read. Row groups hold complete patients, so separate
+ * buffers over different ranges of groups can be read in parallel.
+ * Alternatively, only the row groups whose range of nhs_numbers
+ * contains one of a set of patients are read, which skips most of
+ * the file when looking for a few patients. The other patients in
+ * those row groups are still read.
+ */
+class ExtractRowBuffer {
+public:
+    ExtractRowBuffer(const std::string & file_path, std::size_t first_group = 0,
+		     std::size_t end_group = static_cast<std::size_t>(-1))
+	: ExtractRowBuffer{file_path, first_group, end_group, nullptr} {}
+
+    ExtractRowBuffer(const std::string & file_path,
+		     const std::set<std::uint64_t> & nhs_numbers)
+	: ExtractRowBuffer{file_path, 0, static_cast<std::size_t>(-1), &nhs_numbers} {}
+
+    /// Throws ColumnNotFound if the column does not exist, and
+    /// WrongColumnType if T is not this column's type
+    template<typename T>
+    T at(const std::string & column_name) const {
+	auto it{column_index_.find(column_name)};
+	if (it == column_index_.end()) {
+	    throw RowBufferException::ColumnNotFound{};
+	}
+	const auto & column_data{columns_[it->second]};
+	if (column_data.type != column_type<T>()) {
+	    throw RowBufferException::WrongColumnType{};
+	}
+	if (column_data.nulls[group_row_]) {
+	    return T{};
+	}
+	auto value{column_data.values[group_row_]};
+	if constexpr (std::is_same_v<T, Varchar>) {
+	    return Varchar{std::string{column_data.dictionary[value]}};
+	} else {
+	    return T{value};
+	}
+    }
+
+    /// Fetch the next row. Throws NoMoreRows if there are
+    /// no more rows.
+    void fetch_next_row() {
+	if (not try_fetch_next_row()) {
+	    throw RowBufferException::NoMoreRows{};
+	}
+    }
+
+    /// Fetch the next row, or return false if there are no
+    /// more rows (after which end() is true)
+    bool try_fetch_next_row();
+
+    /// Make a row of a row group (an index into row_groups()) the
+    /// current row. The row group is only decoded if it is not the
+    /// current one. Throws std::out_of_range if there is no such row.
+    void seek(std::size_t group, std::size_t row);
+
+    bool end() const {
+	return end_;
+    }
+
+    auto current_row_number() const {
+	return current_row_;
+    }
+
+    /// The names and types of the columns
+    std::vector<ColumnSpec> columns() const;
+
+    /// The row groups read by this buffer
+    const auto & row_groups() const {
+	return row_groups_;
+    }
+
+    /// The total number of rows in the row groups read
+    std::size_t num_rows() const;
+
+    /// The largest value in an Integer or Timestamp column over all
+    /// the row groups (zero if all null). Throws ColumnNotFound if the
+    /// column does not exist
+    std::uint64_t column_max(const std::string & column_name) const;
+
+private:
+
+    ExtractRowBuffer(const std::string & file_path, std::size_t first_group,
+		     std::size_t end_group, const std::set<std::uint64_t> * nhs_numbers);
+
+    /// One column of the current row group
+    struct ColumnData {
+	std::string name;
+	ColumnType type;
+	std::vector<bool> nulls;
+	std::vector<std::uint64_t> values;
+	std::vector<std::string_view> dictionary;
+    };
+
+    template<typename T>
+    static ColumnType column_type() {
+	if constexpr (std::is_same_v<T, Varchar>) {
+	    return ColumnType::Varchar;
+	} else if constexpr (std::is_same_v<T, Integer>) {
+	    return ColumnType::Integer;
+	} else {
+	    static_assert(std::is_same_v<T, Timestamp>);
+	    return ColumnType::Timestamp;
+	}
+    }
+
+    void load_row_group(std::size_t index);
+
+    MappedFile file_;
+    std::vector<ColumnData> columns_;
+    std::map<std::string, std::size_t> column_index_;
+    std::vector<RowGroupInfo> row_groups_;
+    std::size_t group_{0};
+    std::size_t group_row_{0};
+    std::size_t current_row_{0};
+    bool end_{false};
+};
+
+/// Copy the rows of a row buffer, from the current row to the end,
+/// to an extract, leaving out the rows of the patients in skip.
+/// Returns the number of rows copied.
+std::size_t copy_rows(RowBuffer auto & row, ExtractWriter & writer,
+		      const std::set<std::uint64_t> & skip = {}) {
+    std::size_t num_copied{0};
+    for (; not row.end(); row.try_fetch_next_row()) {
+	auto nhs_number{column<Integer>("nhs_number", row)};
+	if (not nhs_number.null() and skip.contains(nhs_number.read())) {
+	    continue;
+	}
+	writer.push_row(row);
+	num_copied++;
+    }
+    return num_copied;
+}
+
+/**
+ * \brief Replace patients in an extract with the patients in another
+ *
+ * Every patient with any row in the update extract takes all its rows
+ * from the update; all the other patients keep the rows they have.
+ * The patients from the update are written after the others (the
+ * rows of each patient stay together, which is all Patient needs).
+ * The merged extract is written next to file_path and then renamed
+ * over it. Returns the nhs_numbers of the patients in the update.
+ */
+std::set<std::uint64_t> merge_extract(const std::string & file_path,
+				      const std::string & update_path);
+
+/**
+ * \brief Reads rows from another RowBuffer while saving them
+ *
+ * Each row is copied to an extract file as it is fetched, so that
+ * a normal run against the database leaves behind an extract that
+ * later runs can use instead. Call close() once all the rows have
+ * been read.
+ */
+template<RowBuffer R>
+class ExtractingRowBuffer {
+public:
+    ExtractingRowBuffer(R && row, const std::string & file_path)
+	: row_{std::move(row)},
+	  writer_{std::make_unique<ExtractWriter>(file_path, row_.columns())} {
+	if (not row_.end()) {
+	    writer_->push_row(row_);
+	}
+    }
+
+    template<typename T>
+    T at(const std::string & column_name) const {
+	return row_.template at<T>(column_name);
+    }
+
+    void fetch_next_row() {
+	if (not try_fetch_next_row()) {
+	    throw RowBufferException::NoMoreRows{};
+	}
+    }
+
+    bool try_fetch_next_row() {
+	if (not row_.try_fetch_next_row()) {
+	    return false;
+	}
+	writer_->push_row(row_);
+	return true;
+    }
+
+    bool end() const {
+	return row_.end();
+    }
+
+    auto current_row_number() const {
+	return row_.current_row_number();
+    }
+
+    /// Finish the extract file
+    void close() {
+	writer_->close();
+    }
+
+    std::size_t num_rows_saved() const {
+	return writer_->num_rows();
+    }
+
+private:
+    R row_;
+    std::unique_ptr<ExtractWriter> writer_;
+};
+
+#endif
@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include "acs_dataset.h"
+#include "synthetic_row_buffer.h"
+#include "config.h"
+#include "patient_rows.h"
+
+/// Every column gets one row for each index record, and lazy decoding
+/// gives the same table as parsing every spell up front
+TEST(AcsDataset, LazyDecodeGivesSameTable) {
+    auto config{load_config_file("../../scripts/config.yaml")};
+
+    auto make_table = [&](bool lazy) {
+	auto lookup{new_string_lookup()};
+	auto parser{new_clinical_code_parser(config["parser"], lookup)};
+	auto run_config{YAML::Clone(config)};
+	run_config["lazy_decode"] = lazy;
+	auto synthetic{read_synthetic_config(run_config)};
+	synthetic.seed = 5;
+	synthetic.num_patients = 300;
+	synthetic.index_probability = 0.2;
+	SyntheticRowBuffer row{synthetic, parser};
+
+	std::stringstream log;
+	AcsDataset dataset{run_config, parser, lookup, log};
+	EXPECT_EQ(dataset.decode_mode(), lazy ? DecodeMode::Primary : DecodeMode::Full);
+	PipelineStats stats;
+	for (auto & patient : patients(row, parser, dataset.decode_mode())) {
+	    dataset.add_patient(patient, stats, nullptr);
+	}
+	EXPECT_EQ(stats.patients, 300);
+	EXPECT_GT(stats.index_records, 0);
+	EXPECT_EQ(dataset.table().num_rows(), stats.index_records);
+	for (const auto & name : dataset.table().names()) {
+	    std::visit([&](const auto & column) {
+		EXPECT_EQ(column.size(), stats.index_records) << name;
+	    }, dataset.table().at(name));
+	}
+	return std::move(dataset.table());
+    };
+
+    auto full{make_table(false)};
+    auto lazy{make_table(true)};
+    ASSERT_EQ(full.names(), lazy.names());
+    EXPECT_EQ(std::get<NumericColumn>(full.at("index_date")),
+	      std::get<NumericColumn>(lazy.at("index_date")));
+    for (const auto & name : full.names()) {
+	if (name.find("_before") != std::string::npos or name.find("_after") != std::string::npos) {
+	    EXPECT_EQ(std::get<NumericColumn>(full.at(name)),
+		      std::get<NumericColumn>(lazy.at(name))) << name;
+	}
+    }
+}
+
+/// Only the index spells starting in the index_event date range make
+/// rows, and the spell date range is that range widened by the longest
+/// count window
+TEST(AcsDataset, IndexEventDateRange) {
+    auto config{load_config_file("../../scripts/config.yaml")};
+    auto lookup{new_string_lookup()};
+    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+    auto run_config{YAML::Clone(config)};
+    run_config["index_event"]["start_date"] = "2010-1-1";
+    run_config["index_event"]["end_date"] = "2012-1-1";
+    run_config["count_windows"] = YAML::Load("[30, 90]");
+    auto synthetic{read_synthetic_config(run_config)};
+    synthetic.seed = 5;
+    synthetic.num_patients = 300;
+    synthetic.index_probability = 0.2;
+    SyntheticRowBuffer row{synthetic, parser};
+
+    std::stringstream log;
+    AcsDataset dataset{run_config, parser, lookup, log};
+    auto start{parse_date("2010-1-1")};
+    auto end{parse_date("2012-1-1")};
+    auto [first, last] = dataset.spell_date_range();
+    ASSERT_TRUE(first.has_value() and last.has_value());
+    EXPECT_EQ(start - *first, years(1));
+    EXPECT_EQ(*last - end, years(1));
+
+    PipelineStats stats;
+    for (auto & patient : patients(row, parser, dataset.decode_mode())) {
+	dataset.add_patient(patient, stats, nullptr);
+    }
+    EXPECT_GT(stats.index_records, 0);
+    for (auto index_date : std::get<NumericColumn>(dataset.table().at("index_date"))) {
+	EXPECT_GE(index_date, start.read());
+	EXPECT_LT(index_date, end.read());
+    }
+}
+
+/// A start date less than the longest count window after 1970 leaves
+/// the spell date range open below, instead of wrapping round
+TEST(AcsDataset, SpellDateRangeNearEpoch) {
+    auto config{load_config_file("../../scripts/config.yaml")};
+    auto lookup{new_string_lookup()};
+    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+    auto run_config{YAML::Clone(config)};
+    run_config["index_event"]["start_date"] = "1970-3-1";
+    run_config["index_event"]["end_date"] = "1971-1-1";
+    run_config["count_windows"] = YAML::Load("[30, 90]");
+
+    std::stringstream log;
+    AcsDataset dataset{run_config, parser, lookup, log};
+    auto [first, last] = dataset.spell_date_range();
+    EXPECT_FALSE(first.has_value());
+    ASSERT_TRUE(last.has_value());
+    EXPECT_EQ(*last - parse_date("1971-1-1"), years(1));
+}
+
+/// An index spell is in the date range if its index_date (the start of
+/// its first episode) is, whatever the start date of the spell
+TEST(AcsDataset, IndexDateNotSpellStart) {
+    auto config{load_config_file("../../scripts/config.yaml")};
+    auto lookup{new_string_lookup()};
+    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+    auto run_config{YAML::Clone(config)};
+    run_config["index_event"]["start_date"] = "2015-1-1";
+    run_config["index_event"]["end_date"] = "2016-1-1";
+
+    // The spell of patient 1 starts before the range, and its first
+    // episode in it. The spell of patient 2 starts in the range, and its
+    // first episode after it.
+    PatientRows row;
+    row.push_row(1, "a", parse_date("2015-1-2").read(), "I210", parse_date("2014-12-31"));
+    row.push_row(2, "b", parse_date("2016-1-2").read(), "I210", parse_date("2015-12-30"));
+
+    std::stringstream log;
+    AcsDataset dataset{run_config, parser, lookup, log};
+    PipelineStats stats;
+    for (auto & patient : patients(row, parser, dataset.decode_mode())) {
+	dataset.add_patient(patient, stats, nullptr);
+    }
+    ASSERT_EQ(stats.index_records, 1);
+    EXPECT_EQ(std::get<NumericColumn>(dataset.table().at("index_date")).at(0),
+	      parse_date("2015-1-2").read());
+}
+
+/// A repeated or non-positive count window is rejected, instead of
+/// giving two columns the same name
+TEST(AcsDataset, BadCountWindows) {
+    auto config{load_config_file("../../scripts/config.yaml")};
+    auto lookup{new_string_lookup()};
+    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+    std::stringstream log;
+    for (const auto * windows : {"[30, 30]", "[90, 30, 90]", "[0]", "[-30]"}) {
+	auto run_config{YAML::Clone(config)};
+	run_config["count_windows"] = YAML::Load(windows);
+	EXPECT_THROW((AcsDataset{run_config, parser, lookup, log}), std::runtime_error)
+	    << windows;
+    }
+}
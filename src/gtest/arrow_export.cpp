@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstring>
+#include "arrow_export.h"
+
+namespace {
+
+/// The string at row n of a utf8 array
+std::string string_at(const ArrowArray * array, std::size_t n) {
+    auto * offsets{static_cast<const std::int32_t *>(array->buffers[1])};
+    auto * chars{static_cast<const char *>(array->buffers[2])};
+    return std::string(chars + offsets[n], chars + offsets[n + 1]);
+}
+
+}
+
+/// Numeric columns become float64 arrays with NaN as null, and factor
+/// columns become int32 indices into a utf8 dictionary of the levels
+TEST(ArrowExport, ResultTable) {
+    ResultTable table;
+    table.factor("index_type").push_back("ACS");
+    table.numeric("age").push_back(40.5);
+    table.factor("index_type").push_back("PCI");
+    table.numeric("age").push_back(std::nan(""));
+    table.factor("index_type").push_back("ACS");
+    table.numeric("age").push_back(63);
+
+    ArrowSchema schema;
+    ArrowArray array;
+    export_arrow(std::move(table), &schema, &array);
+
+    EXPECT_STREQ(schema.format, "+s");
+    ASSERT_EQ(schema.n_children, 2);
+    EXPECT_EQ(array.length, 3);
+    EXPECT_EQ(array.n_buffers, 1);
+    ASSERT_EQ(array.n_children, 2);
+
+    EXPECT_STREQ(schema.children[0]->name, "index_type");
+    EXPECT_STREQ(schema.children[0]->format, "i");
+    ASSERT_NE(schema.children[0]->dictionary, nullptr);
+    EXPECT_STREQ(schema.children[0]->dictionary->format, "u");
+    const auto * index_type{array.children[0]};
+    EXPECT_EQ(index_type->length, 3);
+    EXPECT_EQ(index_type->null_count, 0);
+    auto * indices{static_cast<const std::int32_t *>(index_type->buffers[1])};
+    EXPECT_EQ(indices[0], 0);
+    EXPECT_EQ(indices[1], 1);
+    EXPECT_EQ(indices[2], 0);
+    ASSERT_EQ(index_type->dictionary->length, 2);
+    EXPECT_EQ(string_at(index_type->dictionary, 0), "ACS");
+    EXPECT_EQ(string_at(index_type->dictionary, 1), "PCI");
+
+    EXPECT_STREQ(schema.children[1]->name, "age");
+    EXPECT_STREQ(schema.children[1]->format, "g");
+    EXPECT_EQ(schema.children[1]->flags, ARROW_FLAG_NULLABLE);
+    const auto * age{array.children[1]};
+    EXPECT_EQ(age->null_count, 1);
+    auto * validity{static_cast<const std::uint8_t *>(age->buffers[0])};
+    ASSERT_NE(validity, nullptr);
+    EXPECT_EQ(validity[0] & 0x7, 0x5);
+    auto * values{static_cast<const double *>(age->buffers[1])};
+    EXPECT_EQ(values[0], 40.5);
+    EXPECT_EQ(values[2], 63);
+
+    // The columns were moved out of the table
+    EXPECT_EQ(table.num_rows(), 0);
+
+    array.release(&array);
+    schema.release(&schema);
+    EXPECT_EQ(array.release, nullptr);
+    EXPECT_EQ(schema.release, nullptr);
+}
+
+/// A consumer can move a child out of the struct and release it after
+/// the parent
+TEST(ArrowExport, MoveChild) {
+    ResultTable table;
+    table.numeric("a").push_back(1);
+    table.numeric("b").push_back(2);
+    ArrowSchema schema;
+    ArrowArray array;
+    export_arrow(std::move(table), &schema, &array);
+
+    ArrowArray child;
+    std::memcpy(&child, array.children[1], sizeof(ArrowArray));
+    array.children[1]->release = nullptr;
+    array.release(&array);
+    schema.release(&schema);
+
+    EXPECT_EQ(static_cast<const double *>(child.buffers[1])[0], 2);
+    EXPECT_EQ(child.buffers[0], nullptr);
+    child.release(&child);
+}
+
+/// String columns become utf8 arrays, and must be the same length
+TEST(ArrowExport, StringColumns) {
+    StringColumns columns{{"code", {"I21.0", "I21.1"}}, {"docs", {"STEMI", "it's \"NSTEMI\""}}};
+    ArrowSchema schema;
+    ArrowArray array;
+    export_arrow(columns, &schema, &array);
+    EXPECT_EQ(array.length, 2);
+    ASSERT_EQ(array.n_children, 2);
+    EXPECT_STREQ(schema.children[1]->name, "docs");
+    EXPECT_EQ(string_at(array.children[0], 1), "I21.1");
+    EXPECT_EQ(string_at(array.children[1], 1), "it's \"NSTEMI\"");
+    array.release(&array);
+    schema.release(&schema);
+
+    columns[1].second.pop_back();
+    EXPECT_THROW(export_arrow(columns, &schema, &array), std::runtime_error);
+}
@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <fstream>
+#include <filesystem>
+#include "checkpoint.h"
+
+namespace {
+
+void add_row(ResultTable & table, const std::string & nhs_number, double age) {
+    table.factor("nhs_number").push_back(nhs_number);
+    table.numeric("age").push_back(age);
+}
+
+}
+
+/// Rows saved in several checkpoints are loaded in order, with
+/// missing values kept
+TEST(Checkpoint, SaveAndLoad) {
+    const std::string directory{"checkpoint_test"};
+    {
+	Checkpoint checkpoint{directory, "database"};
+	checkpoint.clear();
+	ResultTable table;
+	add_row(table, "1", 40.5);
+	add_row(table, "2", std::nan(""));
+	checkpoint.save(table, 2);
+	add_row(table, "3", 1.0/3.0);
+	checkpoint.save(table, 3);
+    }
+
+    Checkpoint checkpoint{directory, "database"};
+    ResultTable table;
+    table.factor("nhs_number");
+    table.numeric("age");
+    auto last{checkpoint.load(table)};
+    ASSERT_TRUE(last.has_value());
+    EXPECT_EQ(*last, 3);
+    ASSERT_EQ(table.num_rows(), 3);
+    EXPECT_EQ(table.factor("nhs_number").at(2), "3");
+    EXPECT_EQ(table.numeric("age")[0], 40.5);
+    EXPECT_TRUE(std::isnan(table.numeric("age")[1]));
+    EXPECT_EQ(table.numeric("age")[2], 1.0/3.0);
+
+    checkpoint.clear();
+    ResultTable empty;
+    EXPECT_FALSE(checkpoint.load(empty).has_value());
+    std::filesystem::remove_all(directory);
+}
+
+/// Rows written after the last saved state (by a save that did
+/// not finish) are dropped when the checkpoint is loaded
+TEST(Checkpoint, PartialSaveDropped) {
+    const std::string directory{"checkpoint_test"};
+    {
+	Checkpoint checkpoint{directory, "database"};
+	ResultTable table;
+	add_row(table, "1", 1);
+	checkpoint.save(table, 1);
+	std::ofstream rows{directory + "/rows.csv", std::ios::app};
+	rows << "2,2\n";
+    }
+
+    Checkpoint checkpoint{directory, "database"};
+    ResultTable table;
+    table.factor("nhs_number");
+    table.numeric("age");
+    EXPECT_EQ(checkpoint.load(table), 1);
+    EXPECT_EQ(table.num_rows(), 1);
+
+    // The next save continues from the loaded rows
+    add_row(table, "3", 3);
+    checkpoint.save(table, 3);
+    ResultTable reloaded;
+    reloaded.factor("nhs_number");
+    reloaded.numeric("age");
+    EXPECT_EQ(checkpoint.load(reloaded), 3);
+    ASSERT_EQ(reloaded.num_rows(), 2);
+    EXPECT_EQ(reloaded.factor("nhs_number").at(1), "3");
+    std::filesystem::remove_all(directory);
+}
+
+/// A checkpoint cannot be loaded into a table with other columns
+TEST(Checkpoint, ColumnMismatch) {
+    const std::string directory{"checkpoint_test"};
+    Checkpoint checkpoint{directory, "database"};
+    ResultTable table;
+    add_row(table, "1", 1);
+    checkpoint.save(table, 1);
+
+    ResultTable other;
+    other.numeric("age");
+    EXPECT_THROW(checkpoint.load(other), std::runtime_error);
+    std::filesystem::remove_all(directory);
+}
+
+/// A checkpoint cannot be resumed against rows from another source
+TEST(Checkpoint, SourceMismatch) {
+    const std::string directory{"checkpoint_test"};
+    {
+	Checkpoint checkpoint{directory, "database"};
+	ResultTable table;
+	add_row(table, "1", 1);
+	checkpoint.save(table, 1);
+    }
+
+    Checkpoint checkpoint{directory, "synthetic rows (seed 1, 10 patients)"};
+    ResultTable table;
+    table.factor("nhs_number");
+    table.numeric("age");
+    EXPECT_THROW(checkpoint.load(table), std::runtime_error);
+    std::filesystem::remove_all(directory);
+}
+
+/// The source of the synthetic rows changes with their seed
+TEST(Checkpoint, SyntheticSource) {
+    auto config{YAML::Load("synthetic: {enabled: true, seed: 1, num_patients: 10}")};
+    auto source{checkpoint_source(config)};
+    EXPECT_EQ(source, checkpoint_source(config));
+    config["synthetic"]["seed"] = 2;
+    EXPECT_NE(source, checkpoint_source(config));
+    EXPECT_EQ(checkpoint_source(YAML::Load("connection: {dsn: xsw}")), "database xsw");
+}
+
+/// Patients up to and including the last one saved are skipped, and
+/// it is an error if the last one saved is never seen
+TEST(Checkpoint, SkipSavedPatients) {
+    SkipSavedPatients skip{3};
+    EXPECT_TRUE(skip.skip(5));
+    EXPECT_TRUE(skip.skip(3));
+    EXPECT_FALSE(skip.skip(1));
+    EXPECT_NO_THROW(skip.finish());
+
+    SkipSavedPatients missing{3};
+    for (unsigned long long n : {1, 2, 4}) {
+	EXPECT_TRUE(missing.skip(n));
+    }
+    EXPECT_THROW(missing.finish(), std::runtime_error);
+
+    SkipSavedPatients none{std::nullopt};
+    EXPECT_FALSE(none.skip(1));
+    EXPECT_NO_THROW(none.finish());
+}
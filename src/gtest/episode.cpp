@@ -120,3 +120,40 @@ TEST(Episode, EpisodeRowColumnCheck) {
     }
 }
 
+
+/// Check that an episode read in DecodeMode::Primary has only the
+/// primary codes until it is decoded, and is then the same as an
+/// episode read in full (including stopping at an invalid code)
+TEST(Episode, LazyDecodeMatchesFull) {
+    EpisodeRowBuffer row;
+    row.set_primary_diagnosis("I210");
+    row.set_secondary_diagnoses({"  I220", "I240", "abcd", "I210"});
+    row.set_primary_procedure("K432");
+    row.set_secondary_procedures({"  K111 ", "K221", "  "});
+
+    auto lookup{new_string_lookup()};
+    auto config{load_config_file("../../scripts/config.yaml")};
+    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+    Episode full{row, parser};
+    Episode lazy{row, parser, DecodeMode::Primary};
+
+    EXPECT_FALSE(lazy.decoded());
+    EXPECT_EQ(lazy.primary_diagnosis().name(lookup), "I21.0");
+    EXPECT_EQ(lazy.primary_procedure().name(lookup), "K43.2");
+    EXPECT_TRUE(lazy.secondary_diagnoses().empty());
+    EXPECT_TRUE(lazy.secondary_procedures().empty());
+
+    lazy.decode(parser);
+    EXPECT_TRUE(lazy.decoded());
+    
+    ASSERT_EQ(lazy.secondary_diagnoses().size(), 2);
+    ASSERT_EQ(lazy.secondary_procedures().size(), 2);
+    EXPECT_EQ(full.secondary_diagnoses().size(), 2);
+    EXPECT_EQ(full.secondary_procedures().size(), 2);
+    for (std::size_t n{0}; n < 2; n++) {
+	EXPECT_EQ(lazy.secondary_diagnoses()[n].name(lookup),
+		  full.secondary_diagnoses()[n].name(lookup));
+	EXPECT_EQ(lazy.secondary_procedures()[n].name(lookup),
+		  full.secondary_procedures()[n].name(lookup));
+    }
+}
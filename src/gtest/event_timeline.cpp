@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+#include "event_timeline.h"
+
+/// One day in seconds
+const long long day{24*60*60};
+
+TEST(EventTimeline, EmptyTimelineCountsZero) {
+    EventTimeline timeline{2};
+    timeline.finalise();
+    EXPECT_EQ(timeline.count(0, Timestamp{100*day}, days(30)), 0);
+    EXPECT_EQ(timeline.count(1, Timestamp{100*day}, days(-30)), 0);
+}
+
+/// Events exactly at the base time or at the end of the window
+/// are not counted
+TEST(EventTimeline, WindowIsStrict) {
+    EventTimeline timeline{1};
+    timeline.push(Timestamp{100*day}, 0);
+    timeline.push(Timestamp{110*day}, 0);
+    timeline.push(Timestamp{130*day}, 0);
+    timeline.finalise();
+
+    Timestamp base{100*day};
+    EXPECT_EQ(timeline.count(0, base, days(30)), 1);
+    EXPECT_EQ(timeline.count(0, base, days(31)), 2);
+    EXPECT_EQ(timeline.count(0, base, days(-30)), 0);
+}
+
+/// Check counts in several windows before and after, with
+/// events pushed out of order and sharing timestamps
+TEST(EventTimeline, MultipleWindowsAndGroups) {
+    EventTimeline timeline{3};
+    timeline.push(Timestamp{200*day}, 1);
+    timeline.push(Timestamp{10*day}, 0);
+    timeline.push(Timestamp{90*day}, 0);
+    timeline.push(Timestamp{90*day}, 0);
+    timeline.push(Timestamp{90*day}, 2);
+    timeline.push(Timestamp{120*day}, 1);
+    timeline.finalise();
+
+    Timestamp base{100*day};
+    EXPECT_EQ(timeline.count(0, base, days(-30)), 2);
+    EXPECT_EQ(timeline.count(0, base, days(-365)), 3);
+    EXPECT_EQ(timeline.count(2, base, days(-30)), 1);
+    EXPECT_EQ(timeline.count(1, base, days(-365)), 0);
+    EXPECT_EQ(timeline.count(1, base, days(30)), 1);
+    EXPECT_EQ(timeline.count(1, base, days(365)), 2);
+    EXPECT_EQ(timeline.count(0, base, days(365)), 0);
+}
+
+/// Null event times are dropped, and a null base has no window
+TEST(EventTimeline, NullTimestamps) {
+    EventTimeline timeline{1};
+    timeline.push(Timestamp{}, 0);
+    timeline.push(Timestamp{50*day}, 0);
+    timeline.finalise();
+    EXPECT_EQ(timeline.count(0, Timestamp{60*day}, days(-365)), 1);
+    EXPECT_EQ(timeline.count(0, Timestamp{}, days(-365)), 0);
+}
+
+TEST(EventTimeline, ColumnOutOfRange) {
+    EventTimeline timeline{1};
+    EXPECT_THROW(timeline.push(Timestamp{0}, 1), std::out_of_range);
+}
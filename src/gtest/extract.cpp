@@ -0,0 +1,254 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <filesystem>
+#include "extract.h"
+#include "patient.h"
+#include "string_lookup.h"
+#include "config.h"
+#include "patient_rows.h"
+
+namespace {
+
+/// Patients 1 to 10 in order (see make_patient_rows)
+PatientRows make_rows() {
+    return make_patient_rows({1, 2, 3, 4, 5, 6, 7, 8, 9, 10});
+}
+
+}
+
+/// Patients read from an extract are the same as the patients
+/// read from the original rows, and row groups do not split a
+/// patient
+TEST(Extract, RoundTrip) {
+    auto lookup{new_string_lookup()};
+    auto config{load_config_file("../../scripts/config.yaml")};
+    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+
+    const std::string extract_file{"extract_test.rdbx"};
+    {
+	auto rows{make_rows()};
+	ExtractWriter writer{extract_file, rows.columns(), 4};
+	while (not rows.end()) {
+	    writer.push_row(rows);
+	    rows.try_fetch_next_row();
+	}
+	writer.close();
+	EXPECT_EQ(writer.num_rows(), 30);
+    }
+
+    ExtractRowBuffer extract{extract_file};
+    EXPECT_EQ(extract.num_rows(), 30);
+    EXPECT_EQ(extract.columns().size(), make_rows().columns().size());
+    // Groups of at least 4 rows end between patients (3 rows each)
+    ASSERT_EQ(extract.row_groups().size(), 5);
+    for (const auto & group : extract.row_groups()) {
+	EXPECT_EQ(group.num_rows, 6);
+	EXPECT_EQ(group.max_nhs_number, group.min_nhs_number + 1);
+    }
+
+    auto rows{make_rows()};
+    auto expected{patients(rows, parser)};
+    auto expected_it{expected.begin()};
+    for (const auto & patient : patients(extract, parser)) {
+	ASSERT_NE(expected_it, expected.end());
+	const auto & expected_patient{*expected_it};
+	EXPECT_EQ(patient.nhs_number(), expected_patient.nhs_number());
+	ASSERT_EQ(patient.spells().size(), expected_patient.spells().size());
+	for (std::size_t s{0}; s < patient.spells().size(); s++) {
+	    const auto & spell{patient.spells()[s]};
+	    const auto & expected_spell{expected_patient.spells()[s]};
+	    EXPECT_EQ(spell.id(), expected_spell.id());
+	    ASSERT_EQ(spell.episodes().size(), expected_spell.episodes().size());
+	    for (std::size_t e{0}; e < spell.episodes().size(); e++) {
+		const auto & episode{spell.episodes()[e]};
+		const auto & expected_episode{expected_spell.episodes()[e]};
+		EXPECT_EQ(episode.episode_start(), expected_episode.episode_start());
+		EXPECT_EQ(episode.primary_diagnosis().null(), expected_episode.primary_diagnosis().null());
+		if (not episode.primary_diagnosis().null()) {
+		    EXPECT_EQ(episode.primary_diagnosis().name(lookup),
+			      expected_episode.primary_diagnosis().name(lookup));
+		}
+	    }
+	}
+	++expected_it;
+    }
+    EXPECT_EQ(expected_it, expected.end());
+    EXPECT_TRUE(extract.end());
+    std::remove(extract_file.c_str());
+}
+
+/// Buffers over separate ranges of row groups read the patients of
+/// those groups only
+TEST(Extract, RowGroupRange) {
+    const std::string extract_file{"extract_range_test.rdbx"};
+    {
+	auto rows{make_rows()};
+	ExtractWriter writer{extract_file, rows.columns(), 4};
+	copy_rows(rows, writer);
+	writer.close();
+    }
+
+    std::vector<unsigned long long> nhs_numbers;
+    for (auto [first, end] : {std::pair{0, 2}, std::pair{2, 4}, std::pair{4, 10}}) {
+	ExtractRowBuffer extract{extract_file, static_cast<std::size_t>(first),
+				 static_cast<std::size_t>(end)};
+	for (; not extract.end(); extract.try_fetch_next_row()) {
+	    auto nhs_number{column<Integer>("nhs_number", extract).read()};
+	    if (nhs_numbers.empty() or nhs_numbers.back() != nhs_number) {
+		nhs_numbers.push_back(nhs_number);
+	    }
+	}
+    }
+    EXPECT_EQ(nhs_numbers, std::vector<unsigned long long>({1, 2, 3, 4, 5, 6, 7, 8, 9, 10}));
+
+    ExtractRowBuffer past_end{extract_file, 5};
+    EXPECT_TRUE(past_end.end());
+    EXPECT_EQ(past_end.num_rows(), 0);
+    std::remove(extract_file.c_str());
+}
+
+/// Rows read through an ExtractingRowBuffer are saved as they are
+/// fetched, and null values survive the round trip
+TEST(Extract, SaveWhileReading) {
+    const std::string extract_file{"extract_tee_test.rdbx"};
+    {
+	ExtractingRowBuffer<PatientRows> row{make_rows(), extract_file};
+	std::size_t count{1};
+	while (row.try_fetch_next_row()) {
+	    count++;
+	}
+	EXPECT_EQ(count, 30);
+	row.close();
+	EXPECT_EQ(row.num_rows_saved(), 30);
+    }
+
+    ExtractRowBuffer extract{extract_file};
+    auto rows{make_rows()};
+    for (std::size_t n{0}; n < 30; n++) {
+	EXPECT_EQ(column<Integer>("nhs_number", extract).read(),
+		  column<Integer>("nhs_number", rows).read());
+	EXPECT_EQ(column<Timestamp>("episode_start", extract),
+		  column<Timestamp>("episode_start", rows));
+	EXPECT_TRUE(column<Timestamp>("date_of_death", extract).null());
+	EXPECT_TRUE(column<Varchar>("primary_procedure", extract).null());
+	EXPECT_EQ(column<Varchar>("spell_id", extract).read(),
+		  column<Varchar>("spell_id", rows).read());
+	EXPECT_THROW(column<Integer>("spell_id", extract), RowBufferException::WrongColumnType);
+	EXPECT_THROW(column<Integer>("missing", extract), RowBufferException::ColumnNotFound);
+	extract.try_fetch_next_row();
+	rows.try_fetch_next_row();
+    }
+    EXPECT_TRUE(extract.end());
+    std::remove(extract_file.c_str());
+}
+
+/// A writer that is not closed leaves the existing extract as it was,
+/// and deletes its temporary file
+TEST(Extract, UnclosedWriterKeepsFile) {
+    const std::string extract_file{"extract_unclosed.rdbx"};
+    {
+	auto rows{make_rows()};
+	ExtractWriter writer{extract_file, rows.columns()};
+	copy_rows(rows, writer);
+	writer.close();
+    }
+    {
+	auto rows{make_rows()};
+	ExtractWriter writer{extract_file, rows.columns()};
+	writer.push_row(rows);
+	EXPECT_TRUE(std::filesystem::exists(extract_file + ".tmp"));
+    }
+    EXPECT_FALSE(std::filesystem::exists(extract_file + ".tmp"));
+    EXPECT_EQ(ExtractRowBuffer{extract_file}.num_rows(), 30);
+    std::remove(extract_file.c_str());
+}
+
+/// Patients in the update replace their rows in the extract, new
+/// patients are added, and the column maximums give the watermark
+TEST(Extract, MergeUpdate) {
+    const std::string extract_file{"extract_merge_test.rdbx"};
+    const std::string update_file{"extract_merge_update.rdbx"};
+    {
+	auto rows{make_rows()};
+	ExtractWriter writer{extract_file, rows.columns(), 4};
+	copy_rows(rows, writer);
+	writer.close();
+    }
+    EXPECT_EQ(ExtractRowBuffer{extract_file}.column_max("episode_start"), 10100);
+    {
+	PatientRows rows;
+	rows.push_row(3, "s3", 3000, "I210");
+	rows.push_row(11, "s11", 11000, "I210");
+	ExtractWriter writer{update_file, rows.columns()};
+	copy_rows(rows, writer);
+	writer.close();
+    }
+
+    auto updated{merge_extract(extract_file, update_file)};
+    EXPECT_EQ(updated, (std::set<std::uint64_t>{3, 11}));
+
+    ExtractRowBuffer merged{extract_file};
+    EXPECT_EQ(merged.num_rows(), 29);
+    EXPECT_EQ(merged.column_max("episode_start"), 11000);
+    std::map<std::uint64_t, std::size_t> rows_per_patient;
+    std::vector<std::uint64_t> order;
+    for (; not merged.end(); merged.try_fetch_next_row()) {
+	auto nhs_number{column<Integer>("nhs_number", merged).read()};
+	if (order.empty() or order.back() != nhs_number) {
+	    order.push_back(nhs_number);
+	}
+	rows_per_patient[nhs_number]++;
+    }
+    EXPECT_EQ(order, (std::vector<std::uint64_t>{1, 2, 4, 5, 6, 7, 8, 9, 10, 3, 11}));
+    EXPECT_EQ(rows_per_patient[3], 1);
+    EXPECT_EQ(rows_per_patient[11], 1);
+    EXPECT_EQ(rows_per_patient[5], 3);
+    std::remove(extract_file.c_str());
+    std::remove(update_file.c_str());
+}
+
+/// Only the row groups that may hold the patients asked for are read,
+/// even when the patients are out of order (as after a merge), and
+/// the row groups of a version 1 file are all read
+TEST(Extract, OnlyPatients) {
+    const std::string extract_file{"extract_only_patients.rdbx"};
+    {
+	// Patients 3 and 1 (one row each) are out of order, as they would
+	// be after merge_extract
+	PatientRows rows;
+	for (unsigned long long n : {2, 4, 5, 6, 7, 8, 9, 3, 1, 10}) {
+	    auto spell_id{"s" + std::to_string(n)};
+	    auto num_rows{n == 1 or n == 3 ? 1 : 3};
+	    for (int r{0}; r < num_rows; r++) {
+		rows.push_row(n, spell_id, 1000*n + r, "I210");
+	    }
+	}
+	ExtractWriter writer{extract_file, rows.columns(), 4};
+	copy_rows(rows, writer);
+	writer.close();
+    }
+
+    auto read_patients = [&](const std::set<std::uint64_t> & nhs_numbers) {
+	std::map<std::uint64_t, std::size_t> rows_per_patient;
+	for (ExtractRowBuffer extract{extract_file, nhs_numbers}; not extract.end();
+	     extract.try_fetch_next_row()) {
+	    rows_per_patient[column<Integer>("nhs_number", extract).read()]++;
+	}
+	return rows_per_patient;
+    };
+    // The row groups hold patients 2 and 4, 5 and 6, 7 and 8, 9 and 3,
+    // and 1 and 10, so only the first and third are skipped
+    auto rows_per_patient{read_patients({6})};
+    EXPECT_EQ(rows_per_patient, (std::map<std::uint64_t, std::size_t>{
+		{5, 3}, {6, 3}, {9, 3}, {3, 1}, {1, 1}, {10, 3}}));
+    EXPECT_EQ(read_patients({3})[3], 1);
+    EXPECT_TRUE(read_patients({100}).empty());
+
+    // The same file with the version 1 magic
+    {
+	std::fstream file{extract_file, std::ios::binary | std::ios::in | std::ios::out};
+	file.write("RDBXTR01", 8);
+    }
+    EXPECT_EQ(read_patients({6}).size(), 10);
+    std::remove(extract_file.c_str());
+}
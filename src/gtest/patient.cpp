@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+#include "patient.h"
+#include "string_lookup.h"
+#include "config.h"
+#include "patient_rows.h"
+
+static_assert(std::ranges::input_range<PatientRange<PatientRows>>);
+
+/// All the patients, including the last one, are returned
+/// by the range, and no exception escapes at the end
+TEST(PatientRange, ReadsAllPatients) {
+    auto lookup{new_string_lookup()};
+    auto config{load_config_file("../../scripts/config.yaml")};
+    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+
+    PatientRows row;
+    row.push_row(1, "a", 100, "I210");
+    row.push_row(1, "a", 50, "I220");
+    row.push_row(1, "b", 200, "I240");
+    row.push_row(2, "c", 300, "I210");
+    row.push_row(3, "d", 400, "I210");
+    row.push_row(3, "e", 500, "I210");
+
+    std::vector<unsigned long long> nhs_numbers;
+    std::vector<std::size_t> num_spells;
+    for (const auto & patient : patients(row, parser)) {
+	nhs_numbers.push_back(patient.nhs_number());
+	num_spells.push_back(patient.spells().size());
+    }
+
+    EXPECT_EQ(nhs_numbers, (std::vector<unsigned long long>{1, 2, 3}));
+    EXPECT_EQ(num_spells, (std::vector<std::size_t>{2, 1, 2}));
+    EXPECT_TRUE(row.end());
+}
+
+/// Episodes in a spell are sorted by start date
+TEST(PatientRange, SpellEpisodesSorted) {
+    auto lookup{new_string_lookup()};
+    auto config{load_config_file("../../scripts/config.yaml")};
+    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+
+    PatientRows row;
+    row.push_row(1, "a", 100, "I210");
+    row.push_row(1, "a", 50, "I220");
+
+    Patient patient{row, parser};
+    const auto & episodes{patient.spells().at(0).episodes()};
+    ASSERT_EQ(episodes.size(), 2);
+    EXPECT_EQ(episodes[0].primary_diagnosis().name(lookup), "I22.0");
+    EXPECT_EQ(episodes[1].primary_diagnosis().name(lookup), "I21.0");
+}
+
+TEST(PatientRange, EmptyRows) {
+    auto lookup{new_string_lookup()};
+    auto config{load_config_file("../../scripts/config.yaml")};
+    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+
+    PatientRows row;
+    std::size_t count{0};
+    for ([[maybe_unused]] const auto & patient : patients(row, parser)) {
+	count++;
+    }
+    EXPECT_EQ(count, 0);
+    EXPECT_THROW((Patient{row, parser}), RowBufferException::NoMoreRows);
+}
+
+/// Reading patients through an arena gives the same result, the
+/// spells and episodes are allocated from it, and (for small
+/// patients) it never reaches the system allocator
+TEST(PatientRange, ArenaReset) {
+    auto lookup{new_string_lookup()};
+    auto config{load_config_file("../../scripts/config.yaml")};
+    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+
+    PatientRows row;
+    for (unsigned long long n{0}; n < 100; n++) {
+	row.push_row(n, "a", 100, "I210");
+	row.push_row(n, "a", 50, "I220");
+	row.push_row(n, "b", 200, "I240");
+    }
+
+    PatientArena arena{true};
+    std::size_t num_patients{0};
+    for (const auto & patient : patients(row, parser, DecodeMode::Full, &arena)) {
+	EXPECT_EQ(patient.nhs_number(), num_patients++);
+	ASSERT_EQ(patient.spells().size(), 2);
+	EXPECT_EQ(patient.spells()[0].episodes()[0].primary_diagnosis().name(lookup), "I22.0");
+	// The arena is passed down to the containers of the spells and episodes
+	const auto & episode{patient.spells()[1].episodes()[0]};
+	EXPECT_EQ(patient.spells()[1].episodes().get_allocator().resource(), arena.resource());
+	EXPECT_EQ(episode.secondary_diagnoses().get_allocator().resource(), arena.resource());
+    }
+    EXPECT_EQ(num_patients, 100);
+    EXPECT_GT(arena.num_allocations(), 0);
+    EXPECT_EQ(arena.num_upstream_allocations(), 0);
+}
+
+/// Spell ids too long to fit in the string itself are allocated from
+/// the arena (one allocation for each spell), like the containers
+TEST(PatientRange, ArenaSpellIds) {
+    auto lookup{new_string_lookup()};
+    auto config{load_config_file("../../scripts/config.yaml")};
+    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+
+    auto count_allocations = [&](const std::string & prefix) {
+	PatientRows row;
+	for (unsigned long long n{0}; n < 10; n++) {
+	    row.push_row(n, prefix + std::to_string(n), 100, "I210");
+	}
+	PatientArena arena{true};
+	for (const auto & patient : patients(row, parser, DecodeMode::Primary, &arena)) {
+	    EXPECT_EQ(patient.spells()[0].id(), prefix + std::to_string(patient.nhs_number()));
+	}
+	EXPECT_EQ(arena.num_upstream_allocations(), 0);
+	return arena.num_allocations();
+    };
+    auto short_ids{count_allocations("a")};
+    auto long_ids{count_allocations(std::string(100, 'a'))};
+    EXPECT_EQ(long_ids, short_ids + 10);
+}
+
+/// With a mortality table, the mortality data comes from the table
+/// (the first record of each patient), and patients without a record
+/// are alive
+TEST(PatientRange, MortalityTable) {
+    auto lookup{new_string_lookup()};
+    auto config{load_config_file("../../scripts/config.yaml")};
+    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+
+    PatientRows deaths;
+    deaths.push_mortality_row(2, 1000, "I210");
+    deaths.push_mortality_row(2, 2000, "I220");
+    MortalityTable mortality{deaths, parser};
+    EXPECT_EQ(mortality.size(), 1);
+
+    PatientRows row;
+    row.push_row(1, "a", 100, "I210");
+    row.push_row(2, "b", 200, "I210");
+    std::vector<bool> alive;
+    for (const auto & patient : patients(row, parser, DecodeMode::Full, nullptr, &mortality)) {
+	alive.push_back(patient.mortality().alive());
+	if (not patient.mortality().alive()) {
+	    EXPECT_EQ(patient.mortality().date_of_death().read(), 1000);
+	    EXPECT_EQ(patient.mortality().cause_of_death()->name(lookup), "I21.0");
+	}
+    }
+    EXPECT_EQ(alive, (std::vector<bool>{true, false}));
+}
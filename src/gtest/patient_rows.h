@@ -0,0 +1,101 @@
+#ifndef PATIENT_ROWS_HPP
+#define PATIENT_ROWS_HPP
+
+#include <map>
+#include <vector>
+#include <string>
+#include "row_buffer.h"
+#include "sql_types.h"
+
+/// A mock row buffer holding a list of rows in memory, with the
+/// columns needed by the Patient constructor
+class PatientRows {
+public:
+    /// Append an episode row for a patient and spell (with a null
+    /// spell_start, unless one is given)
+    void push_row(unsigned long long nhs_number, const std::string & spell_id,
+		  unsigned long long episode_start, const std::string & primary_diagnosis,
+		  const Timestamp & spell_start = Timestamp{}) {
+	std::map<std::string, SqlType> row;
+	row["nhs_number"] = Integer{nhs_number};
+	row["spell_id"] = Varchar{spell_id};
+	row["spell_start"] = spell_start;
+	row["spell_end"] = Timestamp{};
+	row["age_at_episode"] = Integer{50};
+	row["episode_start"] = Timestamp{episode_start};
+	row["episode_end"] = Timestamp{episode_start};
+	row["primary_diagnosis"] = Varchar{primary_diagnosis};
+	row["primary_procedure"] = Varchar{};
+	row["date_of_death"] = Timestamp{};
+	row["age_at_death"] = Integer{};
+	row["cause_of_death"] = Varchar{};
+	rows_.push_back(row);
+    }
+
+    /// Append a row of the mortality query (see MortalityTable)
+    void push_mortality_row(unsigned long long nhs_number, unsigned long long date_of_death,
+			    const std::string & cause_of_death) {
+	std::map<std::string, SqlType> row;
+	row["nhs_number"] = Integer{nhs_number};
+	row["date_of_death"] = Timestamp{date_of_death};
+	row["age_at_death"] = Integer{80};
+	row["cause_of_death"] = Varchar{cause_of_death};
+	rows_.push_back(row);
+    }
+
+    template<typename T>
+    T at(const std::string & column_name) const {
+	try {
+	    return std::get<T>(rows_.at(current_row_).at(column_name));
+	} catch (const std::out_of_range &) {
+	    throw RowBufferException::ColumnNotFound{};
+	} catch (const std::bad_variant_access &) {
+	    throw RowBufferException::WrongColumnType{};
+	}
+    }
+
+    bool try_fetch_next_row() {
+	if (++current_row_ >= rows_.size()) {
+	    return false;
+	}
+	return true;
+    }
+
+    /// The columns of the first row
+    std::vector<ColumnSpec> columns() const {
+	std::vector<ColumnSpec> columns;
+	for (const auto & [name, value] : rows_.at(0)) {
+	    columns.push_back({name, static_cast<ColumnType>(value.index())});
+	}
+	return columns;
+    }
+
+    auto current_row_number() const {
+	return current_row_;
+    }
+
+    bool end() const {
+	return current_row_ >= rows_.size();
+    }
+    
+private:
+    std::size_t current_row_{0};
+    std::vector<std::map<std::string, SqlType>> rows_;
+};
+
+/// Rows for the patients with these NHS numbers (in this order), each
+/// with two spells: "s<n>", with an I210 episode and an invalid
+/// episode, and "s<n>b", with a null diagnosis. Episode start times
+/// are 1000*n onwards.
+inline PatientRows make_patient_rows(const std::vector<unsigned long long> & nhs_numbers) {
+    PatientRows row;
+    for (auto n : nhs_numbers) {
+	auto spell_id{"s" + std::to_string(n)};
+	row.push_row(n, spell_id, 1000*n, "I210");
+	row.push_row(n, spell_id, 1000*n + 50, "XXXX");
+	row.push_row(n, spell_id + "b", 1000*n + 100, "");
+    }
+    return row;
+}
+
+#endif
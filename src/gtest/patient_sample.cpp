@@ -0,0 +1,35 @@
+#include <gtest/gtest.h>
+#include "patient_sample.h"
+
+/// About the right share of the patients is kept, and the sample is
+/// the same for the same seed
+TEST(PatientSample, Fraction) {
+    PatientSample sample{0.05, 3};
+    PatientSample same{0.05, 3};
+    PatientSample other{0.05, 4};
+    std::size_t kept{0};
+    std::size_t differ{0};
+    for (std::uint64_t nhs_number{1000000}; nhs_number < 1100000; nhs_number++) {
+	kept += sample.contains(nhs_number);
+	EXPECT_EQ(sample.contains(nhs_number), same.contains(nhs_number));
+	differ += sample.contains(nhs_number) != other.contains(nhs_number);
+    }
+    EXPECT_NEAR(kept / 100000.0, 0.05, 0.005);
+    EXPECT_GT(differ, 0);
+}
+
+/// A smaller fraction keeps a subset of the patients, and a fraction
+/// of 1 keeps all of them
+TEST(PatientSample, Nested) {
+    PatientSample small{0.1, 7};
+    PatientSample large{0.3, 7};
+    PatientSample all{1, 7};
+    for (std::uint64_t nhs_number{0}; nhs_number < 10000; nhs_number++) {
+	if (small.contains(nhs_number)) {
+	    EXPECT_TRUE(large.contains(nhs_number));
+	}
+	EXPECT_TRUE(all.contains(nhs_number));
+    }
+    EXPECT_THROW((PatientSample{0, 7}), std::runtime_error);
+    EXPECT_THROW((PatientSample{1.5, 7}), std::runtime_error);
+}
@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include "patient_store.h"
+#include "string_lookup.h"
+#include "config.h"
+#include "patient_rows.h"
+
+namespace {
+
+/// Patients 1 to 10 in a shuffled order (see make_patient_rows)
+PatientRows make_rows() {
+    return make_patient_rows({7, 3, 9, 1, 5, 2, 8, 4, 6, 10});
+}
+
+void remove_store(const std::string & file_path) {
+    std::remove(file_path.c_str());
+    std::remove(patient_store_index_path(file_path).c_str());
+}
+
+}
+
+/// Every patient can be found by nhs_number (in any order), with all
+/// of its spells and no rows of the next patient
+TEST(PatientStore, FindPatients) {
+    auto lookup{new_string_lookup()};
+    auto config{load_config_file("../../scripts/config.yaml")};
+    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+
+    const std::string store_file{"patient_store_test.rdbp"};
+    {
+	auto rows{make_rows()};
+	EXPECT_EQ(build_patient_store(rows, store_file, 4), 10);
+    }
+
+    PatientStore store{store_file};
+    EXPECT_EQ(store.size(), 10);
+    for (unsigned long long n : {10, 1, 6, 6, 3}) {
+	auto patient{store.find(n, parser)};
+	ASSERT_TRUE(patient.has_value());
+	EXPECT_EQ(patient->nhs_number(), n);
+	ASSERT_EQ(patient->spells().size(), 2);
+	EXPECT_EQ(patient->spells()[0].id(), "s" + std::to_string(n));
+	EXPECT_EQ(patient->spells()[0].episodes().size(), 2);
+	EXPECT_EQ(patient->spells()[1].episodes().size(), 1);
+    }
+    EXPECT_FALSE(store.find(11, parser).has_value());
+    EXPECT_FALSE(store.find(0, parser).has_value());
+    remove_store(store_file);
+}
+
+/// A store without its index (for example, after a build that did not
+/// finish) cannot be opened, and patients whose rows are split cannot
+/// be stored
+TEST(PatientStore, IncompleteStore) {
+    const std::string store_file{"patient_store_incomplete.rdbp"};
+    {
+	auto rows{make_rows()};
+	build_patient_store(rows, store_file);
+    }
+    std::remove(patient_store_index_path(store_file).c_str());
+    EXPECT_THROW(PatientStore{store_file}, ExtractException::BadFile);
+
+    PatientRows split;
+    split.push_row(1, "a", 1000, "I210");
+    split.push_row(2, "b", 2000, "I210");
+    split.push_row(1, "c", 3000, "I210");
+    EXPECT_THROW(build_patient_store(split, store_file), std::runtime_error);
+    remove_store(store_file);
+}
@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <sstream>
+#include "pipeline_stats.h"
+#include "patient.h"
+#include "config.h"
+#include "patient_rows.h"
+
+/// Time in a nested stage is not also charged to the outer stage
+TEST(PipelineStats, NestedStagesExclusive) {
+    StageClock clock;
+    clock.enter(Stage::Assemble);
+    {
+	ScopedStage stage{&clock, Stage::Parse};
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    clock.enter(Stage::Other);
+    EXPECT_GE(clock.time(Stage::Parse).count(), 0.05);
+    EXPECT_LT(clock.time(Stage::Assemble).count(), 0.05);
+    EXPECT_EQ(clock.time(Stage::Fetch).count(), 0);
+}
+
+/// All the rows and patients are counted, and parse counts
+/// separate cache hits, misses and invalid codes
+TEST(PipelineStats, RowsAndParseCounts) {
+    auto lookup{new_string_lookup()};
+    auto config{load_config_file("../../scripts/config.yaml")};
+    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+
+    PatientRows rows;
+    rows.push_row(1, "a", 1000, "I210");
+    rows.push_row(1, "a", 2000, "I210");
+    rows.push_row(2, "b", 3000, "XXXX");
+    rows.push_row(2, "b", 4000, "XXXX");
+
+    PipelineStats stats;
+    parser->set_stage_clock(&stats.clock);
+    TimedRowBuffer timed_rows{rows, stats.clock};
+    for ([[maybe_unused]] auto & patient : patients(timed_rows, parser)) {
+	stats.patients++;
+    }
+    parser->set_stage_clock(nullptr);
+
+    EXPECT_EQ(timed_rows.rows_read(), 4);
+    EXPECT_EQ(stats.patients, 2);
+    // Reading values is not timed unless asked for, and parsing is
+    // timed because the parser has the clock
+    EXPECT_EQ(stats.clock.time(Stage::Convert).count(), 0);
+    EXPECT_GT(stats.clock.time(Stage::Parse).count(), 0);
+    auto counts{parser->parse_counts(CodeType::Diagnosis)};
+    EXPECT_EQ(counts.cache_hits, 1);
+    // Invalid codes are not cached, so both are misses
+    EXPECT_EQ(counts.cache_misses, 3);
+    EXPECT_EQ(counts.invalid, 2);
+
+    std::stringstream json;
+    stats.write_json(json);
+    EXPECT_NE(json.str().find("\"parse\": "), std::string::npos);
+}
+
+/// The stats of runs over separate parts of the rows add up, apart
+/// from the peak memory
+TEST(PipelineStats, Add) {
+    PipelineStats first;
+    first.clock.enter(Stage::Parse);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    first.clock.enter(Stage::Other);
+    first.rows = 10;
+    first.patients = 2;
+    first.diagnoses.cache_hits = 3;
+    first.peak_rss = 100;
+
+    PipelineStats second;
+    second.clock.enter(Stage::Parse);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    second.clock.enter(Stage::Other);
+    second.rows = 5;
+    second.index_records = 1;
+    second.diagnoses.cache_hits = 1;
+    second.diagnoses.invalid = 2;
+    second.peak_rss = 50;
+
+    first.add(second);
+    EXPECT_GE(first.clock.time(Stage::Parse).count(), 0.04);
+    EXPECT_EQ(first.rows, 15);
+    EXPECT_EQ(first.patients, 2);
+    EXPECT_EQ(first.index_records, 1);
+    EXPECT_EQ(first.diagnoses.cache_hits, 4);
+    EXPECT_EQ(first.diagnoses.invalid, 2);
+    EXPECT_EQ(first.peak_rss, 100);
+}
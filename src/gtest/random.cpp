@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+#include <array>
+#include "random.h"
+
+/// Skipping values with discard is the same as drawing them
+TEST(CounterGenerator, Discard) {
+    CounterGenerator a{7, 3};
+    CounterGenerator b{7, 3};
+    for (std::size_t n{0}; n < 1000; n++) {
+	a();
+    }
+    b.discard(1000);
+    EXPECT_EQ(a.position(), b.position());
+    EXPECT_EQ(a(), b());
+}
+
+/// Different seeds and streams give different values, and the same
+/// seed and stream give the same values
+TEST(CounterGenerator, Streams) {
+    CounterGenerator a{1, 0};
+    CounterGenerator b{1, 1};
+    CounterGenerator c{2, 0};
+    CounterGenerator d{1, 0};
+    auto first{a()};
+    EXPECT_NE(first, b());
+    EXPECT_NE(first, c());
+    EXPECT_EQ(first, d());
+}
+
+/// The values do not depend on the platform (these are the first
+/// values of stream 0 of seed 0)
+TEST(CounterGenerator, KnownValues) {
+    CounterGenerator gen;
+    std::array<std::uint64_t, 3> values{gen(), gen(), gen()};
+    EXPECT_EQ(values, (std::array<std::uint64_t, 3>{
+	    0x7ab05cdf9df34f19, 0xfd7653af855b5acf, 0x5470cc2838462fbe}));
+}
+
+/// Every value in the range comes up about equally often
+TEST(Random, UniformBelow) {
+    CounterGenerator gen{11};
+    std::array<std::size_t, 7> counts{};
+    for (std::size_t n{0}; n < 70000; n++) {
+	auto value{uniform_below(gen, counts.size())};
+	ASSERT_LT(value, counts.size());
+	counts[value]++;
+    }
+    for (auto count : counts) {
+	EXPECT_NEAR(count, 10000, 500);
+    }
+}
+
+/// Integers include both ends of the range, and real numbers
+/// include the lower end only
+TEST(Random, Ranges) {
+    Random<int, CounterGenerator> dice{1, 6, Seed<CounterGenerator>{5}};
+    Random<double, CounterGenerator> real{-1.0, 1.0, Seed<CounterGenerator>{5}};
+    std::array<bool, 6> seen{};
+    for (std::size_t n{0}; n < 1000; n++) {
+	auto value{dice()};
+	ASSERT_GE(value, 1);
+	ASSERT_LE(value, 6);
+	seen[value - 1] = true;
+	auto x{real()};
+	ASSERT_GE(x, -1.0);
+	ASSERT_LT(x, 1.0);
+    }
+    EXPECT_EQ(seen, (std::array<bool, 6>{true, true, true, true, true, true}));
+
+    // 32-bit generators are used two values at a time
+    Random<std::size_t, std::mt19937> big{0, std::numeric_limits<std::size_t>::max() - 1,
+					  Seed<std::mt19937>{1}};
+    EXPECT_LT(big(), std::numeric_limits<std::size_t>::max());
+}
@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include <cstdio>
+#include "record_sink.h"
+#include "patient.h"
+#include "string_lookup.h"
+#include "config.h"
+#include "patient_rows.h"
+
+/// Records written through the sink (with a queue small enough to
+/// make push() wait for the writer) convert back to the same YAML
+/// fields, in order
+TEST(RecordSink, RoundTripToYaml) {
+    auto lookup{new_string_lookup()};
+    auto config{load_config_file("../../scripts/config.yaml")};
+    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+
+    PatientRows row;
+    for (unsigned long long n{0}; n < 20; n++) {
+	// Spell ids are unique across patients
+	auto spell_id{"s" + std::to_string(n)};
+	row.push_row(n, spell_id, 100, "I210");
+	row.push_row(n, spell_id, 50, "XXXX");
+    }
+
+    const std::string records_file{"record_sink_test.bin"};
+    {
+	RecordSink sink{records_file, 1};
+	for (const auto & patient : patients(row, parser)) {
+	    const auto & index_spell{patient.spells().front()};
+	    EventCounter event_counter;
+	    event_counter.push_before(ClinicalCodeGroup{"acs_stemi", lookup});
+	    event_counter.push_after(ClinicalCodeGroup{"bleeding", lookup});
+
+	    RecordEncoder record;
+	    record.number(patient.nhs_number());
+	    record.integer(Integer{60});
+	    record.timestamp(index_spell.start_date());
+	    record.flag(true);
+	    record.flag(false);
+	    record.mortality(patient.mortality());
+	    record.spell(index_spell);
+	    record.spells(patient.spells());
+	    record.spells(std::vector<Spell>{});
+	    record.event_counts(event_counter);
+	    sink.push(record.release());
+	}
+	EXPECT_EQ(sink.size(), 20);
+	sink.close(*lookup);
+    }
+
+    std::stringstream yaml;
+    records_to_yaml(records_file, yaml);
+    std::remove(records_file.c_str());
+
+    auto records{YAML::Load(yaml.str())};
+    ASSERT_EQ(records.size(), 20);
+    for (std::size_t n{0}; n < records.size(); n++) {
+	const auto & record{records[n]};
+	EXPECT_EQ(record["nhs_number"].as<std::size_t>(), n);
+	EXPECT_EQ(record["age_at_index"].as<int>(), 60);
+	EXPECT_EQ(record["presentation"].as<std::string>(), "STEMI");
+	EXPECT_EQ(record["inclusion_trigger"].as<std::string>(), "ACS");
+	EXPECT_TRUE(record["mortality"]["alive"].as<bool>());
+	EXPECT_FALSE(record["spells_before"]);
+	ASSERT_EQ(record["spells_after"].size(), 1);
+
+	const auto & episodes{record["index_spell"]["episodes"]};
+	EXPECT_EQ(record["index_spell"]["id"].as<std::string>(), "s" + std::to_string(n));
+	ASSERT_EQ(episodes.size(), 2);
+	EXPECT_EQ(episodes[0]["start_date"]["timestamp"].as<unsigned long long>(), 50);
+	EXPECT_EQ(episodes[0]["primary_diagnosis"]["name"].as<std::string>(), "XXXX");
+	EXPECT_EQ(episodes[0]["primary_diagnosis"]["docs"].as<std::string>(), "Unknown");
+	EXPECT_EQ(episodes[1]["primary_diagnosis"]["name"].as<std::string>(), "I21.0");
+	EXPECT_FALSE(episodes[1]["primary_procedure"]);
+
+	const auto & counts{record["event_counts"]};
+	EXPECT_EQ(counts["before"][0]["name"].as<std::string>(), "acs_stemi");
+	EXPECT_EQ(counts["after"][0]["name"].as<std::string>(), "bleeding");
+	EXPECT_EQ(counts["after"][0]["count"].as<int>(), 1);
+    }
+}
+
+/// A sink destroyed without close() has no string table, and cannot
+/// be converted
+TEST(RecordSink, UnclosedFileRejected) {
+    const std::string records_file{"record_sink_unclosed.bin"};
+    {
+	RecordSink sink{records_file};
+    }
+    std::stringstream yaml;
+    EXPECT_THROW(records_to_yaml(records_file, yaml), std::runtime_error);
+    std::remove(records_file.c_str());
+}
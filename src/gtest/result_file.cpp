@@ -0,0 +1,56 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdio>
+#include "result_file.h"
+
+namespace {
+
+void add_row(ResultTable & table, const std::string & index_type, double age) {
+    table.factor("index_type").push_back(index_type);
+    table.numeric("age").push_back(age);
+}
+
+}
+
+/// A table read back from a result file has the same columns, levels
+/// and values, with NaN still missing
+TEST(ResultFile, RoundTrip) {
+    const std::string file_path{"result_file_test.rdbt"};
+    ResultTable table;
+    add_row(table, "PCI", 40.5);
+    add_row(table, "ACS", std::nan(""));
+    add_row(table, "PCI", 1.0/3.0);
+    write_result_file(file_path, table);
+
+    auto read{read_result_file(file_path)};
+    EXPECT_EQ(read.names(), table.names());
+    ASSERT_EQ(read.num_rows(), 3);
+    EXPECT_EQ(read.factor("index_type").at(0), "PCI");
+    EXPECT_EQ(read.factor("index_type").at(1), "ACS");
+    EXPECT_EQ(read.factor("index_type").codes(), table.factor("index_type").codes());
+    EXPECT_EQ(read.numeric("age")[0], 40.5);
+    EXPECT_TRUE(std::isnan(read.numeric("age")[1]));
+    EXPECT_EQ(read.numeric("age")[2], 1.0/3.0);
+    std::remove(file_path.c_str());
+
+    EXPECT_THROW(read_result_file(file_path), std::runtime_error);
+}
+
+/// Appending a table maps its factor levels onto the levels of
+/// this table, and tables with other columns are rejected
+TEST(ResultFile, AppendTables) {
+    ResultTable first;
+    add_row(first, "PCI", 1);
+    ResultTable second;
+    add_row(second, "ACS", 2);
+    add_row(second, "PCI", 3);
+    first.append(second);
+    ASSERT_EQ(first.num_rows(), 3);
+    EXPECT_EQ(first.factor("index_type").codes(), std::vector<int>({1, 2, 1}));
+    EXPECT_EQ(first.factor("index_type").at(1), "ACS");
+    EXPECT_EQ(first.numeric("age")[2], 3);
+
+    ResultTable other;
+    other.numeric("age");
+    EXPECT_THROW(first.append(other), std::runtime_error);
+}
@@ -0,0 +1,224 @@
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <sstream>
+#include "sql_load.h"
+#include "synthetic_row_buffer.h"
+#include "config.h"
+#include "episode.h"
+#include "episode_row.h"
+#include "sql_query.h"
+
+namespace {
+
+/// An episode row with packed code columns, read in the same way as
+/// SqlRowBuffer reads them (see SqlRowBuffer::unpack_column)
+struct PackedEpisodeRow {
+    EpisodeRowBuffer row;
+    std::map<std::string, Varchar> values;
+    std::vector<PackedColumn> columns;
+
+    template<typename T>
+    T at(const std::string & column_name) const {
+	for (const auto & packed : columns) {
+	    if (packed.matches(column_name)) {
+		return packed.template at<T>(column_name, 0, [&] {
+		    return values.at(packed.column());
+		});
+	    }
+	}
+	return row.template at<T>(column_name);
+    }
+};
+
+/// A row buffer with one row of fixed values
+struct FixedRow {
+    template<typename T>
+    T at(const std::string & column_name) const {
+	if (column_name == "name") {
+	    return std::get<T>(SqlType{Varchar{"O'Brien"}});
+	} else if (column_name == "age") {
+	    return std::get<T>(SqlType{Integer{}});
+	} else {
+	    return std::get<T>(SqlType{Timestamp{}});
+	}
+    }
+};
+
+}
+
+TEST(SqlLoad, CreateTable) {
+    std::vector<ColumnSpec> columns{
+	{"nhs_number", ColumnType::Integer},
+	{"primary_diagnosis", ColumnType::Varchar},
+	{"episode_start", ColumnType::Timestamp},
+    };
+    EXPECT_EQ(make_create_table("hes", columns, 16),
+	      "CREATE TABLE hes (nhs_number BIGINT, primary_diagnosis VARCHAR(16), "
+	      "episode_start TIMESTAMP)");
+}
+
+/// Quotes in strings are doubled, and null values are NULL
+TEST(SqlLoad, Literals) {
+    FixedRow row;
+    std::stringstream ss;
+    write_sql_literal(ss, row, {"name", ColumnType::Varchar});
+    ss << " ";
+    write_sql_literal(ss, row, {"age", ColumnType::Integer});
+    ss << " ";
+    write_sql_literal(ss, row, {"date", ColumnType::Timestamp});
+    EXPECT_EQ(ss.str(), "'O''Brien' NULL NULL");
+}
+
+/// Load synthetic rows into the data source named by RDB_TEST_DSN
+/// (see scripts/utils/sqlite_dsn.sh), and check that the same rows
+/// come back through SqlRowBuffer
+TEST(SqlLoad, RoundTrip) {
+    const char * dsn{std::getenv("RDB_TEST_DSN")};
+    if (dsn == nullptr) {
+	GTEST_SKIP() << "Set RDB_TEST_DSN to run the ODBC round trip";
+    }
+    auto lookup{new_string_lookup()};
+    auto config{load_config_file("../../scripts/config.yaml")};
+    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+    auto synthetic{read_synthetic_config(config)};
+    synthetic.num_patients = 50;
+    synthetic.secondary_diagnosis_columns = 3;
+    synthetic.secondary_procedure_columns = 2;
+    // With one episode in each spell, the order of the rows is fixed
+    synthetic.episodes_per_spell = 1;
+
+    SQLConnection connection{std::string{dsn}};
+    SyntheticRowBuffer rows{synthetic, parser};
+    auto num_rows{load_table(connection, "rdb_test_hes", rows)};
+    EXPECT_EQ(num_rows, rows.current_row_number() + 1);
+
+    SyntheticRowBuffer expected{synthetic, parser};
+    auto row{connection.execute_direct("SELECT * FROM rdb_test_hes "
+				       "ORDER BY nhs_number, spell_id")};
+    std::size_t num_read{0};
+    while (not row.end()) {
+	ASSERT_FALSE(expected.end());
+	for (const auto & column : expected.columns()) {
+	    std::stringstream a, b;
+	    write_sql_literal(a, row, column);
+	    write_sql_literal(b, expected, column);
+	    EXPECT_EQ(a.str(), b.str()) << column.name;
+	}
+	num_read++;
+	row.try_fetch_next_row();
+	expected.try_fetch_next_row();
+    }
+    EXPECT_EQ(num_read, num_rows);
+    connection.execute("DROP TABLE rdb_test_hes");
+}
+
+/// Run a prepared query twice with different parameters, and load a
+/// temp table with parameter arrays, against RDB_TEST_DSN
+TEST(SqlLoad, PreparedQuery) {
+    const char * dsn{std::getenv("RDB_TEST_DSN")};
+    if (dsn == nullptr) {
+	GTEST_SKIP() << "Set RDB_TEST_DSN to run the prepared query test";
+    }
+    SQLConnection connection{std::string{dsn}};
+    connection.load_temp_table("rdb_test_batch", "nhs_number", {"3", "1", "2", "3"}, 2);
+
+    std::string query{"SELECT count(*) AS n FROM rdb_test_batch WHERE nhs_number >= ?"};
+    auto first{connection.execute_prepared(query, {std::string{"2"}})};
+    ASSERT_FALSE(first.end());
+    EXPECT_EQ(first.at<Integer>("n").read(), 2);
+    // The first result must not be read after running the query again
+    auto second{connection.execute_prepared(query, {std::string{"1"}})};
+    ASSERT_FALSE(second.end());
+    EXPECT_EQ(second.at<Integer>("n").read(), 3);
+    connection.execute("DROP TABLE rdb_test_batch");
+}
+
+/// The same episode read from separate code columns and from packed
+/// code columns, where a null code (packed as an empty string) ends
+/// the codes in both cases
+TEST(SqlRowBuffer, PackedColumnsGiveSameEpisode) {
+    auto lookup{new_string_lookup()};
+    auto config{load_config_file("../../scripts/config.yaml")};
+    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+
+    EpisodeRowBuffer columns;
+    columns.set_primary_diagnosis("I210");
+    columns.set_primary_procedure("K432");
+    columns.set_column("secondary_diagnosis_0", Varchar{"I220"});
+    columns.set_column("secondary_diagnosis_1", Varchar{});
+    columns.set_column("secondary_diagnosis_2", Varchar{"I240"});
+    columns.set_column("secondary_procedure_0", Varchar{});
+    columns.set_column("secondary_procedure_1", Varchar{"K111"});
+
+    // The same row as packed by the query, which keeps the position
+    // of each code
+    std::stringstream query;
+    write_code_columns(query, YAML::Load("[a, b, c]"), "secondary_diagnosis_",
+		       "secondary_diagnoses", true);
+    EXPECT_EQ(query.str(), ",concat_ws('|', coalesce(a, ''), coalesce(b, ''), "
+	      "coalesce(c, '')) as secondary_diagnoses\n");
+    PackedEpisodeRow packed;
+    packed.row.set_primary_diagnosis("I210");
+    packed.row.set_primary_procedure("K432");
+    packed.values["secondary_diagnoses"] = Varchar{"I220||I240"};
+    packed.values["secondary_procedures"] = Varchar{"|K111"};
+    packed.columns.emplace_back("secondary_diagnoses", "secondary_diagnosis_", 3, '|');
+    packed.columns.emplace_back("secondary_procedures", "secondary_procedure_", 2, '|');
+
+    auto names = [&](const auto & codes) {
+	std::vector<std::string> result;
+	for (const auto & code : codes) {
+	    result.push_back(code.name(lookup));
+	}
+	return result;
+    };
+    Episode from_columns{columns, parser};
+    Episode from_packed{packed, parser};
+    EXPECT_EQ(from_packed.primary_diagnosis().name(lookup),
+	      from_columns.primary_diagnosis().name(lookup));
+    EXPECT_EQ(from_packed.primary_procedure().name(lookup),
+	      from_columns.primary_procedure().name(lookup));
+    EXPECT_EQ(names(from_columns.secondary_diagnoses()), std::vector<std::string>{"I22.0"});
+    EXPECT_EQ(names(from_packed.secondary_diagnoses()),
+	      names(from_columns.secondary_diagnoses()));
+    EXPECT_TRUE(from_columns.secondary_procedures().empty());
+    EXPECT_EQ(names(from_packed.secondary_procedures()),
+	      names(from_columns.secondary_procedures()));
+}
+
+/// The spell date range selects whole spells by the start date of the
+/// spell (not each episode row by its own start), with the bounds as
+/// parameters
+TEST(SqlQuery, SpellDateRangeSelectsWholeSpells) {
+    std::optional<std::string> condition;
+    std::vector<SqlParameter> parameters;
+    add_spell_date_range(condition, parameters, std::nullopt, std::nullopt);
+    EXPECT_FALSE(condition.has_value());
+    EXPECT_TRUE(parameters.empty());
+
+    auto first{parse_date("2010-1-1")};
+    add_spell_date_range(condition, parameters, first, std::nullopt);
+    ASSERT_TRUE(condition.has_value());
+    EXPECT_EQ(*condition, "spell_id in (select PBRspellID from abi.dbo.vw_apc_sem_001 "
+	      "group by PBRspellID having coalesce(min(AIMTC_ProviderSpell_Start_Date), "
+	      "min(StartDate_ConsultantEpisode)) >= ?)");
+    ASSERT_EQ(parameters.size(), 1);
+    EXPECT_EQ(std::get<Timestamp>(parameters[0]), first);
+
+    auto end{parse_date("2012-1-1")};
+    condition.reset();
+    parameters.clear();
+    add_spell_date_range(condition, parameters, first, end);
+    EXPECT_EQ(parameters, (std::vector<SqlParameter>{first, end}));
+}
+
+/// A timestamp parameter is bound as the local date and time
+TEST(SqlQuery, TimestampParameter) {
+    auto datetime{to_sql_timestamp(parse_date("2015-6-3") + 3661)};
+    EXPECT_EQ(datetime.year, 2015);
+    EXPECT_EQ(datetime.month, 6);
+    EXPECT_EQ(datetime.day, 3);
+    EXPECT_EQ(datetime.hour, 1);
+    EXPECT_EQ(datetime.minute, 1);
+    EXPECT_EQ(datetime.second, 1);
+}
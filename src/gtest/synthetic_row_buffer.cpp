@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+#include "synthetic_row_buffer.h"
+#include "patient.h"
+#include "config.h"
+
+namespace {
+
+SyntheticConfig small_config() {
+    auto config{load_config_file("../../scripts/config.yaml")};
+    auto synthetic{read_synthetic_config(config)};
+    synthetic.seed = 3;
+    synthetic.num_patients = 200;
+    synthetic.death_probability = 0.5;
+    return synthetic;
+}
+
+}
+
+/// The rows can be read as patients, in order of nhs_number, and
+/// the deaths are after the patient's last episode
+TEST(SyntheticRowBuffer, ReadsAsPatients) {
+    auto lookup{new_string_lookup()};
+    auto config{load_config_file("../../scripts/config.yaml")};
+    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+    auto synthetic{small_config()};
+    SyntheticRowBuffer row{synthetic, parser};
+
+    EXPECT_EQ(row.columns().size(), 12 + synthetic.secondary_diagnosis_columns
+	      + synthetic.secondary_procedure_columns);
+
+    std::size_t num_patients{0};
+    std::size_t num_deaths{0};
+    unsigned long long last_nhs_number{0};
+    for (auto & patient : patients(row, parser)) {
+	EXPECT_GT(patient.nhs_number(), last_nhs_number);
+	last_nhs_number = patient.nhs_number();
+	num_patients++;
+	ASSERT_FALSE(patient.spells().empty());
+	if (not patient.mortality().alive()) {
+	    num_deaths++;
+	    auto last_end{patient.spells().back().end_date()};
+	    EXPECT_GT(patient.mortality().date_of_death(), last_end);
+	}
+    }
+    EXPECT_EQ(num_patients, synthetic.num_patients);
+    EXPECT_GT(num_deaths, 0);
+    EXPECT_LT(num_deaths, num_patients);
+}
+
+/// The same seed makes the same rows
+TEST(SyntheticRowBuffer, Repeatable) {
+    auto lookup{new_string_lookup()};
+    auto config{load_config_file("../../scripts/config.yaml")};
+    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+    SyntheticRowBuffer a{small_config(), parser};
+    SyntheticRowBuffer b{small_config(), parser};
+    while (not a.end()) {
+	ASSERT_FALSE(b.end());
+	EXPECT_EQ(a.at<Integer>("nhs_number").read(), b.at<Integer>("nhs_number").read());
+	EXPECT_EQ(a.at<Varchar>("primary_diagnosis").read(),
+		  b.at<Varchar>("primary_diagnosis").read());
+	EXPECT_EQ(a.at<Timestamp>("episode_start"), b.at<Timestamp>("episode_start"));
+	a.try_fetch_next_row();
+	b.try_fetch_next_row();
+    }
+    EXPECT_TRUE(b.end());
+    EXPECT_THROW(a.at<Integer>("spell_id"), RowBufferException::WrongColumnType);
+}
+
+/// The rows do not depend on the time zone of the machine
+TEST(SyntheticRowBuffer, SameInEveryTimeZone) {
+    auto lookup{new_string_lookup()};
+    auto config{load_config_file("../../scripts/config.yaml")};
+    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+    auto episode_starts{[&](const char * time_zone) {
+	const char * old_time_zone{std::getenv("TZ")};
+	std::string saved{old_time_zone ? old_time_zone : ""};
+	setenv("TZ", time_zone, 1);
+	tzset();
+	std::vector<unsigned long long> starts;
+	for (SyntheticRowBuffer row{small_config(), parser}; not row.end();
+	     row.try_fetch_next_row()) {
+	    starts.push_back(row.at<Timestamp>("episode_start").read());
+	}
+	if (old_time_zone) {
+	    setenv("TZ", saved.c_str(), 1);
+	} else {
+	    unsetenv("TZ");
+	}
+	tzset();
+	return starts;
+    }};
+    auto utc{episode_starts("UTC")};
+    ASSERT_FALSE(utc.empty());
+    EXPECT_EQ(utc, episode_starts("EST5EDT"));
+}
+
+/// A range of the patients made on its own has the same rows as
+/// in the full set
+TEST(SyntheticRowBuffer, PatientsAreIndependent) {
+    auto lookup{new_string_lookup()};
+    auto config{load_config_file("../../scripts/config.yaml")};
+    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+    SyntheticRowBuffer all{small_config(), parser};
+    auto part_config{small_config()};
+    part_config.first_patient = 150;
+    part_config.num_patients = 20;
+    SyntheticRowBuffer part{part_config, parser};
+    while (all.at<Integer>("nhs_number").read() != part.at<Integer>("nhs_number").read()) {
+	all.fetch_next_row();
+    }
+    std::size_t num_rows{0};
+    while (not part.end()) {
+	for (const auto & column : part.columns()) {
+	    if (column.type == ColumnType::Varchar) {
+		auto a{all.at<Varchar>(column.name)};
+		auto b{part.at<Varchar>(column.name)};
+		ASSERT_EQ(a.null(), b.null()) << column.name;
+		if (not a.null()) {
+		    EXPECT_EQ(a.read(), b.read()) << column.name;
+		}
+	    }
+	}
+	EXPECT_EQ(all.at<Timestamp>("episode_start"), part.at<Timestamp>("episode_start"));
+	all.fetch_next_row();
+	part.try_fetch_next_row();
+	num_rows++;
+    }
+    EXPECT_GE(num_rows, 20);
+    EXPECT_EQ(all.at<Integer>("nhs_number").read(), small_config().first_nhs_number + 170);
+}
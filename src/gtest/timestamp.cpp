@@ -34,3 +34,30 @@ TEST(Timestamp, LargeOffsetForwards) {
     auto x{t + 365*24*60*60}; // 1 year
     EXPECT_EQ(x.read(), 1632009600);
 }
+
+TEST(Timestamp, ParseDate) {
+    auto date{parse_date("2015-1-1")};
+    EXPECT_EQ(date, parse_date("2015-01-01"));
+    EXPECT_EQ(parse_date("2015-1-2") - date, days(1));
+    EXPECT_THROW(parse_date("2015/1/1"), std::runtime_error);
+    EXPECT_THROW(parse_date("2015-13-1"), std::runtime_error);
+    EXPECT_THROW(parse_date("2015-13-01"), std::runtime_error);
+    EXPECT_THROW(parse_date("2015-0-1"), std::runtime_error);
+    EXPECT_THROW(parse_date("2015--1-1"), std::runtime_error);
+    EXPECT_THROW(parse_date("2015-1-0"), std::runtime_error);
+    EXPECT_THROW(parse_date("2015-4-31"), std::runtime_error);
+    EXPECT_THROW(parse_date("2015-2-29"), std::runtime_error);
+    EXPECT_EQ(parse_date("2016-3-1") - parse_date("2016-2-29"), days(1));
+    EXPECT_EQ(parse_date("2015-12-31") - parse_date("2015-12-30"), days(1));
+    EXPECT_THROW(parse_date("2015-1-1 extra"), std::runtime_error);
+}
+
+/// local_time is the inverse of the conversion in the Timestamp
+/// constructor
+TEST(Timestamp, LocalTime) {
+    auto tm{local_time(static_cast<std::time_t>(parse_date("2015-6-3").read()))};
+    EXPECT_EQ(tm.tm_year, 115);
+    EXPECT_EQ(tm.tm_mon, 5);
+    EXPECT_EQ(tm.tm_mday, 3);
+    EXPECT_EQ(tm.tm_hour, 0);
+}
@@ -0,0 +1,40 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include <thread>
+#include "trace.h"
+
+/// Spans from each thread are written with their own thread id
+TEST(Trace, SpansFromTwoThreads) {
+    if constexpr (not tracing_enabled) {
+	GTEST_SKIP() << "Tracing is compiled out (build with WITH_TRACE)";
+    }
+    clear_trace();
+    {
+	RDB_TRACE_SPAN("main_span");
+	std::thread worker{[] {
+	    RDB_TRACE_SPAN("worker_span");
+	}};
+	worker.join();
+    }
+    std::stringstream trace;
+    write_chrome_trace(trace);
+    auto json{trace.str()};
+    auto main_span{json.find("\"main_span\"")};
+    auto worker_span{json.find("\"worker_span\"")};
+    ASSERT_NE(main_span, std::string::npos);
+    ASSERT_NE(worker_span, std::string::npos);
+    auto tid = [&](std::size_t from) {
+	auto start{json.find("\"tid\": ", from) + 7};
+	return json.substr(start, json.find(',', start) - start);
+    };
+    EXPECT_NE(tid(main_span), tid(worker_span));
+}
+
+/// Without tracing, the trace is empty but still valid
+TEST(Trace, EmptyWhenCleared) {
+    clear_trace();
+    std::stringstream trace;
+    write_chrome_trace(trace);
+    EXPECT_EQ(trace.str().find("\"ph\""), std::string::npos);
+    EXPECT_NE(trace.str().find("traceEvents"), std::string::npos);
+}
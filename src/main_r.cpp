@@ -1,3 +1,4 @@
+#include <Rcpp.h>
 
 #include "string_lookup.h"
 #include "config.h"
@@ -6,515 +7,623 @@
 #include "sql_connection.h"
 #include "patient.h"
 
-#include "acs.h"
-#include "r_factor.h"
+#include "acs_dataset.h"
+#include "result_table.h"
+#include "checkpoint.h"
+#include "pipeline_stats.h"
+#include "trace.h"
+#include "record_sink.h"
+#include "extract.h"
+#include "synthetic_row_buffer.h"
+#include "altrep.h"
+#include "arrow_export.h"
+#include "patient_store.h"
+#include "patient_sample.h"
 #include <fstream>
+#include <chrono>
+#include <filesystem>
+#include <set>
+#include <limits>
+#include <cmath>
 
 #include <optional>
 
-/// Writes a timestamp object to a YAML stream. Includes the unix timestamp
-/// with the "timestamp" key, and a human-readable string with the "readable"
-/// key. Does not modify the stream if the Timestamp is NULL
-YAML::Emitter & operator<<(YAML::Emitter & ys, const Timestamp & timestamp) {
-    if (not timestamp.null()) {
-	ys << YAML::BeginMap
-	   << YAML::Key << "timestamp"
-	   << YAML::Value << timestamp.read();
-	std::stringstream ss;
-	ss << timestamp;
-	ys << YAML::Key << "readable"
-	   << YAML::Value << ss.str()
-	   << YAML::EndMap;
+// [[Rcpp::export]]
+void print_sql_query(const Rcpp::CharacterVector & config_path) {
+    std::string config_path_str{Rcpp::as<std::string>(config_path)};
+    try {
+	auto config{load_config_file(config_path_str)};
+	auto sql_query{make_acs_sql_query(config["sql_query"], true, false)};
+	Rcpp::Rcout << sql_query << std::endl;
+    } catch (const std::runtime_error & e) {
+	Rcpp::Rcout << "Failed with error: " << e.what() << std::endl;
     }
-    return ys;
 }
 
-/// Writes an Integer to an YAML stream. If the integer is null, no operation is
-/// performed on the stream
-YAML::Emitter & operator<<(YAML::Emitter & ys, const Integer & value) {
-    if (not value.null()) {
-	ys << value.read();
+/// Convert the binary records file saved by make_acs_dataset (when
+/// save_records is true) into a YAML file
+// [[Rcpp::export]]
+void convert_records(const Rcpp::CharacterVector & records_file,
+		     const Rcpp::CharacterVector & yaml_file) {
+    try {
+	std::ofstream yaml{Rcpp::as<std::string>(yaml_file)};
+	records_to_yaml(Rcpp::as<std::string>(records_file), yaml);
+    } catch (const std::runtime_error & e) {
+	Rcpp::Rcout << "Failed with error: " << e.what() << std::endl;
     }
-    return ys;
 }
 
-void write_event_count(YAML::Emitter & ys,
-		       const std::map<ClinicalCodeGroup, std::size_t> & counts,
-		       std::shared_ptr<StringLookup> lookup) {
-    ys << YAML::BeginSeq;
-    for (const auto & [group, count] : counts) {
-	ys << YAML::BeginMap
-	   << YAML::Key << "name"
-	   << YAML::Value << group.name(lookup)
-	   << YAML::Key << "count"
-	   << YAML::Value << count
-	   << YAML::EndMap;
+/// The rows read by make_acs_dataset, either straight from the database,
+/// from the database while saving a local extract, from the extract, or
+/// made up by the synthetic row buffer
+using AcsRowBuffer = VariantRowBuffer<SqlRowBuffer,
+				      ExtractingRowBuffer<SqlRowBuffer>,
+				      ExtractRowBuffer,
+				      SyntheticRowBuffer>;
+
+/// Run the query, or open the local extract, depending on the mode in
+/// the (optional) extract block of the config file: "none" (the default)
+/// reads from the database, "write" reads from the database and saves
+/// the rows to the extract file, and "read" uses only the extract file.
+/// If the synthetic block has enabled: true, the rows are made up
+/// instead (see synthetic_row_buffer.h), and the database is not used.
+/// The parameters are the values of the ? markers in the query. If
+/// only_patients is given, only the row groups of the extract that may
+/// hold those patients are read (the rows of other patients may still
+/// be returned).
+AcsRowBuffer open_acs_rows(const YAML::Node & config, const std::string & sql_query,
+			   std::shared_ptr<ClinicalCodeParser> parser,
+			   const std::vector<SqlParameter> & parameters = {},
+			   const std::set<std::uint64_t> * only_patients = nullptr) {
+    if (config["synthetic"] and config["synthetic"]["enabled"]
+	and config["synthetic"]["enabled"].as<bool>()) {
+	auto synthetic{read_synthetic_config(config)};
+	Rcpp::Rcout << "Making rows for " << synthetic.num_patients
+		    << " synthetic patients" << std::endl;
+	return SyntheticRowBuffer{synthetic, parser};
     }
-    ys << YAML::EndSeq;
-}
 
-/// Write a ClinicalCode to a YAML stream. Not a normal operator << because of
-/// the need for the lookup. If the code is null, then nothing is printed to
-/// the stream. Otherwise, a "name" and "docs" field is added for the code. In
-/// addition, if the code is present in any groups, these are included in an
-/// optional groups field. If the code is invalid, the docs field contains the
-/// string "Unknown".
-///
-void write_yaml_stream(YAML::Emitter & ys, const EventCounter & event_counter,
-		       std::shared_ptr<StringLookup> lookup) {
-    ys << YAML::BeginMap;
-    if (not event_counter.counts_before().empty()) {
-	ys << YAML::Key << "before"
-	   << YAML::Value;
-	write_event_count(ys, event_counter.counts_before(), lookup);
-     }
-    
-    if (not event_counter.counts_after().empty()) {
-	ys << YAML::Key << "after"
-	   << YAML::Value;
-	write_event_count(ys, event_counter.counts_after(), lookup);
+    std::string mode{"none"};
+    std::string file_path{"gendata/extract.rdbx"};
+    if (config["extract"]) {
+	if (config["extract"]["mode"]) {
+	    mode = config["extract"]["mode"].as<std::string>();
+	}
+	if (config["extract"]["file"]) {
+	    file_path = config["extract"]["file"].as<std::string>();
+	}
+    }
+    if (mode == "read") {
+	Rcpp::Rcout << "Reading rows from extract " << file_path << std::endl;
+	if (only_patients) {
+	    return ExtractRowBuffer{file_path, *only_patients};
+	}
+	return ExtractRowBuffer{file_path};
+    } else if (mode != "none" and mode != "write") {
+	throw std::runtime_error("Unknown extract mode '" + mode
+				 + "' (expected none, write or read)");
+    }
+
+    auto sql_connection{new_sql_connection(config["connection"])};
+    Rcpp::Rcout << "Executing query" << std::endl;
+    auto row{sql_connection.execute_prepared(sql_query, parameters)};
+    unpack_code_columns(row, config["sql_query"]);
+    if (mode == "write") {
+	Rcpp::Rcout << "Saving rows to extract " << file_path << std::endl;
+	return ExtractingRowBuffer<SqlRowBuffer>{std::move(row), file_path};
     }
-    ys << YAML::EndMap;
+    return row;
 }
 
-/// Write a ClinicalCode to a YAML stream. Not a normal operator << because of
-/// the need for the lookup. If the code is null, then nothing is printed to
-/// the stream. Otherwise, a "name" and "docs" field is added for the code. In
-/// addition, if the code is present in any groups, these are included in an
-/// optional groups field. If the code is invalid, the docs field contains the
-/// string "Unknown".
-///
-void write_yaml_stream(YAML::Emitter & ys, const ClinicalCode & code,
-		       std::shared_ptr<StringLookup> lookup) {
-    if (not code.null()) {
-	ys << YAML::BeginMap;
-	ys << YAML::Key << "name"
-	   << YAML::Value << code.name(lookup);
-	ys << YAML::Key << "docs";
-        if (code.valid()) {
-	    ys << YAML::Value << code.docs(lookup);
-	} else {
-	    ys << YAML::Value << "Unknown";
+/// Bring the local extract up to date with the database. Patients with an
+/// episode starting or a spell ending after the last one in the extract, or
+/// a death after the last one in the extract, are fetched again in full and
+/// replace their rows in the extract (refresh_overlap_days in the extract
+/// block moves both watermarks back, to catch late records). Returns the
+/// nhs_numbers of the patients that were fetched, whose rows in the dataset
+/// must be remade. Failures are raised as R errors.
+// [[Rcpp::export]]
+Rcpp::NumericVector refresh_extract(const Rcpp::CharacterVector & config_path) {
+
+    std::string config_path_str{Rcpp::as<std::string>(config_path)};
+
+    try {
+	auto config{load_config_file(config_path_str)};
+	auto file_path{config["extract"]["file"].as<std::string>()};
+	long long overlap{0};
+	if (config["extract"]["refresh_overlap_days"]) {
+	    overlap = days(config["extract"]["refresh_overlap_days"].as<long long>()).value();
 	}
-	auto code_groups{code.groups()};
-	if (not code_groups.empty()) {
-	    ys << YAML::Key << "groups"
-	       << YAML::Value
-	       << YAML::BeginSeq;
-	    for (const auto & group : code_groups) {
-		ys << group.name(lookup);	
+	auto watermark{[&](std::uint64_t max) {
+	    return Timestamp{max > static_cast<std::uint64_t>(overlap) ? max - overlap : 0};
+	}};
+
+	Timestamp episode_watermark, death_watermark;
+	{
+	    ExtractRowBuffer extract{file_path};
+	    auto episode_max{std::max(extract.column_max("episode_start"),
+				      extract.column_max("spell_end"))};
+	    auto death_max{extract.column_max("date_of_death")};
+	    if (death_max == 0) {
+		// No deaths yet, so only look for deaths in the same period
+		death_max = episode_max;
 	    }
-	    ys << YAML::EndSeq;
+	    episode_watermark = watermark(episode_max);
+	    death_watermark = watermark(death_max);
 	}
-	ys << YAML::EndMap;
+	Rcpp::Rcout << "Fetching patients with episodes after " << episode_watermark
+		    << " or deaths after " << death_watermark << std::endl;
+
+	const std::string update_path{file_path + ".update"};
+	{
+	    auto sql_connection{new_sql_connection(config["connection"])};
+	    std::vector<SqlParameter> parameters;
+	    auto sql_query{make_acs_refresh_sql_query(config["sql_query"], episode_watermark,
+						      death_watermark, parameters)};
+	    auto row{sql_connection.execute_prepared(sql_query, parameters)};
+	    unpack_code_columns(row, config["sql_query"]);
+	    ExtractWriter update{update_path, row.columns()};
+	    auto num_rows{copy_rows(row, update)};
+	    update.close();
+	    Rcpp::Rcout << "Fetched " << num_rows << " rows" << std::endl;
+	}
+
+	auto updated{merge_extract(file_path, update_path)};
+	std::filesystem::remove(update_path);
+	Rcpp::Rcout << "Updated " << updated.size() << " patients in " << file_path << std::endl;
+	return Rcpp::NumericVector(updated.begin(), updated.end());
+
+    } catch (const std::runtime_error & e) {
+	// An empty result would look the same as no changed patients
+	Rcpp::stop(std::string{"Failed to refresh the extract: "} + e.what());
     }
 }
 
-/// Write the mortality data to a YAML map. Contains the compulsory key "alive",
-/// which is true unless there is mortality data. If there is mortality data,
-/// it consists of the keys "date_of_death" (a timestamp) and "cause_of_death"
-/// (a clinical code).
-void write_yaml_stream(YAML::Emitter & ys, const Mortality & mortality,
-		       std::shared_ptr<StringLookup> lookup) {
-
-    ys << YAML::BeginMap;
-    ys << YAML::Key << "alive"
-       << YAML::Value << mortality.alive();
-
-    if (not mortality.alive()) {
-	if (not mortality.date_of_death().null()) {
-	    ys << YAML::Key << "date_of_death"
-	       << YAML::Value << mortality.date_of_death();
-	}
-	if (mortality.cause_of_death().has_value()) {
-	    ys << YAML::Key << "cause_of_death";
-	    ys << YAML::Value;
-	    write_yaml_stream(ys, mortality.cause_of_death().value(), lookup);
-	}
-	if (not mortality.age_at_death().null()) {
-	    ys << YAML::Key << "age_at_death";
-	    ys << YAML::Value << mortality.age_at_death();
+/// Convert the columns made by make_acs_dataset to an R list of vectors
+/// (factor columns become R factors, and NaN becomes NA). The columns
+/// are moved into ALTREP vectors (see altrep.h), so they are not copied
+/// unless R writes to them.
+Rcpp::List to_r_list(ResultTable && table) {
+    const auto & names{table.names()};
+    Rcpp::List table_r(names.size());
+    for (std::size_t n{0}; n < names.size(); n++) {
+	auto column{table.take(names[n])};
+	if (auto * numeric = std::get_if<NumericColumn>(&column)) {
+	    for (auto & value : *numeric) {
+		if (std::isnan(value)) {
+		    value = NA_REAL;
+		}
+	    }
+	    table_r[n] = make_altrep_numeric(std::move(*numeric));
+	} else {
+	    table_r[n] = make_altrep_factor(std::get<FactorColumn>(std::move(column)));
 	}
     }
-    ys << YAML::EndMap;
+    table_r.attr("names") = Rcpp::CharacterVector(names.begin(), names.end());
+    return table_r;
 }
 
-/// Write an episode to a yaml stream.
-void write_yaml_stream(YAML::Emitter & ys, const Episode & episode,
-		       std::shared_ptr<StringLookup> lookup) {
-
-    ys << YAML::BeginMap
-       << YAML::Key << "start_date"
-       << YAML::Value << episode.episode_start()
-       << YAML::Key << "end_date"
-       << YAML::Value << episode.episode_end();
-    
-    if (not episode.primary_diagnosis().null()) {
-	ys << YAML::Key << "primary_diagnosis"
-	   << YAML::Value;
-	write_yaml_stream(ys, episode.primary_diagnosis(), lookup);
+/// Convert the stage times (in seconds) and counters to an R list
+/// of two named numeric vectors
+Rcpp::List to_r_list(const PipelineStats & stats) {
+    constexpr auto num_stages{static_cast<std::size_t>(Stage::Count)};
+    Rcpp::NumericVector stage_seconds(num_stages);
+    Rcpp::CharacterVector stage_names(num_stages);
+    for (std::size_t n{0}; n < num_stages; n++) {
+	stage_seconds[n] = stats.clock.time(static_cast<Stage>(n)).count();
+	stage_names[n] = stage_name(static_cast<Stage>(n));
     }
+    stage_seconds.attr("names") = stage_names;
+
+    auto counters{stats.counters()};
+    Rcpp::NumericVector counter_values(counters.size());
+    Rcpp::CharacterVector counter_names(counters.size());
+    for (std::size_t n{0}; n < counters.size(); n++) {
+	counter_names[n] = counters[n].first;
+	counter_values[n] = counters[n].second;
+    }
+    counter_values.attr("names") = counter_names;
 
-    
-    if (not episode.primary_procedure().null()) {    
-	ys << YAML::Key << "primary_procedure"
-	   << YAML::Value;
-	write_yaml_stream(ys, episode.primary_procedure(), lookup);
+    Rcpp::List stats_r;
+    stats_r["stage_seconds"] = stage_seconds;
+    stats_r["counters"] = counter_values;
+    return stats_r;
+}
+
+/// Add one row per episode of the patient to the table (see
+/// get_patient_spells), in order of spell start date, and print the
+/// patient if print is true
+void add_patient_spells(ResultTable & table, const Patient & patient,
+			std::shared_ptr<StringLookup> lookup, bool print) {
+    auto code_name = [&](const ClinicalCode & code) {
+	return code.valid() or code.invalid() ? code.name(lookup) : std::string{};
+    };
+    auto seconds = [](const Timestamp & timestamp) {
+	return timestamp.null() ? std::numeric_limits<double>::quiet_NaN()
+	    : static_cast<double>(timestamp.read());
+    };
+
+    std::vector<const Spell *> spells;
+    for (const auto & spell : patient.spells()) {
+	spells.push_back(&spell);
     }
-	
-    if (episode.secondary_diagnoses().size() > 0) {
-	ys << YAML::Key << "secondary_diagnoses"
-	   << YAML::Value
-	   << YAML::BeginSeq;
-	for (const auto & diagnosis : episode.secondary_diagnoses()) {
-	    write_yaml_stream(ys, diagnosis, lookup);
-	}
-	ys << YAML::EndSeq;
+    std::ranges::sort(spells, {}, [](const auto * spell) { return spell->start_date(); });
+    if (print) {
+	Rcpp::Rcout << "Patient " << patient.nhs_number() << std::endl;
+	patient.mortality().print(Rcpp::Rcout, lookup);
     }
-
-    if (episode.secondary_procedures().size() > 0) {
-	ys << YAML::Key << "secondary_procedures"
-	   << YAML::Value
-	   << YAML::BeginSeq;
-	for (const auto & diagnosis : episode.secondary_procedures()) {
-	    write_yaml_stream(ys, diagnosis, lookup);
+    for (const auto * spell : spells) {
+	if (print) {
+	    spell->print(Rcpp::Rcout, lookup);
+	}
+	for (const auto & episode : spell->episodes()) {
+	    table.numeric("nhs_number").push_back(static_cast<double>(patient.nhs_number()));
+	    table.factor("spell_id").push_back(spell->id());
+	    table.numeric("spell_start").push_back(seconds(spell->start_date()));
+	    table.numeric("spell_end").push_back(seconds(spell->end_date()));
+	    table.numeric("episode_start").push_back(seconds(episode.episode_start()));
+	    table.numeric("episode_end").push_back(seconds(episode.episode_end()));
+	    table.factor("primary_diagnosis").push_back(code_name(episode.primary_diagnosis()));
+	    table.factor("primary_procedure").push_back(code_name(episode.primary_procedure()));
 	}
-	ys << YAML::EndSeq;
     }
-    ys << YAML::EndMap;
 }
 
-/// Write a spell to a yaml stream.
-void write_yaml_stream(YAML::Emitter & ys, const Spell & spell,
-		       std::shared_ptr<StringLookup> lookup) {
-    ys << YAML::BeginMap
-       << YAML::Key << "id"
-       << YAML::Value << spell.id()
-       << YAML::Key << "start_date"
-       << YAML::Value << spell.start_date()
-       << YAML::Key << "end_date"
-       << YAML::Value << spell.end_date();
-
-    if (spell.episodes().size() > 0) {
-	ys << YAML::Key << "episodes"
-	   << YAML::Value
-	   << YAML::BeginSeq;
-	for (const auto & episode : spell.episodes()) {
-	    write_yaml_stream(ys, episode, lookup);
+/// Read patients from the local patient store (see patient_store.h),
+/// which is rebuilt from the extract first if it is missing or older
+/// than the extract. The store is at the store path of the extract
+/// block of the config file. Returns one row per episode, in order of
+/// spell start date. Null codes are empty strings. If print is true,
+/// the patients are also printed (like the spells program).
+// [[Rcpp::export]]
+Rcpp::List get_patient_spells(const Rcpp::CharacterVector & config_path,
+			      const Rcpp::NumericVector & nhs_numbers, bool print = false) {
+    auto lookup{new_string_lookup()};
+    auto config{load_config_file(Rcpp::as<std::string>(config_path))};
+    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+
+    std::string extract_path{"gendata/extract.rdbx"};
+    std::string store_path{"gendata/patients.rdbp"};
+    if (config["extract"] and config["extract"]["file"]) {
+	extract_path = config["extract"]["file"].as<std::string>();
+    }
+    if (config["extract"] and config["extract"]["store"]) {
+	store_path = config["extract"]["store"].as<std::string>();
+    }
+    auto store{open_patient_store(store_path, extract_path, Rcpp::Rcout)};
+
+    ResultTable table;
+    for (auto nhs_number : nhs_numbers) {
+	auto patient{store.find(static_cast<std::uint64_t>(nhs_number), parser)};
+	if (not patient) {
+	    Rcpp::Rcout << "Patient " << static_cast<std::uint64_t>(nhs_number)
+			<< " is not in the store" << std::endl;
+	    continue;
 	}
-	ys << YAML::EndSeq;
+	add_patient_spells(table, *patient, lookup, print);
     }
-    ys << YAML::EndMap;
+    return to_r_list(std::move(table));
 }
 
+/// Fetch patients from the database, with the same result as
+/// get_patient_spells (in nhs_number order). The NHS numbers are
+/// loaded into a session temp table with parameter-array inserts,
+/// and all the patients come back from one query.
 // [[Rcpp::export]]
-void print_sql_query(const Rcpp::CharacterVector & config_path) {
-    std::string config_path_str{Rcpp::as<std::string>(config_path)};
-    try {
-	auto config{load_config_file(config_path_str)};
-	auto sql_query{make_acs_sql_query(config["sql_query"], true, std::nullopt)};
-	Rcpp::Rcout << sql_query << std::endl;
-    } catch (const std::runtime_error & e) {
-	Rcpp::Rcout << "Failed with error: " << e.what() << std::endl;
+Rcpp::List query_patient_spells(const Rcpp::CharacterVector & config_path,
+				const Rcpp::NumericVector & nhs_numbers, bool print = false) {
+    auto lookup{new_string_lookup()};
+    auto config{load_config_file(Rcpp::as<std::string>(config_path))};
+    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+
+    std::vector<std::string> batch;
+    for (auto nhs_number : nhs_numbers) {
+	batch.push_back(std::to_string(static_cast<std::uint64_t>(nhs_number)));
+    }
+    auto sql_connection{new_sql_connection(config["connection"])};
+    sql_connection.load_temp_table(patient_batch_table, "nhs_number", batch);
+    auto row{sql_connection.execute_direct(make_acs_batch_sql_query(config["sql_query"], true))};
+    unpack_code_columns(row, config["sql_query"]);
+
+    ResultTable table;
+    std::size_t num_patients{0};
+    for (auto & patient : patients(row, parser)) {
+	add_patient_spells(table, patient, lookup, print);
+	num_patients++;
+	Rcpp::checkUserInterrupt();
+    }
+    Rcpp::Rcout << "Found " << num_patients << " of " << batch.size() << " patients" << std::endl;
+    return to_r_list(std::move(table));
+}
+
+/// The Arrow structs to export a table into, passed from R as external
+/// pointers to released (empty) structs, for example from
+/// nanoarrow::nanoarrow_allocate_schema() and nanoarrow_allocate_array().
+/// Returns null pointers if both are NULL.
+std::pair<ArrowSchema *, ArrowArray *> arrow_pointers(SEXP arrow_schema, SEXP arrow_array) {
+    if (Rf_isNull(arrow_schema) and Rf_isNull(arrow_array)) {
+	return {nullptr, nullptr};
+    }
+    if (TYPEOF(arrow_schema) != EXTPTRSXP or TYPEOF(arrow_array) != EXTPTRSXP) {
+	throw std::runtime_error("arrow_schema and arrow_array must both be external pointers");
     }
+    auto * schema{static_cast<ArrowSchema *>(R_ExternalPtrAddr(arrow_schema))};
+    auto * array{static_cast<ArrowArray *>(R_ExternalPtrAddr(arrow_array))};
+    if (not schema or not array or schema->release or array->release) {
+	throw std::runtime_error("arrow_schema and arrow_array must point to released structs");
+    }
+    return {schema, array};
 }
 
+/// Make the ACS dataset. If only_nhs_numbers is given, the records are
+/// made only for those patients (this is used to remake the records of
+/// the patients changed by refresh_extract). If arrow_schema and
+/// arrow_array are given (see arrow_pointers()), the table is moved into
+/// them (see arrow_export.h) and the list returned is empty, apart from
+/// the stats attribute.
 // [[Rcpp::export]]
-Rcpp::List make_acs_dataset(const Rcpp::CharacterVector & config_path) {
+Rcpp::List make_acs_dataset(const Rcpp::CharacterVector & config_path,
+			    Rcpp::Nullable<Rcpp::NumericVector> only_nhs_numbers = R_NilValue,
+			    SEXP arrow_schema = R_NilValue, SEXP arrow_array = R_NilValue) {
 
     std::string config_path_str{Rcpp::as<std::string>(config_path)};
     
     try {	
+	// Checked before the query, so that a mistake does not waste a run
+	auto [schema, array] = arrow_pointers(arrow_schema, arrow_array);
+
 	auto lookup{new_string_lookup()};
 	auto config{load_config_file(config_path_str)};
 	auto parser{new_clinical_code_parser(config["parser"], lookup)};
-	auto sql_connection{new_sql_connection(config["connection"])};
-	auto nhs_number_filter{std::nullopt};
-	auto with_mortality{true};
-	auto sql_query{make_acs_sql_query(config["sql_query"], with_mortality, nhs_number_filter)};
-
-	ClinicalCodeMetagroup acs_metagroup{config["code_groups"]["acs"], lookup};
-	ClinicalCodeMetagroup pci_metagroup{config["code_groups"]["pci"], lookup};
-	ClinicalCodeMetagroup cardiac_death_metagroup{config["code_groups"]["cardiac_death"], lookup};
-	ClinicalCodeMetagroup stemi_metagroup{config["code_groups"]["stemi"], lookup};
-
-	Rcpp::Rcout << "Executing query" << std::endl;
-        auto row{sql_connection.execute_direct(sql_query)};
 
         auto save_records{config["save_records"].as<bool>()};
 
-	Rcpp::Rcout << "Started fetching rows" << std::endl;
+	// Only the row groups of the extract that may hold these patients
+	// are read. The other patients in those row groups are dropped
+	// below, so their secondary codes are never parsed (lazy_decode).
+	std::optional<std::set<std::uint64_t>> patient_filter;
+	if (only_nhs_numbers.isNotNull()) {
+	    patient_filter.emplace();
+	    for (const auto nhs_number : Rcpp::NumericVector(only_nhs_numbers.get())) {
+		patient_filter->insert(static_cast<std::uint64_t>(nhs_number));
+	    }
+	    config["lazy_decode"] = true;
+	}
 
-	std::map<std::string, Rcpp::NumericVector> event_counts;
-	RFactor nhs_numbers;
-	Rcpp::NumericVector index_dates;
-	RFactor index_types;
-	Rcpp::NumericVector ages_at_index;
-	RFactor stemi_presentations;
-        Rcpp::NumericVector survival_times;	
-	RFactor causes_of_death;
+	// The columns are made in C++ and only converted to R vectors at
+	// the end (so that they can be checkpointed)
+	AcsDataset dataset{config, parser, lookup, Rcpp::Rcout};
+	auto & table{dataset.table()};
 	
 	unsigned cancel_counter{0};
 	unsigned ctrl_c_counter_limit{10};
-	const auto all_groups{parser->all_groups(lookup)};
 
-	std::ofstream patient_records_file{"gendata/records.yaml"};
-	patient_records_file << "# Each item in this list is an ACS/PCI record" << std::endl;
+	// With a checkpoint block in the config, the table is saved to the
+	// checkpoint directory every every_patients patients. If resume is
+	// true, the saved rows are loaded and only the patients after the
+	// last one saved are fetched; otherwise the checkpoint is cleared.
+	// Checkpoints are not used when only_nhs_numbers is given.
+	std::optional<Checkpoint> checkpoint;
+	std::size_t checkpoint_interval{0};
+	std::optional<unsigned long long> resume_after;
+	if (config["checkpoint"] and not patient_filter) {
+	    const auto & checkpoint_config{config["checkpoint"]};
+	    std::string directory{"gendata/checkpoint"};
+	    if (checkpoint_config["directory"]) {
+		directory = checkpoint_config["directory"].as<std::string>();
+	    }
+	    checkpoint_interval = checkpoint_config["every_patients"].as<std::size_t>();
+	    checkpoint.emplace(directory, checkpoint_source(config));
+	    if (checkpoint_config["resume"] and checkpoint_config["resume"].as<bool>()) {
+		resume_after = checkpoint->load(table);
+		if (resume_after) {
+		    Rcpp::Rcout << "Resuming from the checkpoint after patient " << *resume_after
+				<< " (" << table.num_rows() << " rows loaded)" << std::endl;
+		}
+	    } else {
+		checkpoint->clear();
+	    }
+	}
+
+	// The query is ordered by nhs_number, so a resumed query only fetches
+	// the patients after the checkpoint. The extract is not necessarily in
+	// order (after a refresh), so when reading it (or making synthetic
+	// rows) the patients are skipped up to and including the last one saved
+	// (the checkpoint is only loaded if the rows come from the same source).
+	std::string extract_mode{"none"};
+	if (config["extract"] and config["extract"]["mode"]) {
+	    extract_mode = config["extract"]["mode"].as<std::string>();
+	}
+	if (resume_after and extract_mode == "write") {
+	    throw std::runtime_error("Cannot resume from a checkpoint while writing an extract");
+	}
+	// The records file holds StringLookup ids of the run that wrote it,
+	// so the records of the patients before the checkpoint cannot be
+	// kept (and a new records file would only have the later patients).
+	if (resume_after and save_records) {
+	    throw std::runtime_error("Cannot resume from a checkpoint with save_records "
+				     "(set save_records to false, or resume to false)");
+	}
+	std::optional<std::string> condition;
+	std::vector<SqlParameter> parameters;
+	if (resume_after) {
+	    condition = "nhs_number > ?";
+	    parameters.push_back(std::to_string(*resume_after));
+	}
+	auto synthetic{config["synthetic"] and config["synthetic"]["enabled"]
+		       and config["synthetic"]["enabled"].as<bool>()};
+
+	// With a sample block, only a fraction of the patients (chosen by a
+	// hash of the nhs_number) are used. Reading straight from the
+	// database, it only returns those patients. Otherwise the others are
+	// skipped as they are read, so that an extract being written holds
+	// all the patients (as it would without the sample).
+	auto sample{read_sample_config(config)};
+	if (sample) {
+	    Rcpp::Rcout << "Using a sample of " << 100 * sample->fraction()
+			<< "% of the patients" << std::endl;
+	    if (extract_mode == "none" and not synthetic) {
+		add_condition(condition, sample->sql_condition("nhs_number"));
+	    }
+	}
+	// Only the spells near the index_event date range are fetched from
+	// the database. The extract is written with all the spells, so that
+	// it can be read with any date range.
+	if (extract_mode == "none" and not synthetic) {
+	    auto [first, end] = dataset.spell_date_range();
+	    add_spell_date_range(condition, parameters, first, end);
+	}
+	SkipSavedPatients skip_saved{extract_mode == "read" or synthetic ? resume_after
+				     : std::nullopt};
+	// With separate_mortality, the mortality table is read into a hash
+	// table instead of being joined onto every episode row. This is only
+	// done when reading straight from the database, because the extract
+	// (and the synthetic rows) have the mortality columns.
+	auto by_nhs_number{false};
+	auto with_mortality{not (separate_mortality(config["sql_query"])
+				 and extract_mode == "none" and not synthetic)};
+	auto sql_query{make_acs_sql_query(config["sql_query"], with_mortality,
+					  by_nhs_number, condition)};
+	// The time spent in each stage is measured by switching the stage
+	// clock as the loop moves between stages. The time not spent
+	// fetching, converting or parsing while the range reads a patient
+	// is counted as patient assembly. Like reading values, parsing is
+	// only timed if asked for, because that costs two clock reads for
+	// every code.
+	PipelineStats stats;
+	if (config["time_parsing"] and config["time_parsing"].as<bool>()) {
+	    parser->set_stage_clock(&stats.clock);
+	}
+	stats.clock.enter(Stage::Query);
+	std::optional<MortalityTable> mortality;
+	if (not with_mortality) {
+	    auto sql_connection{new_sql_connection(config["connection"])};
+	    auto mortality_rows{sql_connection.execute_direct(make_mortality_sql_query())};
+	    mortality.emplace(mortality_rows, parser);
+	    Rcpp::Rcout << "Read " << mortality->size() << " mortality records" << std::endl;
+	}
+	auto row{open_acs_rows(config, sql_query, parser, parameters,
+			       patient_filter ? &patient_filter.value() : nullptr)};
+	stats.clock.enter(Stage::Assemble);
+	auto time_conversion{config["time_conversion"] and config["time_conversion"].as<bool>()};
+	TimedRowBuffer timed_row{row, stats.clock, time_conversion};
+
+	Rcpp::Rcout << "Started fetching rows" << std::endl;
+
+	// Records are encoded in the loop and written to a binary file by a
+	// background thread (see record_sink.h). Convert the file with
+	// records_to_yaml() to read it.
+	std::unique_ptr<RecordSink> records;
+	if (save_records) {
+	    std::string records_file{"gendata/records.bin"};
+	    if (config["records_file"]) {
+		records_file = config["records_file"].as<std::string>();
+	    }
+	    records = std::make_unique<RecordSink>(records_file);
+	}
+	
+	// With patient_arena set, the spells and episodes of each patient (and
+	// its event timeline and counts) are allocated from a monotonic arena
+	// that is released before the next patient is read, instead of with
+	// new/delete. The arena is only passed to the patient range, so
+	// nothing else allocates from it.
+	auto use_arena{config["patient_arena"] and config["patient_arena"].as<bool>()};
+	PatientArena arena{use_arena};
+	clear_trace();
+	auto loop_start{std::chrono::steady_clock::now()};
+	std::size_t patients_since_checkpoint{0};
+	std::optional<unsigned long long> last_nhs_number;
 	
-        while (true) {
+        for (auto & patient : patients(timed_row, parser, dataset.decode_mode(), &arena,
+				       mortality ? &mortality.value() : nullptr)) {
+
+	    if (skip_saved.skip(patient.nhs_number())) {
+		continue;
+	    }
+
+	    // All the rows of the previous patient are in the table
+	    if (checkpoint and last_nhs_number and ++patients_since_checkpoint >= checkpoint_interval) {
+		ScopedStage append_stage{&stats.clock, Stage::Append};
+		checkpoint->save(table, *last_nhs_number);
+		patients_since_checkpoint = 0;
+	    }
+	    last_nhs_number = patient.nhs_number();
 
 	    if (++cancel_counter > ctrl_c_counter_limit) {
 		Rcpp::checkUserInterrupt();
 		cancel_counter = 0;
 	    }
 
-            try {
-		Patient patient{row, parser};
-		auto index_spells{get_acs_and_pci_spells(patient.spells(), acs_metagroup, pci_metagroup)};
-		if (index_spells.empty()) {
-		    continue;
-		}
+	    if (patient_filter and not patient_filter->contains(patient.nhs_number())) {
+		continue;
+	    }
+	    if (sample and not sample->contains(patient.nhs_number())) {
+		continue;
+	    }
 
-		auto row_number{row.current_row_number()};
-		if (row_number % 100000 == 0) {
-		    Rcpp::Rcout << "Got to row " << row_number << std::endl;
-		}
+	    auto row_number{row.current_row_number()};
+	    if (row_number % 100000 == 0) {
+		Rcpp::Rcout << "Got to row " << row_number << std::endl;
+	    }
 
-		auto nhs_number{patient.nhs_number()};
-		const auto & mortality{patient.mortality()};
-
-		for (const auto & index_spell : index_spells) {
-
-		    if (index_spell.empty()) {
-			continue;
-		    }
-
-		    nhs_numbers.push_back(std::to_string(nhs_number));
-		    
-		    const auto & first_episode_of_index{get_first_episode(index_spell)};
-
-		    const auto pci_triggered{primary_pci(first_episode_of_index, pci_metagroup)};
-		    if (pci_triggered) {
-			index_types.push_back("PCI");
-		    } else {
-			index_types.push_back("ACS");			
-		    }		    
-		    
-                    auto age_at_index{first_episode_of_index.age_at_episode()};
-                    try {
-			ages_at_index.push_back(age_at_index.read());
-		    } catch (const Integer::Null &) {
-			ages_at_index.push_back(NA_REAL);		
-		    }
-
-		    auto date_of_index{first_episode_of_index.episode_start()};
-		    index_dates.push_back(date_of_index.read());
-		    
-		    auto stemi_flag{get_stemi_presentation(index_spell, stemi_metagroup)};
-		    if (stemi_flag) {
-			stemi_presentations.push_back("STEMI");
-		    } else {
-			stemi_presentations.push_back("NSTEMI");
-		    }
-
-		    // Count events before/after
-		    // Do not add secondary procedures into the counts, because they
-		    // often represent the current index procedure (not prior procedures)
-		    EventCounter event_counter;
-		    for (const auto & group : get_index_secondaries(index_spell, CodeType::Diagnosis)) {
-			event_counter.push_before(group);
-		    }
-		    
-		    auto spells_before{get_spells_in_window(patient.spells(), index_spell, -365*24*60*60)};
-		    for (const auto & group : get_all_groups(spells_before)) {
-			event_counter.push_before(group);
-		    }
-
-		    auto spells_after{get_spells_in_window(patient.spells(), index_spell, 365*24*60*60)};
-		    for (const auto & group : get_all_groups(spells_after)) {
-			event_counter.push_after(group);
-		    }
-
-                    // Get the counts before and after for this record
-		    auto before{event_counter.counts_before()};
-		    auto after{event_counter.counts_after()};
-		    for (const auto & group : all_groups) {
-			event_counts[group.name(lookup) + "_before"].push_back(before[group]);
-			event_counts[group.name(lookup) + "_after"].push_back(after[group]);
-		    }
-
-		    // Record mortality info
-		    auto death_after{false};
-		    auto cardiac_death{false};
-		    std::optional<TimestampOffset> survival_time;
-                    if (not mortality.alive()) {
-			auto date_of_death{mortality.date_of_death()};
-			if (not date_of_death.null() and not date_of_index.null()) {
-
-			    if (date_of_death < date_of_index) {
-				throw std::runtime_error("Unexpected date of death before index date at patient"
-							 + std::to_string(nhs_number));
-			    }
-
-			    // Check if death occurs in window after (hardcoded for now)
-			    survival_time = date_of_death - date_of_index;
-			    if (survival_time.value() < years(1)) {
-				death_after = true;
-				auto cause_of_death{mortality.cause_of_death()};
-				if (cause_of_death.has_value()) {
-				    cardiac_death = cardiac_death_metagroup.contains(cause_of_death.value());
-				}
-			    }
-			}
-		    }
-		    if (death_after) {
-			survival_times.push_back(survival_time.value().value());
-			if (cardiac_death) {
-			    causes_of_death.push_back("cardiac");
-			} else {
-			    causes_of_death.push_back("all_cause");			    
-			}
-		    } else {
-                        survival_times.push_back(NA_REAL);
-			causes_of_death.push_back("no_death");
-		    }
-
-		    if (save_records) {
-
-			Rcpp::Rcout << "====================================" << std::endl;
-			Rcpp::Rcout << "PCI/ACS RECORD" << std::endl;
-			Rcpp::Rcout << "------------------------------------" << std::endl;
-			
-			// Provided the top level file is a list, it is fine (from the
-			// perspective of yaml syntax) to just join multiple files together.
-			// This avoids storing the entire YAML document in memory. Note that
-			// you need newlines between the list items. One is inserted below
-			// as insurance.
-			YAML::Emitter patient_record;
-			patient_record << YAML::BeginSeq;
-
-			/////////// print
-			Rcpp::Rcout << "Pseudo NHS Number: " << nhs_number << std::endl;
-			Rcpp::Rcout << "Age at index: " << age_at_index << std::endl;
-			Rcpp::Rcout << "Index date: " << date_of_index << std::endl;
-
-			if (stemi_flag) {
-			    Rcpp::Rcout << "Presentation: STEMI" << std::endl;
-			} else {
-			    Rcpp::Rcout << "Presentation: NSTEMI" << std::endl;
-			}
-
-			if (pci_triggered) {
-			    Rcpp::Rcout << "Inclusion trigger: PCI" << std::endl;
-			} else {
-			    Rcpp::Rcout << "Inclusion trigger: ACS" << std::endl;
-			}
-
-			/////////// end print
-			
-			patient_record << YAML::BeginMap
-				       << YAML::Key << "nhs_number"
-				       << YAML::Value << nhs_number;
-
-			if (not age_at_index.null()) {
-			    patient_record << YAML::Key << "age_at_index"
-					   << YAML::Value << age_at_index;
-			}
-
-			if (not date_of_index.null()) {
-			    patient_record << YAML::Key << "date_of_index"
-					   << YAML::Value << date_of_index;
-			}
-			
-			patient_record << YAML::Key << "presentation";
-			if (stemi_flag) {
-			    patient_record << YAML::Value << "STEMI";
-			} else {
-			    patient_record << YAML::Value << "NSTEMI";
-			}
-			
-			patient_record << YAML::Key << "inclusion_trigger";
-			if (pci_triggered) {
-			    patient_record << YAML::Value << "PCI";
-			} else {
-			    patient_record << YAML::Value << "ACS";
-			}
-
-			patient_record << YAML::Key << "mortality";
-			write_yaml_stream(patient_record, mortality, lookup);
-
-			patient_record << YAML::Key << "index_spell";
-			write_yaml_stream(patient_record, index_spell, lookup);
-
-			if (not spells_after.empty()) {
-			    patient_record << YAML::Key << "spells_after"
-					   << YAML::Value
-					   << YAML::BeginSeq;
-			    for (const auto & spell : spells_after) {
-				write_yaml_stream(patient_record, spell, lookup);	
-			    }
-			    patient_record << YAML::EndSeq;
-			}
-
-			if (not spells_before.empty()) {
-			    patient_record << YAML::Key << "spells_before"
-					   << YAML::Value
-					   << YAML::BeginSeq;
-			    for (const auto & spell : spells_before) {
-				write_yaml_stream(patient_record, spell, lookup);	
-			    }
-			    patient_record << YAML::EndSeq;
-			}
-
-			patient_record << YAML::Key << "event_counts"
-				       << YAML::Value;
-			write_yaml_stream(patient_record, event_counter, lookup);			
-
-			//////////////// end yaml
-
-			
-                        mortality.print(Rcpp::Rcout, lookup);
-			if (survival_time.has_value()) {
-			    Rcpp::Rcout << "Survival time: " << survival_time.value() << std::endl;
-			}
-			Rcpp::Rcout << "EVENT COUNTS" << std::endl;
-			event_counter.print(Rcpp::Rcout, lookup);
-			Rcpp::Rcout << "INDEX SPELL" << std::endl;
-			index_spell.print(Rcpp::Rcout, lookup, 4);			
-			Rcpp::Rcout << std::endl;
-			Rcpp::Rcout << "SPELLS AFTER" << std::endl;
-			for (const auto & spell : spells_after) {
-			    spell.print(Rcpp::Rcout, lookup, 4);
-			}
-			Rcpp::Rcout << "SPELLS BEFORE" << std::endl;
-			for (const auto & spell : spells_before) {
-			    spell.print(Rcpp::Rcout, lookup, 4);
-			}
-
-			patient_record << YAML::EndMap;
-			patient_record << YAML::EndSeq;
-			// Includes newline for insurance (concatenating yaml lists)
-                        patient_records_file << std::endl << patient_record.c_str();
-		    }
-		}
-	    } catch (const RowBufferException::NoMoreRows &) {
-		Rcpp::Rcout << "Finished fetching all rows" << std::endl;
-		break;
+	    // Leaving add_patient returns to patient assembly
+	    dataset.add_patient(patient, stats, records.get());
+	}
+	stats.clock.enter(Stage::Other);
+	parser->set_stage_clock(nullptr);
+	skip_saved.finish();
+	Rcpp::Rcout << "Finished fetching all rows" << std::endl;
+	if (auto extracting{row.get_if<ExtractingRowBuffer<SqlRowBuffer>>()}) {
+	    extracting->close();
+	    Rcpp::Rcout << "Saved " << extracting->num_rows_saved() << " rows to the extract" << std::endl;
+	}
+	if (records) {
+	    records->close(*lookup);
+	    Rcpp::Rcout << "Saved " << records->size() << " records" << std::endl;
+	}
+
+	std::chrono::duration<double> loop_time{std::chrono::steady_clock::now() - loop_start};
+	Rcpp::Rcout << "Processed all patients in " << loop_time.count() << " s" << std::endl;
+	arena.print(Rcpp::Rcout);
+
+	if (checkpoint and last_nhs_number) {
+	    ScopedStage append_stage{&stats.clock, Stage::Append};
+	    checkpoint->save(table, *last_nhs_number);
+	}
+
+	// The stage times and counters are returned in the stats attribute
+	// of the list, and also written as JSON to the optional stats_file
+	stats.rows = timed_row.rows_read();
+	stats.procedures = parser->parse_counts(CodeType::Procedure);
+	stats.diagnoses = parser->parse_counts(CodeType::Diagnosis);
+	stats.peak_rss = peak_rss_bytes();
+	stats.print_stage_times(Rcpp::Rcout);
+	if (config["stats_file"]) {
+	    auto stats_file{config["stats_file"].as<std::string>()};
+	    std::ofstream stats_json{stats_file};
+	    stats.write_json(stats_json);
+	    Rcpp::Rcout << "Saved run statistics to " << stats_file << std::endl;
+	}
+
+	// Spans are only recorded in a build with RDB_TRACE (see trace.h)
+	if (config["trace_file"]) {
+	    if (tracing_enabled) {
+		auto trace_file{config["trace_file"].as<std::string>()};
+		std::ofstream trace{trace_file};
+		write_chrome_trace(trace);
+		Rcpp::Rcout << "Saved the trace to " << trace_file << std::endl;
+	    } else {
+		Rcpp::Rcout << "Not saving trace_file (tracing is not compiled in)" << std::endl;
 	    }
 	}
 
 	Rcpp::List table_r;
-	table_r["nhs_number"] = nhs_numbers.get();
-	table_r["index_date"] = index_dates;
-	table_r["index_type"] = index_types.get();
-	table_r["age_at_index"] = ages_at_index;
-	table_r["stemi_presentation"] = stemi_presentations.get();
-	table_r["survival_time"] = survival_times;
-	table_r["cause_of_death"] = causes_of_death.get();
-	for (const auto & [column_name, counts] : event_counts) {
-	    table_r[column_name] = counts;
+	if (schema) {
+	    export_arrow(std::move(table), schema, array);
+	} else {
+	    table_r = to_r_list(std::move(table));
 	}
-
+	table_r.attr("stats") = to_r_list(stats);
 	return table_r;
 
     } catch (const std::runtime_error & e) {
@@ -523,18 +632,41 @@ Rcpp::List make_acs_dataset(const Rcpp::CharacterVector & config_path) {
     }
 }
 
+/// Return a named list of the docs of every code in the codes file. If
+/// arrow_schema and arrow_array are given (see arrow_pointers()), the
+/// codes are exported into them instead as a table with code and docs
+/// columns, and an empty list is returned.
 // [[Rcpp::export]]
-Rcpp::List get_flat_codes(const Rcpp::CharacterVector & codes_file_path) {
+Rcpp::List get_flat_codes(const Rcpp::CharacterVector & codes_file_path,
+			  SEXP arrow_schema = R_NilValue, SEXP arrow_array = R_NilValue) {
+
+    auto [schema, array] = arrow_pointers(arrow_schema, arrow_array);
 
     std::string codes_file_path_str{Rcpp::as<std::string>(codes_file_path)};
     auto codes_file{YAML::LoadFile(codes_file_path_str)};
     TopLevelCategory top_level_category{codes_file};
     auto all_codes_and_docs{top_level_category.all_codes_and_docs()};
 
-    Rcpp::List list_r;
-    for (const auto & [code, docs] : all_codes_and_docs) {
-	list_r[code] = docs;
+    if (schema) {
+	StringColumns columns{{"code", {}}, {"docs", {}}};
+	for (auto & [code, docs] : all_codes_and_docs) {
+	    columns[0].second.push_back(std::move(code));
+	    columns[1].second.push_back(std::move(docs));
+	}
+	export_arrow(columns, schema, array);
+	return Rcpp::List{};
+    }
+
+    // Assigning by name to a list copies it each time, so the list and
+    // its names are made at full size
+    Rcpp::List list_r(all_codes_and_docs.size());
+    Rcpp::CharacterVector names(all_codes_and_docs.size());
+    for (std::size_t n{0}; n < all_codes_and_docs.size(); n++) {
+	const auto & [code, docs] = all_codes_and_docs[n];
+	names[n] = code;
+	list_r[n] = docs;
     }
+    list_r.attr("names") = names;
     return list_r;
 }
 
@@ -542,29 +674,50 @@ Rcpp::List get_flat_codes(const Rcpp::CharacterVector & codes_file_path) {
 /// Return a list of all the groups, and which codes they contain.
 /// The structure is a named list. The names are the groups, and
 /// the items are a list of codes (with name and docs). Pass the codes
-/// file which defines the groupings.
+/// file which defines the groupings. If arrow_schema and arrow_array
+/// are given (see arrow_pointers()), the groups are exported into them
+/// instead as one table with group, names and docs columns, and an
+/// empty list is returned.
 // [[Rcpp::export]]
-Rcpp::List dump_groups(const Rcpp::CharacterVector & file) {
+Rcpp::List dump_groups(const Rcpp::CharacterVector & file,
+		       SEXP arrow_schema = R_NilValue, SEXP arrow_array = R_NilValue) {
 
     std::string file_ = Rcpp::as<std::string>(file);     
     
     try {
+	auto [schema, array] = arrow_pointers(arrow_schema, arrow_array);
 	YAML::Node top_level_category_yaml = YAML::LoadFile(file_);
 	TopLevelCategory top_level_category{top_level_category_yaml};
 
-	Rcpp::List list;
-	for (const auto & group : top_level_category.all_groups()) {
-	    Rcpp::CharacterVector names_vec, docs_vec;
-	    auto codes_in_group{top_level_category.codes_in_group(group)};
-	    for (const auto & [name, docs] : codes_in_group) {
-		names_vec.push_back(name);
-		docs_vec.push_back(docs);
+	if (schema) {
+	    StringColumns columns{{"group", {}}, {"names", {}}, {"docs", {}}};
+	    for (const auto & group : top_level_category.all_groups()) {
+		for (auto & [name, doc] : top_level_category.codes_in_group(group)) {
+		    columns[0].second.push_back(group);
+		    columns[1].second.push_back(std::move(name));
+		    columns[2].second.push_back(std::move(doc));
+		}
+	    }
+	    export_arrow(columns, schema, array);
+	    return Rcpp::List{};
+	}
+
+	auto groups{top_level_category.all_groups()};
+	Rcpp::List list(groups.size());
+	std::size_t n{0};
+	for (const auto & group : groups) {
+	    std::vector<std::string> names, docs;
+	    for (auto & [name, doc] : top_level_category.codes_in_group(group)) {
+		names.push_back(std::move(name));
+		docs.push_back(std::move(doc));
 	    }
-	    list[group] = Rcpp::List::create(Rcpp::Named("names")
-					     = names_vec,
-					     Rcpp::Named("docs")
-					     = docs_vec);
+	    Rcpp::List codes(2);
+	    codes[0] = make_altrep_strings(std::move(names));
+	    codes[1] = make_altrep_strings(std::move(docs));
+	    codes.attr("names") = Rcpp::CharacterVector::create("names", "docs");
+	    list[n++] = codes;
 	}
+	list.attr("names") = Rcpp::CharacterVector(groups.begin(), groups.end());
 
 	return list;
 	
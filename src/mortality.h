@@ -1,6 +1,8 @@
 #ifndef MORTALITY_HPP
 #define MORTALITY_HPP
 
+#include <unordered_map>
+
 #include "row_buffer.h"
 #include "clinical_code.h"
 
@@ -8,6 +10,9 @@ class Mortality {
 public:
 
     struct PatientAlive {};
+
+    /// Make empty mortality data (to be replaced from a row)
+    Mortality() = default;
     
     Mortality(const RowBuffer auto & row, std::shared_ptr<ClinicalCodeParser> parser) {
 	date_of_death_ = column<Timestamp>("date_of_death", row);
@@ -25,6 +30,13 @@ public:
 	}
     }
     
+    /// Mortality data for a patient with no mortality record
+    static Mortality alive_patient() {
+	Mortality mortality;
+	mortality.alive_ = true;
+	return mortality;
+    }
+
     auto alive() const {
 	return alive_;
     }
@@ -77,4 +89,42 @@ private:
     bool alive_{false};
 };
 
+/**
+ * \brief The mortality records of all patients, by nhs_number
+ *
+ * Instead of joining the mortality table onto every episode row, the
+ * mortality rows (see make_mortality_sql_query) can be read once into
+ * this table, parsing each cause of death once, and Patient::read()
+ * takes the mortality data from here. If there is more than one row
+ * for a patient, the first is kept. The codes belong to the parser's
+ * string lookup, so use the table with the same parser.
+ */
+class MortalityTable {
+public:
+    /// Read all the rows, which have nhs_number, date_of_death,
+    /// age_at_death and cause_of_death columns
+    MortalityTable(RowBuffer auto & row, std::shared_ptr<ClinicalCodeParser> parser) {
+	while (not row.end()) {
+	    auto nhs_number{column<Integer>("nhs_number", row).read()};
+	    records_.try_emplace(nhs_number, row, parser);
+	    row.try_fetch_next_row();
+	}
+    }
+
+    /// The mortality data of a patient (alive if there is no record)
+    const Mortality & find(unsigned long long nhs_number) const {
+	auto it{records_.find(nhs_number)};
+	return it == records_.end() ? alive_ : it->second;
+    }
+
+    /// The number of patients with a mortality record
+    std::size_t size() const {
+	return records_.size();
+    }
+
+private:
+    std::unordered_map<unsigned long long, Mortality> records_;
+    Mortality alive_{Mortality::alive_patient()};
+};
+
 #endif
@@ -4,19 +4,51 @@
 #include "row_buffer.h"
 #include "spell.h"
 #include <ostream>
+#include <concepts>
+#include <memory_resource>
+#include <optional>
 #include "mortality.h"
+#include "arena.h"
+#include "trace.h"
 
 class Patient {
 public:
+    /// Make an empty patient, to be filled by read()
+    Patient() = default;
+
+    /// Make an empty patient whose spells (and their episodes) are
+    /// allocated from resource (see PatientRange)
+    explicit Patient(std::pmr::memory_resource * resource)
+	: spells_{resource} { }
+    
     /// The row object passed in has _already had the
     /// first row fetched_. At the other end, when it
     /// discovers a new patients, the row is left in
-    /// the buffer for the next Patient object
-    Patient(RowBuffer auto & row, std::shared_ptr<ClinicalCodeParser> parser)
-	// Take the mortality data from the first row of the first spell, because
-	// the mortality table was left-joined (so all rows will be the same)
-	: mortality_{row, parser} {
+    /// the buffer for the next Patient object. In
+    /// DecodeMode::Primary, only the primary codes of
+    /// each episode are parsed (see decode()). If a mortality
+    /// table is passed, the mortality data comes from there instead
+    /// of from the rows.
+    Patient(RowBuffer auto & row, std::shared_ptr<ClinicalCodeParser> parser,
+	    DecodeMode mode = DecodeMode::Full,
+	    const MortalityTable * mortality = nullptr) {
+	read(row, parser, mode, mortality);
+    }
 
+    /// Replace the contents of this patient with the next patient
+    /// in the row buffer. The spells vector keeps its capacity, so
+    /// reading patients one after another into the same object does
+    /// not reallocate it. Throws NoMoreRows if the row buffer has
+    /// already finished.
+    void read(RowBuffer auto & row, std::shared_ptr<ClinicalCodeParser> parser,
+	      DecodeMode mode = DecodeMode::Full,
+	      const MortalityTable * mortality = nullptr) {
+
+	RDB_TRACE_SPAN("patient");
+	if (row.end()) {
+	    throw RowBufferException::NoMoreRows{};
+	}
+	
 	try {
 	    nhs_number_ = column<Integer>("nhs_number", row).read();
 	} catch (const RowBufferException::ColumnNotFound &) {
@@ -24,9 +56,31 @@ public:
 	} catch (const RowBufferException::WrongColumnType &) {
 	    throw std::runtime_error("Wrong column type for nhs_number in Patient constructor");
 	}
-	    
-	while(column<Integer>("nhs_number", row).read() == nhs_number_) {
-	    spells_.emplace_back(row, parser);
+
+	// Otherwise, take the mortality data from the first row of the first
+	// spell, because the mortality table was left-joined (so all rows will
+	// be the same)
+	if (mortality != nullptr) {
+	    mortality_ = mortality->find(nhs_number_);
+	} else {
+	    mortality_ = Mortality{row, parser};
+	}
+
+	spells_.clear();
+	while (not row.end()
+	       and column<Integer>("nhs_number", row).read() == nhs_number_) {
+	    spells_.emplace_back(row, parser, mode);
+	}
+    }
+
+    /// Parse the secondary columns of the spells for which
+    /// the predicate is true (the others are left as they are)
+    void decode(std::shared_ptr<ClinicalCodeParser> parser,
+		std::predicate<const Spell &> auto && include) {
+	for (auto & spell : spells_) {
+	    if (include(spell)) {
+		spell.decode(parser);
+	    }
 	}
     }
 
@@ -53,8 +107,120 @@ public:
     
 private:
     Mortality mortality_;
-    long long unsigned nhs_number_;
-    std::vector<Spell> spells_;
+    long long unsigned nhs_number_{0};
+    std::pmr::vector<Spell> spells_;
 };
 
+/// Marks the end of a PatientRange
+struct PatientSentinel {};
+
+/**
+ * \brief Input range over the patients in a row buffer
+ *
+ * Each step reads the next patient into the same Patient object
+ * (see Patient::read()), so the reference obtained from the
+ * iterator is only valid until the next increment. The end is
+ * found by checking the row buffer, so no NoMoreRows exception
+ * is thrown when the rows run out. Use as
+ *
+ *     for (auto & patient : patients(row, parser)) { ... }
+ *
+ * If an arena is passed, the spells and episodes of each patient are
+ * allocated from it, and it is reset before each patient is read
+ * (after the previous patient is destroyed). If a mortality table is
+ * passed, the rows do not need the mortality columns (see
+ * Patient::read()).
+ */
+template<RowBuffer R>
+class PatientRange {
+public:
+    class Iterator {
+    public:
+	using value_type = Patient;
+	using difference_type = std::ptrdiff_t;
+
+	Iterator() = default;
+	explicit Iterator(PatientRange * range) : range_{range} {}
+
+	Patient & operator*() const {
+	    return *range_->patient_;
+	}
+
+	Iterator & operator++() {
+	    range_->next();
+	    return *this;
+	}
+
+	void operator++(int) {
+	    ++*this;
+	}
+
+	friend bool operator==(const Iterator & it, PatientSentinel) {
+	    return it.at_end();
+	}
+	
+    private:
+	bool at_end() const {
+	    return range_->done_;
+	}
+	
+	PatientRange * range_{nullptr};
+    };
+
+    PatientRange(R & row, std::shared_ptr<ClinicalCodeParser> parser, DecodeMode mode,
+		 PatientArena * arena = nullptr, const MortalityTable * mortality = nullptr)
+	: row_{row}, parser_{parser}, mode_{mode}, arena_{arena}, mortality_{mortality} {
+	patient_.emplace(resource());
+	next();
+    }
+
+    // The iterators point back into the range
+    PatientRange(const PatientRange &) = delete;
+    PatientRange & operator=(const PatientRange &) = delete;
+    
+    Iterator begin() {
+	return Iterator{this};
+    }
+
+    PatientSentinel end() const {
+	return {};
+    }
+    
+private:
+    void next() {
+	if (arena_ != nullptr) {
+	    // The previous patient must go before its memory is released
+	    patient_.reset();
+	    arena_->reset();
+	    patient_.emplace(resource());
+	}
+	if (row_.end()) {
+	    done_ = true;
+	} else {
+	    patient_->read(row_, parser_, mode_, mortality_);
+	}
+    }
+
+    std::pmr::memory_resource * resource() const {
+	return arena_ != nullptr ? arena_->resource() : std::pmr::get_default_resource();
+    }
+    
+    R & row_;
+    std::shared_ptr<ClinicalCodeParser> parser_;
+    DecodeMode mode_;
+    PatientArena * arena_;
+    const MortalityTable * mortality_;
+    std::optional<Patient> patient_;
+    bool done_{false};
+};
+
+/// Iterate over the patients in a row buffer (see PatientRange)
+template<RowBuffer R>
+PatientRange<R> patients(R & row, std::shared_ptr<ClinicalCodeParser> parser,
+			 DecodeMode mode = DecodeMode::Full,
+			 PatientArena * arena = nullptr,
+			 const MortalityTable * mortality = nullptr) {
+    return {row, parser, mode, arena, mortality};
+}
+
 #endif
@@ -0,0 +1,41 @@
+#include "patient_sample.h"
+
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#include "random.h"
+
+PatientSample::PatientSample(double fraction, std::uint64_t seed)
+    : fraction_{fraction} {
+    if (not (fraction > 0 and fraction <= 1)) {
+	throw std::runtime_error("The sample fraction must be more than 0 and at most 1");
+    }
+    CounterGenerator gen{seed};
+    multiplier_ = 1 + uniform_below(gen, modulus_ - 1);
+    increment_ = uniform_below(gen, modulus_);
+    threshold_ = fraction == 1 ? modulus_
+	: static_cast<std::uint64_t>(std::floor(fraction * static_cast<double>(modulus_)));
+}
+
+std::string PatientSample::sql_condition(const std::string & nhs_number) const {
+    // Taking n mod p first keeps the product below 2^62, so it does
+    // not overflow a bigint
+    std::stringstream condition;
+    condition << "(((cast(" << nhs_number << " as bigint) % " << modulus_ << ") * "
+	      << multiplier_ << " + " << increment_ << ") % " << modulus_
+	      << " < " << threshold_ << ")";
+    return condition.str();
+}
+
+std::optional<PatientSample> read_sample_config(const YAML::Node & config) {
+    if (not config["sample"]) {
+	return std::nullopt;
+    }
+    auto sample{config["sample"]};
+    std::uint64_t seed{0};
+    if (sample["seed"]) {
+	seed = sample["seed"].as<std::uint64_t>();
+    }
+    return PatientSample{sample["fraction"].as<double>(), seed};
+}
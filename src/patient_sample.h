@@ -0,0 +1,65 @@
+#ifndef PATIENT_SAMPLE_HPP
+#define PATIENT_SAMPLE_HPP
+
+/**
+ * \file patient_sample.h
+ * \brief A reproducible sample of the patients
+ *
+ * A patient is in the sample if a hash of their nhs_number is below
+ * a threshold, so all the rows of a patient are kept or dropped
+ * together, and the same patients are chosen whatever the source of
+ * the rows (database, extract or synthetic) and their order. The hash
+ * is
+ *
+ *     h(n) = ((n mod p) * a + c) mod p, with p = 2^31 - 1
+ *
+ * where the seed chooses a and c. It only needs 64-bit integer
+ * arithmetic, so the database can work it out too (see
+ * sql_condition()) and send only the sample. A patient is kept if
+ * h(n) < fraction * p. For the same seed, a smaller fraction gives
+ * a subset of the patients of a larger one.
+ */
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include <yaml-cpp/yaml.h>
+
+class PatientSample {
+public:
+    /// Keep the fraction (in (0, 1]) of the patients chosen by the
+    /// seed. Throws std::runtime_error for any other fraction.
+    PatientSample(double fraction, std::uint64_t seed);
+
+    /// Whether the patient is in the sample
+    bool contains(std::uint64_t nhs_number) const {
+	return hash(nhs_number) < threshold_;
+    }
+
+    /// The same test as an SQL condition, for a column (or expression)
+    /// holding the nhs_number as a number
+    std::string sql_condition(const std::string & nhs_number) const;
+
+    double fraction() const {
+	return fraction_;
+    }
+
+private:
+    static constexpr std::uint64_t modulus_{2147483647};
+
+    std::uint64_t hash(std::uint64_t nhs_number) const {
+	return ((nhs_number % modulus_) * multiplier_ + increment_) % modulus_;
+    }
+
+    double fraction_;
+    std::uint64_t multiplier_;
+    std::uint64_t increment_;
+    std::uint64_t threshold_;
+};
+
+/// Read the optional sample block of the config file (fraction, and
+/// seed, which defaults to 0). Returns nullopt if there is no block.
+std::optional<PatientSample> read_sample_config(const YAML::Node & config);
+
+#endif
@@ -0,0 +1,118 @@
+#include "patient_store.h"
+
+#include <fstream>
+#include <sstream>
+#include <string_view>
+
+namespace {
+
+const std::string index_magic{"RDBIDX01"};
+
+/// The size of an index entry in the file
+constexpr std::size_t index_entry_size{16};
+
+void append_uint(std::string & bytes, std::uint64_t value, std::size_t width) {
+    for (std::size_t n{0}; n < width; n++) {
+	bytes.push_back(static_cast<char>((value >> (8*n)) & 0xff));
+    }
+}
+
+std::uint64_t read_uint(std::string_view bytes, std::size_t width) {
+    std::uint64_t value{0};
+    for (std::size_t n{0}; n < width; n++) {
+	value |= static_cast<std::uint64_t>(static_cast<unsigned char>(bytes[n])) << (8*n);
+    }
+    return value;
+}
+
+std::vector<PatientStoreEntry> read_index(const std::string & file_path) {
+    std::ifstream file{patient_store_index_path(file_path), std::ios::binary};
+    if (not file) {
+	throw ExtractException::BadFile{"Missing patient store index for " + file_path};
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    auto bytes{contents.str()};
+    std::string_view view{bytes};
+    if (not view.starts_with(index_magic) or view.size() < index_magic.size() + 8) {
+	throw ExtractException::BadFile{"Not a complete patient store index: " + file_path};
+    }
+    view.remove_prefix(index_magic.size());
+    auto num_patients{read_uint(view, 8)};
+    view.remove_prefix(8);
+    if (view.size() != num_patients * index_entry_size) {
+	throw ExtractException::BadFile{"Wrong size of patient store index: " + file_path};
+    }
+    std::vector<PatientStoreEntry> index(num_patients);
+    for (auto & entry : index) {
+	entry.nhs_number = read_uint(view, 8);
+	entry.row_group = static_cast<std::uint32_t>(read_uint(view.substr(8), 4));
+	entry.row = static_cast<std::uint32_t>(read_uint(view.substr(12), 4));
+	view.remove_prefix(index_entry_size);
+    }
+    return index;
+}
+
+}
+
+void write_patient_store_index(const std::string & file_path,
+			       const std::vector<PatientStoreEntry> & index) {
+    // Written to a temporary file and renamed, so that the index only
+    // appears once it is complete
+    auto index_path{patient_store_index_path(file_path)};
+    auto temp_path{index_path + ".tmp"};
+    std::string bytes{index_magic};
+    append_uint(bytes, index.size(), 8);
+    for (const auto & entry : index) {
+	append_uint(bytes, entry.nhs_number, 8);
+	append_uint(bytes, entry.row_group, 4);
+	append_uint(bytes, entry.row, 4);
+    }
+    {
+	std::ofstream file{temp_path, std::ios::binary};
+	file.write(bytes.data(), bytes.size());
+	if (not file) {
+	    throw std::runtime_error("Failed to write the patient store index " + temp_path);
+	}
+    }
+    std::filesystem::rename(temp_path, index_path);
+}
+
+PatientStore::PatientStore(const std::string & file_path)
+    : rows_{file_path}, index_{read_index(file_path)} {
+    for (const auto & entry : index_) {
+	if (entry.row_group >= rows_.row_groups().size()
+	    or entry.row >= rows_.row_groups()[entry.row_group].num_rows) {
+	    throw ExtractException::BadFile{"Patient store index does not match " + file_path};
+	}
+    }
+}
+
+std::optional<Patient> PatientStore::find(std::uint64_t nhs_number,
+					  std::shared_ptr<ClinicalCodeParser> parser) {
+    auto it{std::ranges::lower_bound(index_, nhs_number, {}, &PatientStoreEntry::nhs_number)};
+    if (it == index_.end() or it->nhs_number != nhs_number) {
+	return std::nullopt;
+    }
+    rows_.seek(it->row_group, it->row);
+    return Patient{rows_, parser};
+}
+
+PatientStore open_patient_store(const std::string & store_path,
+				const std::string & extract_path, std::ostream & os) {
+    namespace fs = std::filesystem;
+    auto complete{fs::exists(store_path) and fs::exists(patient_store_index_path(store_path))};
+    if (complete and fs::exists(extract_path)
+	and fs::last_write_time(patient_store_index_path(store_path))
+	< fs::last_write_time(extract_path)) {
+	os << "The patient store is older than the extract" << std::endl;
+	complete = false;
+    }
+    if (not complete) {
+	os << "Building the patient store " << store_path << " from " << extract_path << std::endl;
+	ExtractRowBuffer extract{extract_path};
+	auto num_patients{build_patient_store(extract, store_path)};
+	os << "Saved " << num_patients << " patients" << std::endl;
+    }
+    return PatientStore{store_path};
+}
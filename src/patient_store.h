@@ -0,0 +1,126 @@
+#ifndef PATIENT_STORE_HPP
+#define PATIENT_STORE_HPP
+
+/**
+ * \file patient_store.h
+ * \brief A local file of patients, indexed by nhs_number
+ *
+ * Looking up one patient in the database means a query through the
+ * view for each patient. The patient store is a copy of a full extract
+ * that can be read one patient at a time instead. It is two files:
+ *
+ * - the rows, as an extract file (see extract.h) with small row
+ *   groups, so that reading a patient only decodes a few rows
+ * - an index, next to it with ".idx" added to the name, of the first
+ *   row of every patient, sorted by nhs_number
+ *
+ * Index layout (integers are little-endian): magic "RDBIDX01", u64
+ * number of patients, then for each patient: u64 nhs_number, u32 row
+ * group and u32 row within the row group. The index is written last,
+ * so a store whose build did not finish has no index and cannot be
+ * opened.
+ *
+ * Use open_patient_store() to open the store, rebuilding it first if
+ * it is older than the extract.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "extract.h"
+#include "patient.h"
+
+/// The position of the first row of a patient in the store
+struct PatientStoreEntry {
+    std::uint64_t nhs_number;
+    std::uint32_t row_group;
+    std::uint32_t row;
+};
+
+/// The path of the index of the store at file_path
+inline std::string patient_store_index_path(const std::string & file_path) {
+    return file_path + ".idx";
+}
+
+/// Write the index of a patient store. The entries must be sorted by
+/// nhs_number.
+void write_patient_store_index(const std::string & file_path,
+			       const std::vector<PatientStoreEntry> & index);
+
+/// Copy the rows of a row buffer, from the current row to the end, to
+/// a patient store at file_path (replacing any store there). The rows
+/// of each patient must be together (as in an extract), but patients
+/// can be in any order. Throws std::runtime_error if a patient's rows
+/// are split. Returns the number of patients.
+std::size_t build_patient_store(RowBuffer auto & row, const std::string & file_path,
+				std::size_t rows_per_group = 256) {
+    std::filesystem::remove(patient_store_index_path(file_path));
+    std::vector<PatientStoreEntry> index;
+    {
+	ExtractWriter writer{file_path, row.columns(), rows_per_group};
+	std::optional<std::uint64_t> last_nhs_number;
+	for (; not row.end(); row.try_fetch_next_row()) {
+	    auto nhs_number{column<Integer>("nhs_number", row).read()};
+	    writer.push_row(row);
+	    if (nhs_number != last_nhs_number) {
+		auto [row_group, group_row] = writer.last_row_position();
+		index.push_back({nhs_number, static_cast<std::uint32_t>(row_group),
+				 static_cast<std::uint32_t>(group_row)});
+		last_nhs_number = nhs_number;
+	    }
+	}
+	writer.close();
+    }
+    std::ranges::sort(index, {}, &PatientStoreEntry::nhs_number);
+    auto repeated{std::ranges::adjacent_find(index, {}, &PatientStoreEntry::nhs_number)};
+    if (repeated != index.end()) {
+	throw std::runtime_error("The rows of patient " + std::to_string(repeated->nhs_number)
+				 + " are not together");
+    }
+    write_patient_store_index(file_path, index);
+    return index.size();
+}
+
+/**
+ * \brief Reads patients from a patient store by nhs_number
+ *
+ * The whole index is read when the store is opened, and the rows are
+ * memory-mapped, so finding a patient is a binary search and decoding
+ * the row group that holds it.
+ */
+class PatientStore {
+public:
+    /// Open the store made by build_patient_store(). Throws
+    /// ExtractException::BadFile if the store or its index is not
+    /// complete.
+    explicit PatientStore(const std::string & file_path);
+
+    /// Read a patient, or return nullopt if the patient is not in
+    /// the store
+    std::optional<Patient> find(std::uint64_t nhs_number,
+				std::shared_ptr<ClinicalCodeParser> parser);
+
+    /// The number of patients in the store
+    std::size_t size() const {
+	return index_.size();
+    }
+
+private:
+    ExtractRowBuffer rows_;
+    std::vector<PatientStoreEntry> index_;
+};
+
+/// Open the patient store at store_path, first rebuilding it from the
+/// extract at extract_path if the store is missing, not complete, or
+/// older than the extract. Progress is printed to os.
+PatientStore open_patient_store(const std::string & store_path,
+				const std::string & extract_path, std::ostream & os);
+
+#endif
@@ -0,0 +1,97 @@
+#include "pipeline_stats.h"
+
+#include <stdexcept>
+
+#ifdef _WIN64
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+const char * stage_name(Stage stage) {
+    switch (stage) {
+    case Stage::Other: return "other";
+    case Stage::Query: return "query";
+    case Stage::Fetch: return "fetch";
+    case Stage::Convert: return "convert";
+    case Stage::Parse: return "parse";
+    case Stage::Assemble: return "assemble";
+    case Stage::Index: return "index";
+    case Stage::Append: return "append";
+    case Stage::Records: return "records";
+    default:
+	throw std::runtime_error("Not expecting to get here in stage_name()");
+    }
+}
+
+std::size_t peak_rss_bytes() {
+#ifdef _WIN64
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+	return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+	return 0;
+    }
+#ifdef __APPLE__
+    // Bytes on macOS, kilobytes on Linux
+    return static_cast<std::size_t>(usage.ru_maxrss);
+#else
+    return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+std::vector<std::pair<std::string, double>> PipelineStats::counters() const {
+    auto add_parse_counts = [](auto & counters, const std::string & prefix,
+			       const ParseCounts & counts) {
+	counters.push_back({prefix + "_cache_hits", counts.cache_hits});
+	counters.push_back({prefix + "_cache_misses", counts.cache_misses});
+	counters.push_back({prefix + "_invalid", counts.invalid});
+    };
+    std::vector<std::pair<std::string, double>> counters{
+	{"rows", rows},
+	{"patients", patients},
+	{"index_records", index_records},
+    };
+    add_parse_counts(counters, "procedure", procedures);
+    add_parse_counts(counters, "diagnosis", diagnoses);
+    counters.push_back({"invalid_codes", procedures.invalid + diagnoses.invalid});
+    counters.push_back({"peak_rss_bytes", peak_rss});
+    return counters;
+}
+
+void PipelineStats::write_json(std::ostream & os) const {
+    os << "{\n  \"stage_seconds\": {";
+    double total{0};
+    for (std::size_t n{0}; n < static_cast<std::size_t>(Stage::Count); n++) {
+	auto stage{static_cast<Stage>(n)};
+	auto seconds{clock.time(stage).count()};
+	total += seconds;
+	os << (n > 0 ? "," : "") << "\n    \"" << stage_name(stage) << "\": " << seconds;
+    }
+    os << ",\n    \"total\": " << total << "\n  },\n  \"counters\": {";
+    auto all_counters{counters()};
+    for (std::size_t n{0}; n < all_counters.size(); n++) {
+	os << (n > 0 ? "," : "") << "\n    \"" << all_counters[n].first
+	   << "\": " << static_cast<unsigned long long>(all_counters[n].second);
+    }
+    os << "\n  }\n}\n";
+}
+
+void PipelineStats::print_stage_times(std::ostream & os) const {
+    std::chrono::duration<double> total{0};
+    for (std::size_t n{0}; n < static_cast<std::size_t>(Stage::Count); n++) {
+	total += clock.time(static_cast<Stage>(n));
+    }
+    os << "Time in each stage:" << std::endl;
+    for (std::size_t n{0}; n < static_cast<std::size_t>(Stage::Count); n++) {
+	auto time{clock.time(static_cast<Stage>(n))};
+	os << "  " << stage_name(static_cast<Stage>(n)) << ": " << time.count() << " s ("
+	   << (total.count() > 0 ? 100 * time / total : 0) << "%)" << std::endl;
+    }
+}
@@ -0,0 +1,206 @@
+#ifndef PIPELINE_STATS_HPP
+#define PIPELINE_STATS_HPP
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "row_buffer.h"
+#include "clinical_code.h"
+
+/// The stages of making the dataset that are timed separately
+enum class Stage : std::size_t {
+    Other,    ///< Anything not in another stage
+    Query,    ///< Executing the query (or opening the extract)
+    Fetch,    ///< Fetching rows from the database or extract
+    Convert,  ///< Reading Varchar/Integer/Timestamp values from a row (only
+              ///< timed if asked for, see TimedRowBuffer)
+    Parse,    ///< Parsing clinical codes (only timed if asked for, see
+              ///< timed_parse in episode.h)
+    Assemble, ///< Making patients, spells and episodes from the rows
+    Index,    ///< Finding index spells and computing each record
+    Append,   ///< Appending records to the output (and checkpointing)
+    Records,  ///< Encoding and queueing the saved records
+    Count     ///< Number of stages (not a stage)
+};
+
+/// The name of a stage, used in the R list and the JSON output
+const char * stage_name(Stage stage);
+
+/**
+ * \brief Splits the elapsed time between the stages of the pipeline
+ *
+ * There is always one current stage, which is charged with the time
+ * until the next call to enter(). This means that nested stages are
+ * not counted twice: time spent parsing inside patient assembly is
+ * counted as parsing only, and the stage times add up to the total.
+ * Each change of stage costs one clock read. Use ScopedStage to
+ * return to the previous stage at the end of a block.
+ */
+class StageClock {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    StageClock() : last_{Clock::now()} {}
+
+    /// Charge the time since the last change to the current stage,
+    /// and make stage current. Returns the previous stage.
+    Stage enter(Stage stage) {
+	auto now{Clock::now()};
+	times_[index(current_)] += now - last_;
+	last_ = now;
+	return std::exchange(current_, stage);
+    }
+
+    /// Add the stage times of another clock to this one
+    void add(const StageClock & other) {
+	for (std::size_t n{0}; n < times_.size(); n++) {
+	    times_[n] += other.times_[n];
+	}
+    }
+
+    /// The time charged to a stage so far (not counting the time
+    /// since the last change, if it is the current stage)
+    std::chrono::duration<double> time(Stage stage) const {
+	return times_[index(stage)];
+    }
+
+private:
+    static std::size_t index(Stage stage) {
+	return static_cast<std::size_t>(stage);
+    }
+
+    std::array<Clock::duration, static_cast<std::size_t>(Stage::Count)> times_{};
+    Stage current_{Stage::Other};
+    Clock::time_point last_;
+};
+
+/// Enter a stage for the lifetime of this object, and then return
+/// to the previous stage. Does nothing if the clock is null.
+class ScopedStage {
+public:
+    ScopedStage(StageClock * clock, Stage stage)
+	: clock_{clock} {
+	if (clock_ != nullptr) {
+	    previous_ = clock_->enter(stage);
+	}
+    }
+
+    ~ScopedStage() {
+	if (clock_ != nullptr) {
+	    clock_->enter(previous_);
+	}
+    }
+
+    ScopedStage(const ScopedStage &) = delete;
+    ScopedStage & operator=(const ScopedStage &) = delete;
+
+private:
+    StageClock * clock_;
+    Stage previous_{Stage::Other};
+};
+
+/**
+ * \brief Times the fetches and reads of another row buffer
+ *
+ * Wraps a reference to a row buffer. Fetching the next row is
+ * charged to Stage::Fetch, and the number of rows read is counted.
+ * Reading a value from the row is only charged to Stage::Convert if
+ * time_values is true, because that costs two clock reads for every
+ * value (many times the cost of the conversion itself). Otherwise, it
+ * is charged to the current stage (patient assembly, in the pipeline).
+ */
+template<RowBuffer R>
+class TimedRowBuffer {
+public:
+    TimedRowBuffer(R & row, StageClock & clock, bool time_values = false)
+	: row_{row}, clock_{clock}, time_values_{time_values},
+	  rows_read_{row.end() ? 0u : 1u} {}
+
+    template<typename T>
+    T at(const std::string & column_name) const {
+	if (not time_values_) {
+	    return row_.template at<T>(column_name);
+	}
+	ScopedStage stage{&clock_, Stage::Convert};
+	return row_.template at<T>(column_name);
+    }
+
+    void fetch_next_row() {
+	if (not try_fetch_next_row()) {
+	    throw RowBufferException::NoMoreRows{};
+	}
+    }
+
+    bool try_fetch_next_row() {
+	ScopedStage stage{&clock_, Stage::Fetch};
+	auto fetched{row_.try_fetch_next_row()};
+	if (fetched) {
+	    rows_read_++;
+	}
+	return fetched;
+    }
+
+    bool end() const {
+	return row_.end();
+    }
+
+    auto current_row_number() const {
+	return row_.current_row_number();
+    }
+
+    /// The number of rows read, including the current row of the
+    /// underlying buffer when this object was made
+    std::size_t rows_read() const {
+	return rows_read_;
+    }
+
+private:
+    R & row_;
+    StageClock & clock_;
+    bool time_values_;
+    std::size_t rows_read_;
+};
+
+/// The largest resident set size of this process so far, in bytes
+/// (zero if it is not available on this platform)
+std::size_t peak_rss_bytes();
+
+/// The stage times and counters of one make_acs_dataset run
+struct PipelineStats {
+    StageClock clock;
+    std::size_t rows{0};
+    std::size_t patients{0};
+    std::size_t index_records{0};
+    ParseCounts procedures;
+    ParseCounts diagnoses;
+    std::size_t peak_rss{0};
+
+    /// Add the times and counters of a run over another part of the
+    /// rows (the stage times of runs in parallel add up to more than
+    /// the elapsed time). The peak memory is the larger of the two.
+    void add(const PipelineStats & other) {
+	clock.add(other.clock);
+	rows += other.rows;
+	patients += other.patients;
+	index_records += other.index_records;
+	procedures.add(other.procedures);
+	diagnoses.add(other.diagnoses);
+	peak_rss = std::max(peak_rss, other.peak_rss);
+    }
+
+    /// The named counters, in the order they are reported
+    std::vector<std::pair<std::string, double>> counters() const;
+
+    /// Write the stage times (in seconds) and counters as JSON
+    void write_json(std::ostream & os) const;
+
+    /// Print the time and share of the run spent in each stage
+    void print_stage_times(std::ostream & os) const;
+};
+
+#endif
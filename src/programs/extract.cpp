@@ -0,0 +1,378 @@
+/**
+ * \file extract.cpp
+ * \brief Make the ACS dataset without R
+ *
+ * rdb-extract reads the same config file as make_acs_dataset and runs
+ * the same pipeline (AcsDataset), then writes the table to a result
+ * file (see result_file.h), which read_result_file() in the R package
+ * reads back. It can be run from cron or a batch scheduler.
+ *
+ * The rows are split into partitions, and a pool of worker threads
+ * processes one partition at a time. Each worker has its own copy of
+ * the config (yaml-cpp nodes share memory, and even reading one is not
+ * thread-safe), its own parser and string lookup, and each partition
+ * its own AcsDataset. Partitions hold whole patients:
+ *
+ * - database (extract mode none): each partition runs the query on
+ *   its own connection, restricted to nhs_number % partitions equal
+ *   to the partition number (a result_limit applies to each one). The
+ *   partition numbers are parameters, so all the partitions run the
+ *   same prepared query. With separate_mortality, the mortality table
+ *   is read once, before the workers start. Each worker's lookup
+ *   starts as a copy of the one the table was read with, so the
+ *   codes in the table have the same ids for every worker
+ * - extract mode read: each partition reads a range of row groups
+ * - synthetic rows: each partition makes a range of the patients
+ *
+ * With a sample block in the config file, the database query only
+ * returns the sampled patients, and the other sources skip the rest
+ * (see patient_sample.h). The database query also only returns the
+ * spells near the index_event date range (see
+ * AcsDataset::spell_date_range).
+ *
+ * The tables of the partitions are appended in partition order, so
+ * with more than one partition the rows from the database are not in
+ * nhs_number order. The stage times in the stats add up over the
+ * workers. Checkpoints, saving records and writing an extract are
+ * only done by make_acs_dataset. With patient_arena set, each
+ * partition reads its patients through its own arena.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <vector>
+#include <string>
+#include <optional>
+
+#include "config.h"
+#include "clinical_code.h"
+#include "patient.h"
+#include "acs_dataset.h"
+#include "pipeline_stats.h"
+#include "result_file.h"
+#include "patient_sample.h"
+#include "extract.h"
+#include "synthetic_row_buffer.h"
+#include "trace.h"
+#include "sql_query.h"
+#include "sql_connection.h"
+
+#include "cmdline/cmdline.hpp"
+
+namespace {
+
+/// The rows of one partition
+using PartitionRowBuffer = VariantRowBuffer<SqlRowBuffer, ExtractRowBuffer, SyntheticRowBuffer>;
+
+/// Where the rows come from, and how they are split into partitions
+class RowSource {
+public:
+    /// Read the source from the config. The other members that take
+    /// a config need the same settings (for example, a worker's copy).
+    RowSource(const YAML::Node & config, std::size_t num_partitions)
+	: num_partitions_{num_partitions},
+	  sample_{read_sample_config(config)} {
+
+	if (config["synthetic"] and config["synthetic"]["enabled"]
+	    and config["synthetic"]["enabled"].as<bool>()) {
+	    synthetic_ = read_synthetic_config(config);
+	    return;
+	}
+
+	std::string mode{"none"};
+	if (config["extract"] and config["extract"]["mode"]) {
+	    mode = config["extract"]["mode"].as<std::string>();
+	}
+	if (mode == "read") {
+	    extract_file_ = "gendata/extract.rdbx";
+	    if (config["extract"]["file"]) {
+		extract_file_ = config["extract"]["file"].as<std::string>();
+	    }
+	    num_row_groups_ = ExtractRowBuffer{extract_file_.value()}.row_groups().size();
+	} else if (mode == "write") {
+	    throw std::runtime_error("rdb-extract does not write extracts (use make_acs_dataset)");
+	} else if (mode != "none") {
+	    throw std::runtime_error("Unknown extract mode '" + mode
+				     + "' (expected none, write or read)");
+	}
+	separate_mortality_ = ::separate_mortality(config["sql_query"]);
+    }
+
+    /// Open the rows of a partition (from 0 to num_partitions - 1). The
+    /// database only returns the spells starting in spell_dates (see
+    /// AcsDataset::spell_date_range).
+    PartitionRowBuffer open(const YAML::Node & config, std::size_t partition,
+			    std::shared_ptr<ClinicalCodeParser> parser,
+			    const std::pair<std::optional<Timestamp>,
+			    std::optional<Timestamp>> & spell_dates) const {
+	if (synthetic_) {
+	    auto synthetic{synthetic_.value()};
+	    auto [first, end] = split(synthetic_->num_patients, partition);
+	    synthetic.first_patient += first;
+	    synthetic.num_patients = end - first;
+	    return SyntheticRowBuffer{synthetic, parser};
+	}
+	if (extract_file_) {
+	    auto [first, end] = split(num_row_groups_, partition);
+	    return ExtractRowBuffer{extract_file_.value(), first, end};
+	}
+	std::optional<std::string> condition;
+	std::vector<SqlParameter> parameters;
+	if (num_partitions_ > 1) {
+	    condition = "cast(nhs_number as bigint) % ? = ?";
+	    parameters = {static_cast<long long>(num_partitions_),
+			  static_cast<long long>(partition)};
+	}
+	if (sample_) {
+	    add_condition(condition, sample_->sql_condition("nhs_number"));
+	}
+	add_spell_date_range(condition, parameters, spell_dates.first, spell_dates.second);
+	auto sql_query{make_acs_sql_query(config["sql_query"], not separate_mortality(),
+					  false, condition)};
+	auto sql_connection{new_sql_connection(config["connection"])};
+	auto row{sql_connection.execute_prepared(sql_query, parameters)};
+	unpack_code_columns(row, config["sql_query"]);
+	return row;
+    }
+
+    /// Whether the partitions come from the database without the
+    /// mortality columns, which are read with read_mortality() instead
+    bool separate_mortality() const {
+	return not synthetic_ and not extract_file_ and separate_mortality_;
+    }
+
+    /// Read the mortality table (see MortalityTable)
+    MortalityTable read_mortality(const YAML::Node & config,
+				  std::shared_ptr<ClinicalCodeParser> parser) const {
+	auto sql_connection{new_sql_connection(config["connection"])};
+	auto row{sql_connection.execute_direct(make_mortality_sql_query())};
+	return MortalityTable{row, parser};
+    }
+
+    /// The sample of the patients to use, if any
+    const std::optional<PatientSample> & sample() const {
+	return sample_;
+    }
+
+    /// The source, for the log
+    std::string name() const {
+	if (synthetic_) {
+	    return std::to_string(synthetic_->num_patients) + " synthetic patients";
+	} else if (extract_file_) {
+	    return "extract " + extract_file_.value() + " (" + std::to_string(num_row_groups_)
+		+ " row groups)";
+	}
+	return "the database";
+    }
+
+private:
+    /// The range [first, end) of the partition's share of size items
+    std::pair<std::size_t, std::size_t> split(std::size_t size, std::size_t partition) const {
+	return {size * partition / num_partitions_, size * (partition + 1) / num_partitions_};
+    }
+
+    std::size_t num_partitions_;
+    std::optional<SyntheticConfig> synthetic_;
+    std::optional<std::string> extract_file_;
+    std::size_t num_row_groups_{0};
+    std::optional<PatientSample> sample_;
+    bool separate_mortality_{false};
+};
+
+/// The table and stats made from one partition
+struct PartitionResult {
+    std::optional<ResultTable> table;
+    PipelineStats stats;
+};
+
+/// Run the pipeline over the rows of one partition
+void run_partition(const YAML::Node & config, const RowSource & source, std::size_t partition,
+		   std::shared_ptr<ClinicalCodeParser> parser,
+		   std::shared_ptr<StringLookup> lookup, const MortalityTable * mortality,
+		   PartitionResult & result) {
+    auto & stats{result.stats};
+    AcsDataset dataset{config, parser, lookup, std::cout};
+    if (config["time_parsing"] and config["time_parsing"].as<bool>()) {
+	parser->set_stage_clock(&stats.clock);
+    }
+    auto procedures_before{parser->parse_counts(CodeType::Procedure)};
+    auto diagnoses_before{parser->parse_counts(CodeType::Diagnosis)};
+
+    stats.clock.enter(Stage::Query);
+    auto row{source.open(config, partition, parser, dataset.spell_date_range())};
+    stats.clock.enter(Stage::Assemble);
+    TimedRowBuffer timed_row{row, stats.clock,
+			     config["time_conversion"] and config["time_conversion"].as<bool>()};
+    PatientArena arena{config["patient_arena"] and config["patient_arena"].as<bool>()};
+    for (auto & patient : patients(timed_row, parser, dataset.decode_mode(), &arena,
+				   mortality)) {
+	if (source.sample() and not source.sample()->contains(patient.nhs_number())) {
+	    continue;
+	}
+	dataset.add_patient(patient, stats, nullptr);
+    }
+    stats.clock.enter(Stage::Other);
+    parser->set_stage_clock(nullptr);
+
+    // The parser is shared by the partitions of one worker, so only
+    // the parses since the start of this partition are counted
+    auto procedures{parser->parse_counts(CodeType::Procedure)};
+    auto diagnoses{parser->parse_counts(CodeType::Diagnosis)};
+    stats.procedures = {procedures.cache_hits - procedures_before.cache_hits,
+			procedures.cache_misses - procedures_before.cache_misses,
+			procedures.invalid - procedures_before.invalid};
+    stats.diagnoses = {diagnoses.cache_hits - diagnoses_before.cache_hits,
+		       diagnoses.cache_misses - diagnoses_before.cache_misses,
+		       diagnoses.invalid - diagnoses_before.invalid};
+    stats.rows = timed_row.rows_read();
+    result.table.emplace(std::move(dataset.table()));
+}
+
+}
+
+int main(int argc, char ** argv) {
+
+    CommandLine cmd;
+
+    const std::string program_name{ "rdb-extract" };
+    const std::string version{ "v0.1.0" };
+    const std::string short_desc{"Make the ACS dataset without R"};
+    const std::string long_desc{R"xyz(rdb-extract makes the ACS dataset from the database, a local extract or synthetic rows (as set in the config file, like make_acs_dataset), using a pool of worker threads, and writes it to a columnar result file. Read the file in R with read_result_file().)xyz"};
+
+    cmd.addOption<std::string>('c', "config",
+			       "The config file (default: ../../scripts/config.yaml)");
+    cmd.addOption<std::string>('o', "output",
+			       "The result file to write (default: acs_dataset.rdbt)");
+    cmd.addOption<std::size_t>('t', "threads",
+			       "The number of worker threads (default: the number of cores)");
+    cmd.addOption<std::size_t>('p', "partitions",
+			       "The number of partitions of the rows (default: the number of "
+			       "threads for the database, and four per thread otherwise)");
+
+    if(cmd.parse(argc, argv) != 0) {
+	std::cerr << "An error occurred while parsing the command line arguments"
+		  << std::endl;
+	return 1;
+    }
+
+    try {
+	auto config{load_config_file(cmd.get<std::string>('c').value_or("../../scripts/config.yaml"))};
+	auto output_path{cmd.get<std::string>('o').value_or("acs_dataset.rdbt")};
+	auto num_threads{cmd.get<std::size_t>('t').value_or(std::max(1u, std::thread::hardware_concurrency()))};
+	num_threads = std::max<std::size_t>(num_threads, 1);
+
+	// Each partition from the database is a separate query, so there
+	// are only as many as there are threads by default
+	auto from_database{not (config["synthetic"] and config["synthetic"]["enabled"]
+				and config["synthetic"]["enabled"].as<bool>())
+			   and not (config["extract"] and config["extract"]["mode"]
+				    and config["extract"]["mode"].as<std::string>() == "read")};
+	auto num_partitions{cmd.get<std::size_t>('p').value_or(from_database ? num_threads
+							       : 4 * num_threads)};
+	num_partitions = std::max<std::size_t>(num_partitions, 1);
+	num_threads = std::min(num_threads, num_partitions);
+
+	if (config["save_records"] and config["save_records"].as<bool>()) {
+	    std::cout << "Not saving records (only make_acs_dataset saves them)" << std::endl;
+	}
+
+	RowSource source{config, num_partitions};
+	std::cout << "Reading " << source.name() << " in " << num_partitions
+		  << " partitions with " << num_threads << " threads" << std::endl;
+
+	clear_trace();
+	auto start{std::chrono::steady_clock::now()};
+
+	// The mortality table is shared by the workers. Its codes are in
+	// lookup, which each worker copies before adding its own strings.
+	auto lookup{new_string_lookup()};
+	std::optional<MortalityTable> mortality;
+	if (source.separate_mortality()) {
+	    auto parser{new_clinical_code_parser(config["parser"], lookup)};
+	    mortality.emplace(source.read_mortality(config, parser));
+	    std::cout << "Read " << mortality->size() << " mortality records" << std::endl;
+	}
+
+	// Every worker gets its own copy of the config, made here
+	std::vector<YAML::Node> worker_configs;
+	for (std::size_t w{0}; w < num_threads; w++) {
+	    worker_configs.push_back(YAML::Clone(config));
+	}
+
+	std::vector<PartitionResult> results(num_partitions);
+	std::vector<std::exception_ptr> errors(num_threads);
+	std::atomic<std::size_t> next_partition{0};
+	std::mutex log_mutex;
+	{
+	    std::vector<std::jthread> workers;
+	    for (std::size_t w{0}; w < num_threads; w++) {
+		workers.emplace_back([&, w] {
+		    try {
+			const auto & worker_config{worker_configs[w]};
+			auto worker_lookup{std::make_shared<StringLookup>(*lookup)};
+			auto parser{new_clinical_code_parser(worker_config["parser"],
+							     worker_lookup)};
+			for (auto partition{next_partition++}; partition < num_partitions;
+			     partition = next_partition++) {
+			    run_partition(worker_config, source, partition, parser, worker_lookup,
+					  mortality ? &mortality.value() : nullptr,
+					  results[partition]);
+			    std::lock_guard lock{log_mutex};
+			    std::cout << "Finished partition " << partition << " ("
+				      << results[partition].stats.rows << " rows, "
+				      << results[partition].table->num_rows() << " index records)"
+				      << std::endl;
+			}
+		    } catch (...) {
+			errors[w] = std::current_exception();
+			// Stop the other workers taking more partitions
+			next_partition = num_partitions;
+		    }
+		});
+	    }
+	}
+	for (const auto & error : errors) {
+	    if (error) {
+		std::rethrow_exception(error);
+	    }
+	}
+
+	PipelineStats stats;
+	ResultTable table{std::move(results[0].table.value())};
+	stats.add(results[0].stats);
+	for (std::size_t p{1}; p < num_partitions; p++) {
+	    ScopedStage append_stage{&stats.clock, Stage::Append};
+	    table.append(results[p].table.value());
+	    results[p].table.reset();
+	    stats.add(results[p].stats);
+	}
+	std::chrono::duration<double> elapsed{std::chrono::steady_clock::now() - start};
+	std::cout << "Processed all patients in " << elapsed.count() << " s" << std::endl;
+
+	write_result_file(output_path, table);
+	std::cout << "Saved " << table.num_rows() << " rows to " << output_path << std::endl;
+
+	stats.peak_rss = peak_rss_bytes();
+	stats.print_stage_times(std::cout);
+	if (config["stats_file"]) {
+	    auto stats_file{config["stats_file"].as<std::string>()};
+	    std::ofstream stats_json{stats_file};
+	    stats.write_json(stats_json);
+	    std::cout << "Saved run statistics to " << stats_file << std::endl;
+	}
+	if (config["trace_file"] and tracing_enabled) {
+	    auto trace_file{config["trace_file"].as<std::string>()};
+	    std::ofstream trace{trace_file};
+	    write_chrome_trace(trace);
+	    std::cout << "Saved the trace to " << trace_file << std::endl;
+	}
+    } catch (const std::exception & e) {
+	std::cerr << "Failed with error: " << e.what() << std::endl;
+	return 1;
+    }
+}
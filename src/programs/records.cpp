@@ -0,0 +1,46 @@
+#include <iostream>
+#include <fstream>
+
+#include "record_sink.h"
+
+#include "cmdline/cmdline.hpp"
+
+int main(int argc, char ** argv) {
+
+    CommandLine cmd;
+
+    const std::string program_name{ "records" };
+    const std::string version{ "v0.1.0" };
+    const std::string short_desc{"A program for reading saved ACS/PCI records"};
+    const std::string long_desc{R"xyz(records converts the binary records file written by make_acs_dataset (when save_records is true) into YAML.)xyz"};
+
+    cmd.addOption<std::string>('i', "input",
+			       "The binary records file (e.g. gendata/records.bin)");
+    cmd.addOption<std::string>('o', "output",
+			       "The YAML file to write (default: standard output)");
+
+    if(cmd.parse(argc, argv) != 0) {
+	std::cerr << "An error occurred while parsing the command line arguments"
+		  << std::endl;
+	return 1;
+    }
+
+    auto input{cmd.get<std::string>('i')};
+    if (not input) {
+	std::cerr << "Missing the input records file (--input)" << std::endl;
+	return 1;
+    }
+    
+    try {
+	auto output_path{cmd.get<std::string>('o')};
+	if (output_path) {
+	    std::ofstream output{output_path.value()};
+	    records_to_yaml(input.value(), output);
+	} else {
+	    records_to_yaml(input.value(), std::cout);
+	}
+    } catch (const std::runtime_error & e) {
+	std::cerr << "Failed with error: " << e.what() << std::endl;
+	return 1;
+    }
+}
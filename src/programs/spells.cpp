@@ -3,14 +3,40 @@
 #include "clinical_code.h"
 #include "episode.h"
 #include "episode_row.h"
-#include "spell_rows.h"
 #include "spell.h"
 #include "config.h"
 #include "sql_query.h"
 #include "sql_connection.h"
+#include "patient_store.h"
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <charconv>
+#include <optional>
 
 #include "cmdline/cmdline.hpp"
 
+/// Print the spells of a patient, in order of start date
+void print_spells(std::vector<Spell> spells, std::shared_ptr<StringLookup> lookup) {
+    std::ranges::sort(spells, {}, [](const auto & spell) { return spell.start_date(); });
+    for (const auto & spell : spells) {
+	    spell.print(std::cout, lookup);
+	    std::cout << std::endl;
+    }
+}
+
+/// Parse a pseudo-NHS number, which must be all digits (returns
+/// nullopt for anything else, including trailing characters)
+std::optional<unsigned long long> parse_nhs_number(const std::string & text) {
+    unsigned long long nhs_number{0};
+    auto end{text.data() + text.size()};
+    auto [ptr, error] = std::from_chars(text.data(), end, nhs_number);
+    if (text.empty() or error != std::errc{} or ptr != end) {
+	return std::nullopt;
+    }
+    return nhs_number;
+}
+
 int main(int argc, char ** argv) {
 
     CommandLine cmd;
@@ -18,10 +44,17 @@ int main(int argc, char ** argv) {
     const std::string program_name{ "spells" };
     const std::string version{ "v0.1.0" };
     const std::string short_desc{"A program for getting patient spells"};
-    const std::string long_desc{R"xyz(spells is a program for reading a HES table and returning readable information about patient episodes and spells.)xyz"};
+    const std::string long_desc{R"xyz(spells is a program for reading a HES table and returning readable information about patient episodes and spells. With --store, the patients are read from the local patient store (see patient_store.h), which is rebuilt from the extract when the extract is newer, instead of the database. With more than one patient, the NHS numbers are loaded into a temp table and all the patients are fetched from the database in one query.)xyz"};
     
     cmd.addOption<std::string>('n', "nhs-number",
-			       "The pseudo-NHS number of the patient to search");
+			       "The pseudo-NHS number of the patient to search "
+			       "(or a comma-separated list of them)");
+    cmd.addOption<std::string>('f', "file",
+			       "A file of pseudo-NHS numbers to search, one per line");
+    cmd.addOption<bool>('s', "store",
+			"Read the patients from the local patient store");
+    cmd.addOption<bool>('r', "rebuild",
+			"Rebuild the patient store from the extract first");
 
     if(cmd.parse(argc, argv) != 0) {
 	std::cerr << "An error occurred while parsing the command line arguments"
@@ -29,38 +62,111 @@ int main(int argc, char ** argv) {
 	return 1;
     }
 
-    auto nhs_number{cmd.get<std::string>('n')};
+    // An entry that is not a number is reported and left out
+    std::vector<std::string> nhs_numbers;
+    std::size_t num_entries{0};
+    auto add_nhs_number = [&](const std::string & nhs_number) {
+	num_entries++;
+	if (parse_nhs_number(nhs_number)) {
+	    nhs_numbers.push_back(nhs_number);
+	} else {
+	    std::cerr << "Skipping '" << nhs_number << "': not a valid NHS number" << std::endl;
+	}
+    };
+    std::stringstream nhs_number_list{cmd.get<std::string>('n').value_or("")};
+    for (std::string nhs_number; std::getline(nhs_number_list, nhs_number, ',');) {
+	add_nhs_number(nhs_number);
+    }
+    if (auto file_path{cmd.get<std::string>('f')}) {
+	std::ifstream file{*file_path};
+	if (not file) {
+	    std::cerr << "Could not open " << *file_path << std::endl;
+	    return 1;
+	}
+	for (std::string nhs_number; std::getline(file, nhs_number);) {
+	    if (not nhs_number.empty()) {
+		add_nhs_number(nhs_number);
+	    }
+	}
+    }
 
-    auto lookup{new_string_lookup()};
-    auto config{load_config_file("../../scripts/config.yaml")};
-    auto parser{new_clinical_code_parser(config["parser"], lookup)};
-    auto sql_connection{new_sql_connection(config["connection"])};
-    auto sql_query{make_acs_sql_query(config["sql_query"], false, nhs_number)};
+    // Without any valid numbers, the query below would fetch everyone
+    if (num_entries > 0 and nhs_numbers.empty()) {
+	std::cerr << "None of the NHS numbers are valid" << std::endl;
+	return 1;
+    }
 
-    std::cout << sql_query << std::endl;
+    try {
+	auto lookup{new_string_lookup()};
+	auto config{load_config_file("../../scripts/config.yaml")};
+	auto parser{new_clinical_code_parser(config["parser"], lookup)};
 
-    auto row{sql_connection.execute_direct(sql_query)};
-    std::vector<Spell> spells;
-    
-    while (true) {
-	try {
-	    spells.push_back(Spell{row, parser});
-	} catch (const RowBufferException::NoMoreRows &) {
-	    std::cout << "Finished fetching all rows" << std::endl;
-	    break;
+	if (cmd.get<bool>('s').value_or(false) or cmd.get<bool>('r').value_or(false)) {
+	    std::string extract_path{"gendata/extract.rdbx"};
+	    std::string store_path{"gendata/patients.rdbp"};
+	    if (config["extract"] and config["extract"]["file"]) {
+		extract_path = config["extract"]["file"].as<std::string>();
+	    }
+	    if (config["extract"] and config["extract"]["store"]) {
+		store_path = config["extract"]["store"].as<std::string>();
+	    }
+	    if (cmd.get<bool>('r').value_or(false)) {
+		std::filesystem::remove(patient_store_index_path(store_path));
+	    }
+	    auto store{open_patient_store(store_path, extract_path, std::cout)};
+	    for (const auto & nhs_number : nhs_numbers) {
+		auto patient{store.find(*parse_nhs_number(nhs_number), parser)};
+		if (not patient) {
+		    std::cout << "Patient " << nhs_number << " is not in the store" << std::endl;
+		    continue;
+		}
+		patient->mortality().print(std::cout, lookup);
+		print_spells({patient->spells().begin(), patient->spells().end()}, lookup);
+	    }
+	    return 0;
 	}
-    }
 
-    struct {
-	bool operator()(const Spell & a, const Spell & b) const {
-	    return a.start_date() < b.start_date();
+	auto sql_connection{new_sql_connection(config["connection"])};
+
+	// More than one patient are fetched in one query, by loading their
+	// NHS numbers into a temp table that the query selects on
+	if (nhs_numbers.size() > 1) {
+	    sql_connection.load_temp_table(patient_batch_table, "nhs_number", nhs_numbers);
+	    auto sql_query{make_acs_batch_sql_query(config["sql_query"], true)};
+	    std::cout << sql_query << std::endl;
+
+	    auto row{sql_connection.execute_direct(sql_query)};
+	    unpack_code_columns(row, config["sql_query"]);
+	    std::size_t num_patients{0};
+	    for (auto & patient : patients(row, parser)) {
+		std::cout << "Patient " << patient.nhs_number() << std::endl;
+		patient.mortality().print(std::cout, lookup);
+		print_spells({patient.spells().begin(), patient.spells().end()}, lookup);
+		num_patients++;
+	    }
+	    std::cout << "Found " << num_patients << " of " << nhs_numbers.size()
+		      << " patients" << std::endl;
+	    return 0;
 	}
-    } by_start_date;
 
-    std::ranges::sort(spells, by_start_date);
+	// Without an nhs_number, the query is not restricted to a patient.
+	// The nhs_number is the parameter of the query.
+	auto sql_query{make_acs_sql_query(config["sql_query"], false, not nhs_numbers.empty())};
+	std::vector<SqlParameter> parameters{nhs_numbers.begin(), nhs_numbers.end()};
 
-    for (const auto & spell : spells) {
-	    spell.print(std::cout, lookup);
-	    std::cout << std::endl;
+	std::cout << sql_query << std::endl;
+
+	auto row{sql_connection.execute_prepared(sql_query, parameters)};
+	unpack_code_columns(row, config["sql_query"]);
+	std::vector<Spell> spells;
+    
+	while (not row.end()) {
+	    spells.push_back(Spell{row, parser});
+	}
+	std::cout << "Finished fetching all rows" << std::endl;
+	print_spells(std::move(spells), lookup);
+    } catch (const std::exception & e) {
+	std::cerr << "Failed with error: " << e.what() << std::endl;
+	return 1;
     }
 }
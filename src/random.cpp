@@ -42,19 +42,17 @@ T Random<T, Gen>::max() const
     return upper_;
 }
 
-/// Get a random value in [lower, upper)
+/// Get a random value in [lower, upper] (integers) or [lower, upper)
+/// (real numbers)
 template<Numeric T, typename Gen>
 T Random<T, Gen>::operator() ()
 {
-    seed_t val{gen_()};
     if constexpr (std::is_integral_v<T>) {
-	auto range{upper_ + 1 - lower_};
-	return lower_ + (val % range);
+	// The size of the range, which wraps to 0 for the full 64 bits
+	auto range{static_cast<std::uint64_t>(upper_) - static_cast<std::uint64_t>(lower_) + 1};
+	return static_cast<T>(static_cast<std::uint64_t>(lower_) + uniform_below(gen_, range));
     } else {
-	// Range of gen_ integers
-	constexpr auto range{Gen::max() - Gen::min()};
-	// Generate float
-	return lower_ + gen_()/static_cast<T>(range/(upper_-lower_));
+	return lower_ + (upper_ - lower_) * uniform_real<T>(gen_);
     }
 }
 
@@ -76,3 +74,12 @@ template class Random<unsigned, std::mt19937>;
 template class Random<float, std::mt19937>;
 template class Random<double, std::mt19937>;
 template class Random<long double, std::mt19937>;
+
+template class Random<int, CounterGenerator>;
+template class Random<long int, CounterGenerator>;
+template class Random<std::size_t, CounterGenerator>;
+template class Random<unsigned, CounterGenerator>;
+
+template class Random<float, CounterGenerator>;
+template class Random<double, CounterGenerator>;
+template class Random<long double, CounterGenerator>;
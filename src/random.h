@@ -10,9 +10,10 @@
  * generating random numbers: "https://peteroupc.github.io/
  * randomfunc.html#For_Floating_Point_Number_Formats". 
  * 
- * \todo The basic real number distribution in this file should be
- * improved in accordance with the guidance here:
- * "https://peteroupc.github.io/randomfunc.html#Uniform_Random_Real_Numbers"
+ * So this file has its own unbiased range reduction (uniform_below) and
+ * real numbers (uniform_real), which give the same values on every
+ * platform, and a counter-based generator (CounterGenerator) whose
+ * streams can be made independently, for generating data in parallel.
  * 
  */
 
@@ -20,11 +21,120 @@
 #define RANDOM_HPP
 
 #include <random>
+#include <limits>
+#include <cstdint>
+#include <cmath>
 #include "seed.h"
 
 template<typename T>
 concept Numeric = std::floating_point<T> or std::integral<T>;
 
+/**
+ * \brief A counter-based random number generator (SplitMix64 style)
+ *
+ * The n-th value of a stream is a hash (the SplitMix64 finaliser) of
+ * the stream key plus n times an odd constant. There is no other
+ * state, so discard(n) is O(1), and the stream for (seed, stream) is
+ * made directly, without running through the streams before it. Use
+ * one stream per patient (or per bootstrap sample) to get the same
+ * values whatever the order or the number of threads that make them.
+ */
+class CounterGenerator {
+public:
+    using result_type = std::uint64_t;
+
+    explicit constexpr CounterGenerator(std::uint64_t seed = 0, std::uint64_t stream = 0)
+	: key_{stream_key(seed, stream)} {}
+
+    /// Start stream 0 of a new seed
+    constexpr void seed(std::uint64_t seed) {
+	*this = CounterGenerator{seed};
+    }
+
+    static constexpr result_type min() {
+	return 0;
+    }
+
+    static constexpr result_type max() {
+	return std::numeric_limits<result_type>::max();
+    }
+
+    constexpr result_type operator()() {
+	return mix(key_ + ++counter_ * gamma);
+    }
+
+    /// Skip the next n values
+    constexpr void discard(std::uint64_t n) {
+	counter_ += n;
+    }
+
+    /// The number of values made (or skipped) so far
+    constexpr std::uint64_t position() const {
+	return counter_;
+    }
+
+private:
+    static constexpr std::uint64_t gamma{0x9e3779b97f4a7c15};
+
+    static constexpr std::uint64_t mix(std::uint64_t z) {
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+	return z ^ (z >> 31);
+    }
+
+    /// The key is hashed from both numbers, so that nearby seeds and
+    /// streams give unrelated keys
+    static constexpr std::uint64_t stream_key(std::uint64_t seed, std::uint64_t stream) {
+	return mix(mix(seed + gamma) ^ mix(stream * gamma + 0xd1342543de82ef95));
+    }
+
+    std::uint64_t key_;
+    std::uint64_t counter_{0};
+};
+
+static_assert(std::uniform_random_bit_generator<CounterGenerator>);
+
+/// 64 random bits from a generator with a 32- or 64-bit range
+template<std::uniform_random_bit_generator G>
+std::uint64_t random_bits(G & gen) {
+    constexpr auto range{static_cast<std::uint64_t>(G::max() - G::min())};
+    if constexpr (range == std::numeric_limits<std::uint64_t>::max()) {
+	return static_cast<std::uint64_t>(gen() - G::min());
+    } else {
+	static_assert(range == std::numeric_limits<std::uint32_t>::max(),
+		      "random_bits needs a generator with a 32- or 64-bit range");
+	auto high{static_cast<std::uint64_t>(gen() - G::min())};
+	return (high << 32) | static_cast<std::uint64_t>(gen() - G::min());
+    }
+}
+
+/// A random number in [0, range), with every value equally likely.
+/// Values that would make the modulo biased are rejected (fewer than
+/// one in 2^32 draws for ranges below 2^32). A range of 0 means the
+/// whole 64-bit range.
+template<std::uniform_random_bit_generator G>
+std::uint64_t uniform_below(G & gen, std::uint64_t range) {
+    if (range == 0) {
+	return random_bits(gen);
+    }
+    // 2^64 mod range, the number of values to reject
+    auto threshold{(0 - range) % range};
+    while (true) {
+	auto value{random_bits(gen)};
+	if (value >= threshold) {
+	    return value % range;
+	}
+    }
+}
+
+/// A random real number in [0, 1), from 53 random bits
+template<std::floating_point T = double, std::uniform_random_bit_generator G>
+T uniform_real(G & gen) {
+    auto value{static_cast<T>(random_bits(gen) >> 11) * static_cast<T>(0x1.0p-53)};
+    // Rounding to a narrower type can give 1
+    return value < 1 ? value : std::nextafter(T{1}, T{0});
+}
+
 /**
  * \brief Random numbers that can be seeded or unseeded
  */
@@ -58,7 +168,8 @@ public:
     /// Get the upper end of the range
     [[nodiscard]] T max() const; 
 
-    /// Get a random value in [lower, upper)
+    /// Get a random value in [lower, upper] (integers) or [lower,
+    /// upper) (real numbers)
     [[nodiscard]] T operator() ();    
 
 private:
@@ -0,0 +1,551 @@
+#include "record_sink.h"
+#include "trace.h"
+
+#include <sstream>
+#include <string_view>
+#include <vector>
+#include <stdexcept>
+#include <yaml-cpp/yaml.h>
+
+namespace {
+
+const std::string records_magic{"RDBREC01"};
+
+void append_u32(std::string & bytes, std::uint32_t value) {
+    for (int n{0}; n < 4; n++) {
+	bytes.push_back(static_cast<char>((value >> (8*n)) & 0xff));
+    }
+}
+
+void append_u64(std::string & bytes, std::uint64_t value) {
+    for (int n{0}; n < 8; n++) {
+	bytes.push_back(static_cast<char>((value >> (8*n)) & 0xff));
+    }
+}
+
+enum CodeTag : std::uint8_t {
+    NullCode = 0,
+    InvalidCode = 1,
+    ValidCode = 2,
+};
+
+}
+
+void RecordEncoder::flag(bool value) {
+    bytes_.push_back(value ? 1 : 0);
+}
+
+void RecordEncoder::number(std::uint64_t value) {
+    append_u64(bytes_, value);
+}
+
+void RecordEncoder::string(std::string_view value) {
+    append_u32(bytes_, value.size());
+    bytes_.append(value);
+}
+
+void RecordEncoder::timestamp(const Timestamp & value) {
+    flag(value.null());
+    if (not value.null()) {
+	number(value.read());
+    }
+}
+
+void RecordEncoder::integer(const Integer & value) {
+    flag(value.null());
+    if (not value.null()) {
+	number(value.read());
+    }
+}
+
+void RecordEncoder::code(const ClinicalCode & code) {
+    if (code.invalid()) {
+	bytes_.push_back(InvalidCode);
+	number(code.name_id());
+    } else if (code.null()) {
+	bytes_.push_back(NullCode);
+    } else {
+	bytes_.push_back(ValidCode);
+	number(code.name_id());
+	number(code.docs_id());
+	number(code.group_ids().size());
+	for (const auto group_id : code.group_ids()) {
+	    number(group_id);
+	}
+    }
+}
+
+void RecordEncoder::episode(const Episode & episode) {
+    timestamp(episode.episode_start());
+    timestamp(episode.episode_end());
+    code(episode.primary_diagnosis());
+    code(episode.primary_procedure());
+    number(episode.secondary_diagnoses().size());
+    for (const auto & diagnosis : episode.secondary_diagnoses()) {
+	code(diagnosis);
+    }
+    number(episode.secondary_procedures().size());
+    for (const auto & procedure : episode.secondary_procedures()) {
+	code(procedure);
+    }
+}
+
+void RecordEncoder::spell(const Spell & spell) {
+    string(spell.id());
+    timestamp(spell.start_date());
+    timestamp(spell.end_date());
+    number(spell.episodes().size());
+    for (const auto & e : spell.episodes()) {
+	episode(e);
+    }
+}
+
+void RecordEncoder::mortality(const Mortality & mortality) {
+    flag(mortality.alive());
+    if (not mortality.alive()) {
+	timestamp(mortality.date_of_death());
+	auto cause_of_death{mortality.cause_of_death()};
+	flag(cause_of_death.has_value());
+	if (cause_of_death.has_value()) {
+	    code(cause_of_death.value());
+	}
+	integer(mortality.age_at_death());
+    }
+}
+
+void RecordEncoder::event_counts(const EventCounter & event_counter) {
+    for (const auto * counts : {&event_counter.counts_before(),
+				&event_counter.counts_after()}) {
+	number(counts->size());
+	for (const auto & [group, count] : *counts) {
+	    number(group.id());
+	    number(count);
+	}
+    }
+}
+
+RecordSink::RecordSink(const std::string & file_path, std::size_t capacity)
+    : file_{file_path, std::ios::binary}, capacity_{std::max<std::size_t>(capacity, 1)} {
+    if (not file_) {
+	throw std::runtime_error("Could not open records file " + file_path);
+    }
+    file_.write(records_magic.data(), records_magic.size());
+    writer_ = std::thread{&RecordSink::write_records, this};
+}
+
+RecordSink::~RecordSink() {
+    // Without the lookup there is no string table, so the file is left
+    // incomplete. Call close() to finish it.
+    stop_writer();
+}
+
+void RecordSink::push(std::string record) {
+    std::unique_lock lock{mutex_};
+    not_full_.wait(lock, [&] { return queue_.size() < capacity_ or error_; });
+    if (error_) {
+	std::rethrow_exception(error_);
+    }
+    queue_.push_back(std::move(record));
+    num_records_++;
+    lock.unlock();
+    not_empty_.notify_one();
+}
+
+void RecordSink::close(const StringLookup & lookup) {
+    if (closed_) {
+	return;
+    }
+    stop_writer();
+    closed_ = true;
+    if (error_) {
+	std::rethrow_exception(error_);
+    }
+
+    std::string footer;
+    append_u32(footer, 0);
+    std::uint64_t table_offset{static_cast<std::uint64_t>(file_.tellp()) + footer.size()};
+    auto strings{lookup.strings()};
+    append_u64(footer, std::ranges::distance(strings));
+    for (const auto & string : strings) {
+	append_u32(footer, string.size());
+	footer.append(string);
+    }
+    append_u64(footer, table_offset);
+    file_.write(footer.data(), footer.size());
+    file_.close();
+    if (not file_) {
+	throw std::runtime_error("Failed to finish writing the records file");
+    }
+}
+
+void RecordSink::stop_writer() {
+    if (writer_.joinable()) {
+	{
+	    std::lock_guard lock{mutex_};
+	    done_ = true;
+	}
+	not_empty_.notify_one();
+	writer_.join();
+    }
+}
+
+void RecordSink::write_records() {
+    std::string length;
+    while (true) {
+	std::unique_lock lock{mutex_};
+	not_empty_.wait(lock, [&] { return not queue_.empty() or done_; });
+	if (queue_.empty()) {
+	    return;
+	}
+	auto record{std::move(queue_.front())};
+	queue_.pop_front();
+	lock.unlock();
+	not_full_.notify_one();
+
+	RDB_TRACE_SPAN("record_write");
+	length.clear();
+	append_u32(length, record.size());
+	file_.write(length.data(), length.size());
+	file_.write(record.data(), record.size());
+	if (not file_) {
+	    lock.lock();
+	    error_ = std::make_exception_ptr(std::runtime_error("Failed to write to the records file"));
+	    queue_.clear();
+	    lock.unlock();
+	    not_full_.notify_all();
+	    return;
+	}
+    }
+}
+
+namespace {
+
+/// Reads back the fields written by RecordEncoder
+class RecordDecoder {
+public:
+    RecordDecoder(std::string_view bytes) : bytes_{bytes} {}
+
+    bool flag() {
+	return bytes(1)[0] != 0;
+    }
+
+    std::uint8_t byte() {
+	return static_cast<std::uint8_t>(bytes(1)[0]);
+    }
+
+    std::uint32_t u32() {
+	auto data{bytes(4)};
+	std::uint32_t value{0};
+	for (int n{0}; n < 4; n++) {
+	    value |= static_cast<std::uint32_t>(static_cast<unsigned char>(data[n])) << (8*n);
+	}
+	return value;
+    }
+
+    std::uint64_t number() {
+	auto data{bytes(8)};
+	std::uint64_t value{0};
+	for (int n{0}; n < 8; n++) {
+	    value |= static_cast<std::uint64_t>(static_cast<unsigned char>(data[n])) << (8*n);
+	}
+	return value;
+    }
+
+    std::string string() {
+	auto length{u32()};
+	return std::string{bytes(length)};
+    }
+
+    Timestamp timestamp() {
+	if (flag()) {
+	    return Timestamp{};
+	}
+	return Timestamp{number()};
+    }
+
+    Integer integer() {
+	if (flag()) {
+	    return Integer{};
+	}
+	return Integer{number()};
+    }
+
+    /// The next length bytes, unconverted
+    std::string_view bytes(std::size_t length) {
+	if (length > bytes_.size()) {
+	    throw std::runtime_error("Truncated record in records file");
+	}
+	auto result{bytes_.substr(0, length)};
+	bytes_.remove_prefix(length);
+	return result;
+    }
+
+private:
+    std::string_view bytes_;
+};
+
+/// Converts decoded fields to YAML, using the string table at the
+/// end of the file for the code names
+class RecordYamlWriter {
+public:
+    RecordYamlWriter(YAML::Emitter & ys, const std::vector<std::string> & strings)
+	: ys_{ys}, strings_{strings} {}
+
+    /// Write one index record as a YAML map
+    void record(RecordDecoder & record) {
+	ys_ << YAML::BeginMap
+	    << YAML::Key << "nhs_number"
+	    << YAML::Value << record.number();
+
+	auto age_at_index{record.integer()};
+	if (not age_at_index.null()) {
+	    ys_ << YAML::Key << "age_at_index"
+		<< YAML::Value << age_at_index.read();
+	}
+	auto date_of_index{record.timestamp()};
+	if (not date_of_index.null()) {
+	    ys_ << YAML::Key << "date_of_index"
+		<< YAML::Value;
+	    timestamp(date_of_index);
+	}
+	ys_ << YAML::Key << "presentation"
+	    << YAML::Value << (record.flag() ? "STEMI" : "NSTEMI");
+	ys_ << YAML::Key << "inclusion_trigger"
+	    << YAML::Value << (record.flag() ? "PCI" : "ACS");
+
+	ys_ << YAML::Key << "mortality"
+	    << YAML::Value;
+	mortality(record);
+
+	ys_ << YAML::Key << "index_spell"
+	    << YAML::Value;
+	spell(record);
+
+	spells("spells_after", record);
+	spells("spells_before", record);
+
+	ys_ << YAML::Key << "event_counts"
+	    << YAML::Value << YAML::BeginMap;
+	event_counts("before", record);
+	event_counts("after", record);
+	ys_ << YAML::EndMap;
+
+	ys_ << YAML::EndMap;
+    }
+
+private:
+    const std::string & at(std::uint64_t id) const {
+	if (id >= strings_.size()) {
+	    throw std::runtime_error("String id out of range in records file");
+	}
+	return strings_[id];
+    }
+
+    /// The unix time and a human-readable string, or null
+    void timestamp(const Timestamp & timestamp) {
+	if (timestamp.null()) {
+	    ys_ << YAML::Null;
+	    return;
+	}
+	std::stringstream ss;
+	ss << timestamp;
+	ys_ << YAML::BeginMap
+	    << YAML::Key << "timestamp"
+	    << YAML::Value << timestamp.read()
+	    << YAML::Key << "readable"
+	    << YAML::Value << ss.str()
+	    << YAML::EndMap;
+    }
+
+    /// Write a code map (name, docs and optional groups) for a
+    /// valid or invalid code. The docs of an invalid code are "Unknown"
+    void code(std::uint8_t tag, RecordDecoder & record) {
+	ys_ << YAML::BeginMap;
+	if (tag == InvalidCode) {
+	    ys_ << YAML::Key << "name"
+		<< YAML::Value << at(record.number())
+		<< YAML::Key << "docs"
+		<< YAML::Value << "Unknown";
+	} else {
+	    ys_ << YAML::Key << "name"
+		<< YAML::Value << at(record.number())
+		<< YAML::Key << "docs"
+		<< YAML::Value << at(record.number());
+	    auto num_groups{record.number()};
+	    if (num_groups > 0) {
+		ys_ << YAML::Key << "groups"
+		    << YAML::Value << YAML::BeginSeq;
+		for (std::uint64_t n{0}; n < num_groups; n++) {
+		    ys_ << at(record.number());
+		}
+		ys_ << YAML::EndSeq;
+	    }
+	}
+	ys_ << YAML::EndMap;
+    }
+
+    /// Write a key and code, unless the code is null
+    void keyed_code(const std::string & key, RecordDecoder & record) {
+	auto tag{record.byte()};
+	if (tag != NullCode) {
+	    ys_ << YAML::Key << key
+		<< YAML::Value;
+	    code(tag, record);
+	}
+    }
+
+    /// Write a key and list of codes, unless the list is empty
+    void code_list(const std::string & key, RecordDecoder & record) {
+	auto num_codes{record.number()};
+	if (num_codes > 0) {
+	    ys_ << YAML::Key << key
+		<< YAML::Value << YAML::BeginSeq;
+	    for (std::uint64_t n{0}; n < num_codes; n++) {
+		auto tag{record.byte()};
+		if (tag == NullCode) {
+		    ys_ << YAML::Null;
+		} else {
+		    code(tag, record);
+		}
+	    }
+	    ys_ << YAML::EndSeq;
+	}
+    }
+
+    void mortality(RecordDecoder & record) {
+	ys_ << YAML::BeginMap;
+	auto alive{record.flag()};
+	ys_ << YAML::Key << "alive"
+	    << YAML::Value << alive;
+	if (not alive) {
+	    auto date_of_death{record.timestamp()};
+	    if (not date_of_death.null()) {
+		ys_ << YAML::Key << "date_of_death"
+		    << YAML::Value;
+		timestamp(date_of_death);
+	    }
+	    if (record.flag()) {
+		keyed_code("cause_of_death", record);
+	    }
+	    auto age_at_death{record.integer()};
+	    if (not age_at_death.null()) {
+		ys_ << YAML::Key << "age_at_death"
+		    << YAML::Value << age_at_death.read();
+	    }
+	}
+	ys_ << YAML::EndMap;
+    }
+
+    void episode(RecordDecoder & record) {
+	ys_ << YAML::BeginMap
+	    << YAML::Key << "start_date"
+	    << YAML::Value;
+	timestamp(record.timestamp());
+	ys_ << YAML::Key << "end_date"
+	    << YAML::Value;
+	timestamp(record.timestamp());
+	keyed_code("primary_diagnosis", record);
+	keyed_code("primary_procedure", record);
+	code_list("secondary_diagnoses", record);
+	code_list("secondary_procedures", record);
+	ys_ << YAML::EndMap;
+    }
+
+    void spell(RecordDecoder & record) {
+	ys_ << YAML::BeginMap
+	    << YAML::Key << "id"
+	    << YAML::Value << record.string()
+	    << YAML::Key << "start_date"
+	    << YAML::Value;
+	timestamp(record.timestamp());
+	ys_ << YAML::Key << "end_date"
+	    << YAML::Value;
+	timestamp(record.timestamp());
+	auto num_episodes{record.number()};
+	if (num_episodes > 0) {
+	    ys_ << YAML::Key << "episodes"
+		<< YAML::Value << YAML::BeginSeq;
+	    for (std::uint64_t n{0}; n < num_episodes; n++) {
+		episode(record);
+	    }
+	    ys_ << YAML::EndSeq;
+	}
+	ys_ << YAML::EndMap;
+    }
+
+    /// Write a key and list of spells, unless the list is empty
+    void spells(const std::string & key, RecordDecoder & record) {
+	auto num_spells{record.number()};
+	if (num_spells > 0) {
+	    ys_ << YAML::Key << key
+		<< YAML::Value << YAML::BeginSeq;
+	    for (std::uint64_t n{0}; n < num_spells; n++) {
+		spell(record);
+	    }
+	    ys_ << YAML::EndSeq;
+	}
+    }
+
+    void event_counts(const std::string & key, RecordDecoder & record) {
+	auto num_groups{record.number()};
+	if (num_groups > 0) {
+	    ys_ << YAML::Key << key
+		<< YAML::Value << YAML::BeginSeq;
+	    for (std::uint64_t n{0}; n < num_groups; n++) {
+		ys_ << YAML::BeginMap
+		    << YAML::Key << "name"
+		    << YAML::Value << at(record.number())
+		    << YAML::Key << "count"
+		    << YAML::Value << record.number()
+		    << YAML::EndMap;
+	    }
+	    ys_ << YAML::EndSeq;
+	}
+    }
+
+    YAML::Emitter & ys_;
+    const std::vector<std::string> & strings_;
+};
+
+}
+
+void records_to_yaml(const std::string & records_file_path, std::ostream & os) {
+
+    std::ifstream file{records_file_path, std::ios::binary};
+    if (not file) {
+	throw std::runtime_error("Could not open records file " + records_file_path);
+    }
+    std::string contents{std::istreambuf_iterator<char>{file}, {}};
+    std::string_view bytes{contents};
+
+    if (not bytes.starts_with(records_magic) or bytes.size() < records_magic.size() + 8) {
+	throw std::runtime_error("Not a complete records file: " + records_file_path);
+    }
+
+    // The string table offset is the last 8 bytes of the file
+    RecordDecoder footer{bytes.substr(bytes.size() - 8)};
+    auto table_offset{footer.number()};
+    if (table_offset < records_magic.size() or table_offset > bytes.size() - 8) {
+	throw std::runtime_error("Bad string table offset in records file");
+    }
+    RecordDecoder table{bytes.substr(table_offset, bytes.size() - 8 - table_offset)};
+    std::vector<std::string> strings(table.number());
+    for (auto & string : strings) {
+	string = table.string();
+    }
+
+    YAML::Emitter ys;
+    RecordYamlWriter writer{ys, strings};
+    ys << YAML::BeginSeq;
+    RecordDecoder records{bytes.substr(records_magic.size(),
+				       table_offset - records_magic.size())};
+    while (auto length{records.u32()}) {
+	auto record_bytes{records.bytes(length)};
+	RecordDecoder record{record_bytes};
+	writer.record(record);
+    }
+    ys << YAML::EndSeq;
+
+    os << "# Each item in this list is an ACS/PCI record" << std::endl
+       << ys.c_str() << std::endl;
+}
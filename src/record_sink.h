@@ -0,0 +1,126 @@
+/**
+ * \file record_sink.h
+ * \brief Binary index records written by a background thread
+ *
+ * When save_records is on, each ACS/PCI index record is encoded
+ * into a compact binary blob (RecordEncoder) and handed to a
+ * RecordSink, which writes the blobs to a file from a background
+ * thread through a bounded queue. Strings (code names, docs, groups)
+ * are stored as StringLookup ids, and the strings themselves are
+ * written once at the end of the file. Use records_to_yaml() (or the
+ * records program) to convert the file to YAML for inspection.
+ *
+ * File layout (integers are little-endian):
+ *
+ * - magic "RDBREC01"
+ * - records: u32 length, then the encoded record
+ * - u32 0, marking the end of the records
+ * - string table: u64 count, then count * (u32 length, bytes)
+ * - u64 offset of the string table from the start of the file
+ */
+
+#ifndef RECORD_SINK_HPP
+#define RECORD_SINK_HPP
+
+#include <string>
+#include <string_view>
+#include <deque>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <ranges>
+#include <cstdint>
+
+#include "sql_types.h"
+#include "clinical_code.h"
+#include "episode.h"
+#include "spell.h"
+#include "mortality.h"
+#include "event_counter.h"
+
+/// Encodes one index record into a byte string. The order of the
+/// calls defines the record layout, and must match the order in
+/// which records_to_yaml() reads the fields back.
+class RecordEncoder {
+public:
+    void flag(bool value);
+    void number(std::uint64_t value);
+    void string(std::string_view value);
+    void timestamp(const Timestamp & value);
+    void integer(const Integer & value);
+    void code(const ClinicalCode & code);
+    void episode(const Episode & episode);
+    void spell(const Spell & spell);
+    void mortality(const Mortality & mortality);
+    void event_counts(const EventCounter & event_counter);
+
+    /// Write a count followed by each spell in the range
+    void spells(std::ranges::range auto && spells) {
+	number(std::ranges::distance(spells));
+	for (const auto & s : spells) {
+	    spell(s);
+	}
+    }
+
+    /// Get the encoded record, leaving the encoder empty
+    std::string release() {
+	return std::move(bytes_);
+    }
+
+private:
+    std::string bytes_;
+};
+
+/**
+ * \brief Writes encoded records to a file in a background thread
+ *
+ * push() only blocks when the queue already holds capacity records,
+ * so the extraction does not wait on the disk. Call close() at the
+ * end to write the string table; errors in the writer thread are
+ * rethrown from push() or close().
+ */
+class RecordSink {
+public:
+    RecordSink(const std::string & file_path, std::size_t capacity = 1024);
+    ~RecordSink();
+
+    RecordSink(const RecordSink &) = delete;
+    RecordSink & operator=(const RecordSink &) = delete;
+
+    /// Queue an encoded record for writing
+    void push(std::string record);
+
+    /// Write the remaining records and the string table, and close
+    /// the file. Does nothing if already closed.
+    void close(const StringLookup & lookup);
+
+    /// The number of records pushed
+    std::size_t size() const {
+	return num_records_;
+    }
+
+private:
+    void write_records();
+    void stop_writer();
+
+    std::ofstream file_;
+    std::size_t capacity_;
+    std::size_t num_records_{0};
+    std::deque<std::string> queue_;
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    bool done_{false};
+    bool closed_{false};
+    std::exception_ptr error_;
+    std::thread writer_;
+};
+
+/// Convert a binary records file written by RecordSink into a YAML
+/// list of records (the same layout as the old records.yaml). Throws
+/// runtime_error if the file is not a valid records file.
+void records_to_yaml(const std::string & records_file_path, std::ostream & os);
+
+#endif
@@ -0,0 +1,159 @@
+#include "result_file.h"
+
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+
+namespace {
+
+const std::string result_magic{"RDBTAB01"};
+
+/// The bits of R's NA_real_
+constexpr std::uint64_t na_real_bits{0x7ff00000000007a2};
+
+enum class ResultColumnType : std::uint8_t {
+    Numeric = 0,
+    Factor = 1
+};
+
+void append_uint(std::string & bytes, std::uint64_t value, std::size_t width) {
+    for (std::size_t n{0}; n < width; n++) {
+	bytes.push_back(static_cast<char>((value >> (8*n)) & 0xff));
+    }
+}
+
+void append_string(std::string & bytes, std::string_view value) {
+    append_uint(bytes, value.size(), 4);
+    bytes.append(value);
+}
+
+/// Reads fields from the bytes of a result file
+class ResultReader {
+public:
+    ResultReader(std::string_view bytes) : bytes_{bytes} {}
+
+    std::string_view bytes(std::size_t length) {
+	if (length > bytes_.size()) {
+	    throw std::runtime_error("Truncated result file");
+	}
+	auto result{bytes_.substr(0, length)};
+	bytes_.remove_prefix(length);
+	return result;
+    }
+
+    std::uint64_t uint(std::size_t width) {
+	auto data{bytes(width)};
+	std::uint64_t value{0};
+	for (std::size_t n{0}; n < width; n++) {
+	    value |= static_cast<std::uint64_t>(static_cast<unsigned char>(data[n])) << (8*n);
+	}
+	return value;
+    }
+
+    std::string string() {
+	return std::string{bytes(uint(4))};
+    }
+
+    bool empty() const {
+	return bytes_.empty();
+    }
+
+private:
+    std::string_view bytes_;
+};
+
+}
+
+void write_result_file(const std::string & file_path, const ResultTable & table) {
+    std::ofstream file{file_path, std::ios::binary};
+    if (not file) {
+	throw std::runtime_error("Failed to open result file " + file_path);
+    }
+    auto num_rows{table.num_rows()};
+    std::string bytes{result_magic};
+    append_uint(bytes, num_rows, 8);
+    append_uint(bytes, table.names().size(), 4);
+    file.write(bytes.data(), bytes.size());
+
+    // One column at a time is encoded, to keep the memory down
+    for (const auto & name : table.names()) {
+	bytes.clear();
+	if (const auto * numeric = std::get_if<NumericColumn>(&table.at(name))) {
+	    bytes.push_back(static_cast<char>(ResultColumnType::Numeric));
+	    append_string(bytes, name);
+	    for (std::size_t n{0}; n < num_rows; n++) {
+		auto value{(*numeric)[n]};
+		append_uint(bytes, std::isnan(value) ? na_real_bits : std::bit_cast<std::uint64_t>(value), 8);
+	    }
+	} else {
+	    const auto & factor{std::get<FactorColumn>(table.at(name))};
+	    bytes.push_back(static_cast<char>(ResultColumnType::Factor));
+	    append_string(bytes, name);
+	    auto levels{factor.levels()};
+	    append_uint(bytes, std::ranges::distance(levels), 4);
+	    for (const auto & level : levels) {
+		append_string(bytes, level);
+	    }
+	    for (std::size_t n{0}; n < num_rows; n++) {
+		append_uint(bytes, static_cast<std::uint32_t>(factor.codes()[n]), 4);
+	    }
+	}
+	file.write(bytes.data(), bytes.size());
+    }
+    file.close();
+    if (not file) {
+	throw std::runtime_error("Failed to write result file " + file_path);
+    }
+}
+
+ResultTable read_result_file(const std::string & file_path) {
+    std::ifstream file{file_path, std::ios::binary};
+    if (not file) {
+	throw std::runtime_error("Failed to open result file " + file_path);
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    auto bytes{contents.str()};
+
+    ResultReader reader{bytes};
+    if (reader.bytes(result_magic.size()) != result_magic) {
+	throw std::runtime_error("Not a result file: " + file_path);
+    }
+    auto num_rows{reader.uint(8)};
+    auto num_columns{reader.uint(4)};
+    ResultTable table;
+    for (std::size_t c{0}; c < num_columns; c++) {
+	auto type{reader.uint(1)};
+	auto name{reader.string()};
+	if (type == static_cast<std::uint64_t>(ResultColumnType::Numeric)) {
+	    auto & numeric{table.numeric(name)};
+	    numeric.reserve(num_rows);
+	    for (std::size_t n{0}; n < num_rows; n++) {
+		numeric.push_back(std::bit_cast<double>(reader.uint(8)));
+	    }
+	} else if (type == static_cast<std::uint64_t>(ResultColumnType::Factor)) {
+	    std::vector<std::string> levels(reader.uint(4));
+	    for (auto & level : levels) {
+		level = reader.string();
+	    }
+	    auto & factor{table.factor(name)};
+	    for (std::size_t n{0}; n < num_rows; n++) {
+		auto code{reader.uint(4)};
+		if (code == 0 or code > levels.size()) {
+		    throw std::runtime_error("Level number out of range in result file");
+		}
+		factor.push_back(levels[code - 1]);
+	    }
+	} else {
+	    throw std::runtime_error("Bad column type in result file");
+	}
+    }
+    if (not reader.empty()) {
+	throw std::runtime_error("Unexpected data at the end of result file " + file_path);
+    }
+    return table;
+}
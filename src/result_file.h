@@ -0,0 +1,39 @@
+#ifndef RESULT_FILE_HPP
+#define RESULT_FILE_HPP
+
+/**
+ * \file result_file.h
+ * \brief A columnar file of the columns of a ResultTable
+ *
+ * This is the output of rdb-extract. Each column is stored in one
+ * piece, so a reader (for example read_result_file() in the R
+ * package) can read a whole column at once, and columns it does not
+ * need can be skipped.
+ *
+ * File layout (integers are little-endian):
+ *
+ * - magic "RDBTAB01"
+ * - u64 number of rows, u32 number of columns
+ * - each column: u8 type (0 numeric, 1 factor), string name, then
+ *   - numeric: a float64 for each row. NaN is written as R's NA_real_
+ *     (a NaN with payload 1954), so R reads missing values as NA.
+ *   - factor: u32 number of levels, each level (a string), then an
+ *     i32 level number (from 1, as in R) for each row
+ *
+ * Strings are a u32 length followed by the bytes.
+ */
+
+#include <string>
+
+#include "result_table.h"
+
+/// Write the table to a file. Throws std::runtime_error if the
+/// file cannot be written.
+void write_result_file(const std::string & file_path, const ResultTable & table);
+
+/// Read a table written by write_result_file(). Throws
+/// std::runtime_error if the file cannot be read or is not a
+/// complete result file.
+ResultTable read_result_file(const std::string & file_path);
+
+#endif
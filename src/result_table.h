@@ -0,0 +1,155 @@
+#ifndef RESULT_TABLE_HPP
+#define RESULT_TABLE_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <variant>
+#include <stdexcept>
+#include <algorithm>
+
+#include "string_lookup.h"
+
+/// A column of strings stored as level numbers (like an R factor,
+/// the levels are numbered from 1 in order of first appearance)
+class FactorColumn {
+public:
+    void push_back(const std::string & value) {
+	codes_.push_back(static_cast<int>(lookup_.insert_string(value)) + 1);
+    }
+
+    /// The level numbers, one per row
+    const auto & codes() const {
+	return codes_;
+    }
+
+    /// Move the level numbers out (the column is left empty)
+    std::vector<int> take_codes() {
+	return std::move(codes_);
+    }
+
+    /// The level strings, in order of level number
+    auto levels() const {
+	return lookup_.strings();
+    }
+
+    /// Append the rows of another column (with its own levels)
+    void append(const FactorColumn & other) {
+	std::vector<int> level_codes;
+	for (const auto & level : other.levels()) {
+	    level_codes.push_back(static_cast<int>(lookup_.insert_string(level)) + 1);
+	}
+	for (auto code : other.codes_) {
+	    codes_.push_back(level_codes[code - 1]);
+	}
+    }
+
+    /// The string in a row
+    std::string at(std::size_t row) const {
+	return lookup_.at(codes_.at(row) - 1);
+    }
+
+    std::size_t size() const {
+	return codes_.size();
+    }
+
+private:
+    std::vector<int> codes_;
+    StringLookup lookup_;
+};
+
+/// A numeric column. Missing values are NaN (NA_REAL in R)
+using NumericColumn = std::vector<double>;
+
+/**
+ * \brief The columns of a dataset, in the order they were added
+ *
+ * Columns are added by name with numeric() or factor(), which return
+ * the existing column if the name is already present. References to
+ * columns stay valid as more columns are added. The table is kept in
+ * plain C++ so that it can be checkpointed, and is only converted to
+ * R vectors at the end.
+ */
+class ResultTable {
+public:
+    using Column = std::variant<NumericColumn, FactorColumn>;
+
+    /// Get or add a numeric column. Throws runtime_error if a
+    /// column of another type has the same name
+    NumericColumn & numeric(const std::string & name) {
+	return column<NumericColumn>(name);
+    }
+
+    /// Get or add a factor column. Throws runtime_error if a
+    /// column of another type has the same name
+    FactorColumn & factor(const std::string & name) {
+	return column<FactorColumn>(name);
+    }
+
+    /// The column names, in order
+    const auto & names() const {
+	return names_;
+    }
+
+    const Column & at(const std::string & name) const {
+	return columns_.at(name);
+    }
+
+    /// Move a column out of the table (the column is left empty,
+    /// so that it can be handed to R without copying it)
+    Column take(const std::string & name) {
+	return std::move(columns_.at(name));
+    }
+
+    /// Append the rows of another table with the same column names,
+    /// in the same order, and types. Throws runtime_error if the
+    /// columns do not match.
+    void append(const ResultTable & other) {
+	if (other.names_ != names_) {
+	    throw std::runtime_error("Cannot append a table with different columns");
+	}
+	for (const auto & name : names_) {
+	    auto & column{columns_.at(name)};
+	    const auto & other_column{other.columns_.at(name)};
+	    if (column.index() != other_column.index()) {
+		throw std::runtime_error("Cannot append column " + name + " of another type");
+	    }
+	    if (auto * numeric = std::get_if<NumericColumn>(&column)) {
+		const auto & other_numeric{std::get<NumericColumn>(other_column)};
+		numeric->insert(numeric->end(), other_numeric.begin(), other_numeric.end());
+	    } else {
+		std::get<FactorColumn>(column).append(std::get<FactorColumn>(other_column));
+	    }
+	}
+    }
+
+    /// The number of rows (the length of the shortest column)
+    std::size_t num_rows() const {
+	if (names_.empty()) {
+	    return 0;
+	}
+	std::size_t rows{static_cast<std::size_t>(-1)};
+	for (const auto & [name, column] : columns_) {
+	    rows = std::min(rows, std::visit([](const auto & c) { return c.size(); }, column));
+	}
+	return rows;
+    }
+
+private:
+    template<typename T>
+    T & column(const std::string & name) {
+	auto [it, inserted] = columns_.try_emplace(name, T{});
+	if (inserted) {
+	    names_.push_back(name);
+	}
+	if (not std::holds_alternative<T>(it->second)) {
+	    throw std::runtime_error("Column " + name + " already exists with another type");
+	}
+	return std::get<T>(it->second);
+    }
+
+    std::vector<std::string> names_;
+    std::map<std::string, Column> columns_;
+};
+
+#endif
@@ -3,6 +3,8 @@
 
 #include "sql_types.h"
 #include <string>
+#include <variant>
+#include <cstdint>
 
 template<class T>
 concept RowBuffer = requires(T t, const std::string & s) {
@@ -16,10 +18,24 @@ T column(const std::string & column_name, const RowBuffer auto & row) {
     return row.template at<T>(column_name);
 }
 
+/// The type of a column, in the same order as the alternatives
+/// of SqlType
+enum class ColumnType : std::uint8_t {
+    Varchar,
+    Integer,
+    Timestamp
+};
+
+/// The name and type of a column in a row buffer
+struct ColumnSpec {
+    std::string name;
+    ColumnType type;
+};
+
 namespace RowBufferException {
 
-    /// Thrown by the constructor if there are no rows, or by
-    /// fetch_next_row if there are no more rows.
+    /// Thrown by fetch_next_row if there are no more rows, or
+    /// when reading a Spell or Patient from a finished buffer.
     struct NoMoreRows {};
 
     /// Throw by at() if the columns is not present
@@ -31,5 +47,53 @@ namespace RowBufferException {
 
 }
 
+/**
+ * \brief One of several row buffer types, chosen at run time
+ *
+ * Forwards each call to the row buffer it holds, so that the same
+ * loop can read from the database or from a local extract.
+ */
+template<RowBuffer... Buffers>
+class VariantRowBuffer {
+public:
+    template<typename B>
+    VariantRowBuffer(B && buffer)
+	requires (not std::is_same_v<std::remove_cvref_t<B>, VariantRowBuffer>)
+	: buffer_{std::forward<B>(buffer)} {}
+
+    template<typename T>
+    T at(const std::string & column_name) const {
+	return std::visit([&](const auto & row) {
+	    return row.template at<T>(column_name);
+	}, buffer_);
+    }
+
+    void fetch_next_row() {
+	std::visit([](auto & row) { row.fetch_next_row(); }, buffer_);
+    }
+
+    bool try_fetch_next_row() {
+	return std::visit([](auto & row) { return row.try_fetch_next_row(); }, buffer_);
+    }
+
+    bool end() const {
+	return std::visit([](const auto & row) { return row.end(); }, buffer_);
+    }
+
+    std::size_t current_row_number() const {
+	return std::visit([](const auto & row) -> std::size_t {
+	    return row.current_row_number();
+	}, buffer_);
+    }
+
+    /// Get the row buffer, if it is a B. Returns nullptr otherwise
+    template<typename B>
+    B * get_if() {
+	return std::get_if<B>(&buffer_);
+    }
+
+private:
+    std::variant<Buffers...> buffer_;
+};
 
 #endif
@@ -4,16 +4,30 @@
 #include "episode.h"
 #include "row_buffer.h"
 
+#include <string_view>
+
 class Spell {
 public:
-    Spell(RowBuffer auto & row, std::shared_ptr<ClinicalCodeParser> parser) {
-	// Assume the next row is the start of a new spell
-	// block. Push back to the episodes vector one row
-	// per episode.
+    /// The episodes are allocated with this allocator, which a
+    /// std::pmr::vector<Spell> passes to each element it makes
+    /// (see PatientRange)
+    using allocator_type = std::pmr::polymorphic_allocator<>;
+
+    /// Assume the current row is the start of a new spell
+    /// block. Push back to the episodes vector one row
+    /// per episode. Throws NoMoreRows if the row buffer
+    /// has already finished.
+    Spell(RowBuffer auto & row, std::shared_ptr<ClinicalCodeParser> parser,
+	  DecodeMode mode = DecodeMode::Full, const allocator_type & alloc = {})
+	: spell_id_{alloc}, episodes_{alloc} {
 
+	if (row.end()) {
+	    throw RowBufferException::NoMoreRows{};
+	}
+	
 	// The first row contains the spell id
 	try {
-	    spell_id_ = column<Varchar>("spell_id", row).read();
+	    spell_id_.assign(column<Varchar>("spell_id", row).read());
 	    spell_start_ = column<Timestamp>("spell_start", row);
             spell_end_ = column<Timestamp>("spell_end", row);
 	} catch (const RowBufferException::ColumnNotFound &) {
@@ -22,20 +36,37 @@ public:
 	    throw std::runtime_error("Column type errors in Spell constructor");
 	}
 
-	try {
-	    while (column<Varchar>("spell_id", row).read() == spell_id_) {
-		episodes_.push_back(Episode{row, parser});
-		row.fetch_next_row();
-	    }
-	} catch (const RowBufferException::NoMoreRows & e) {
-	    sort_episodes();
-	    throw;
-	}
+	// Stop at the first row of the next spell, or the end of
+	// the rows (which leaves row.end() true for the caller)
+	do {
+	    episodes_.emplace_back(row, parser, mode);
+	} while (row.try_fetch_next_row()
+		 and std::string_view{column<Varchar>("spell_id", row).read()} == spell_id_);
 	
 	sort_episodes();
     }
 
-    auto id() const {
+    Spell(const Spell &) = default;
+    Spell(Spell &&) = default;
+    Spell & operator=(const Spell &) = default;
+    Spell & operator=(Spell &&) = default;
+
+    Spell(const Spell & other, const allocator_type & alloc)
+	: spell_id_{other.spell_id_, alloc}, spell_start_{other.spell_start_},
+	  spell_end_{other.spell_end_}, episodes_{other.episodes_, alloc} { }
+
+    Spell(Spell && other, const allocator_type & alloc)
+	: spell_id_{std::move(other.spell_id_), alloc}, spell_start_{other.spell_start_},
+	  spell_end_{other.spell_end_}, episodes_{std::move(other.episodes_), alloc} { }
+
+    /// Parse any secondary columns left unparsed by DecodeMode::Primary
+    void decode(std::shared_ptr<ClinicalCodeParser> parser) {
+	for (auto & episode : episodes_) {
+	    episode.decode(parser);
+	}
+    }
+
+    std::string_view id() const {
 	return spell_id_;
     }
     
@@ -96,10 +127,10 @@ public:
     }
     
 private:
-    std::string spell_id_;
+    std::pmr::string spell_id_;
     Timestamp spell_start_;
     Timestamp spell_end_;
-    std::vector<Episode> episodes_;
+    std::pmr::vector<Episode> episodes_;
 };
 
 #endif
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <map>
+#include <algorithm>
 
 #include <string>
 #include <memory>
@@ -35,14 +36,89 @@ public:
     /// Submit an SQL query and get the result back as a set of
     /// columns (with column names).
     SqlRowBuffer execute_direct(const std::string & query) {
+	unprepare();
 	stmt_->exec_direct(query);
 	return SqlRowBuffer{stmt_};
     }
-    
+
+    /// Run a query with ? parameter markers, with the values of the
+    /// markers in parameters (so the values are never spliced into the
+    /// query). The query is prepared the first time, and running the
+    /// same query again with new values reuses the server's plan.
+    SqlRowBuffer execute_prepared(const std::string & query,
+				  const std::vector<SqlParameter> & parameters) {
+	if (prepared_query_ != query) {
+	    unprepare();
+	    stmt_->prepare(query);
+	    prepared_query_ = query;
+	}
+	stmt_->bind_parameters(parameters);
+	stmt_->execute();
+	return SqlRowBuffer{stmt_};
+    }
+
+    /// Run a statement that does not return rows (such as CREATE
+    /// TABLE or INSERT)
+    void execute(const std::string & statement) {
+	unprepare();
+	stmt_->exec_direct(statement);
+	stmt_->close_cursor();
+    }
+
+    /// Replace the table (normally a session temp table, such as
+    /// #patients) with a table of one varchar column holding the
+    /// values, without duplicates. The values are inserted by a
+    /// prepared INSERT with arrays of batch_size parameters, so there
+    /// is one round-trip for each batch instead of each value.
+    void load_temp_table(const std::string & table, const std::string & column,
+			 std::vector<std::string> values, std::size_t batch_size = 1000) {
+	std::ranges::sort(values);
+	values.erase(std::unique(values.begin(), values.end()), values.end());
+	std::size_t width{1};
+	for (const auto & value : values) {
+	    width = std::max(width, value.size());
+	}
+
+	execute("DROP TABLE IF EXISTS " + table);
+	execute("CREATE TABLE " + table + " (" + column + " VARCHAR("
+		+ std::to_string(width) + ") PRIMARY KEY)");
+	if (values.empty()) {
+	    return;
+	}
+
+	unprepare();
+	batch_size = std::min(std::max<std::size_t>(batch_size, 1), values.size());
+	std::vector<char> buffer(batch_size * width);
+	std::vector<SQLLEN> lengths(batch_size);
+	stmt_->prepare("INSERT INTO " + table + " (" + column + ") VALUES (?)");
+	for (std::size_t first{0}; first < values.size(); first += batch_size) {
+	    auto num_values{std::min(batch_size, values.size() - first)};
+	    for (std::size_t n{0}; n < num_values; n++) {
+		const auto & value{values[first + n]};
+		std::ranges::copy(value, buffer.begin() + n * width);
+		lengths[n] = value.size();
+	    }
+	    stmt_->bind_varchar_array(1, buffer.data(), width, lengths.data(), num_values);
+	    stmt_->execute();
+	}
+	stmt_->reset_parameters();
+	stmt_->close_cursor();
+    }
+
 private:
+    /// Drop the prepared query (and its parameters) before running
+    /// something else on the statement handle
+    void unprepare() {
+	if (not prepared_query_.empty()) {
+	    stmt_->reset_parameters();
+	    prepared_query_.clear();
+	}
+    }
+
     std::shared_ptr<EnvHandle> env_; ///< Global environment handle
     std::shared_ptr<ConHandle> dbc_; ///< Connection handle
     std::shared_ptr<StmtHandle> stmt_; ///< Statement handle
+    std::string prepared_query_; ///< The query last prepared by execute_prepared
 
 };
 
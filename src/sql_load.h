@@ -0,0 +1,130 @@
+#ifndef SQL_LOAD_HPP
+#define SQL_LOAD_HPP
+
+/**
+ * \file sql_load.h
+ * \brief Copy the rows of a row buffer into a database table
+ *
+ * This is for loading test data (for example synthetic HES rows) into
+ * a local database, such as a SQLite database behind the SQLite ODBC
+ * driver, so that the ODBC fetch path can be tested and timed without
+ * the real server. Values are written as SQL literals in multi-row
+ * INSERT statements, so it is not meant for loading real data.
+ */
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "row_buffer.h"
+#include "sql_connection.h"
+
+/// The CREATE TABLE statement for a table with these columns. Varchar
+/// columns get varchar_length characters.
+inline std::string make_create_table(const std::string & table,
+				     const std::vector<ColumnSpec> & columns,
+				     std::size_t varchar_length = 32) {
+    std::stringstream ss;
+    ss << "CREATE TABLE " << table << " (";
+    for (std::size_t n{0}; n < columns.size(); n++) {
+	ss << (n > 0 ? ", " : "") << columns[n].name << " ";
+	switch (columns[n].type) {
+	case ColumnType::Varchar:
+	    ss << "VARCHAR(" << varchar_length << ")";
+	    break;
+	case ColumnType::Integer:
+	    ss << "BIGINT";
+	    break;
+	case ColumnType::Timestamp:
+	    ss << "TIMESTAMP";
+	    break;
+	}
+    }
+    ss << ")";
+    return ss.str();
+}
+
+/// Write the value of a column in the current row as an SQL literal
+void write_sql_literal(std::ostream & os, const RowBuffer auto & row,
+		       const ColumnSpec & column) {
+    switch (column.type) {
+    case ColumnType::Varchar: {
+	auto value{row.template at<Varchar>(column.name)};
+	if (value.null()) {
+	    os << "NULL";
+	} else {
+	    // Quotes are escaped by doubling them
+	    os << "'";
+	    for (auto c : value.read()) {
+		os << c;
+		if (c == '\'') {
+		    os << c;
+		}
+	    }
+	    os << "'";
+	}
+	break;
+    }
+    case ColumnType::Integer: {
+	auto value{row.template at<Integer>(column.name)};
+	if (value.null()) {
+	    os << "NULL";
+	} else {
+	    os << value.read();
+	}
+	break;
+    }
+    case ColumnType::Timestamp: {
+	// Timestamps are printed (and read back) in local time
+	auto value{row.template at<Timestamp>(column.name)};
+	if (value.null()) {
+	    os << "NULL";
+	} else {
+	    os << "'" << value << "'";
+	}
+	break;
+    }
+    }
+}
+
+/// Replace the table with the rows of the row buffer, from the current
+/// row to the end, with batch_size rows in each INSERT statement and
+/// all of them in one transaction. Returns the number of rows written.
+template<typename R>
+std::size_t load_table(SQLConnection & connection, const std::string & table,
+		       R & row, std::size_t batch_size = 500) {
+    auto columns{row.columns()};
+    connection.execute("DROP TABLE IF EXISTS " + table);
+    connection.execute(make_create_table(table, columns));
+
+    std::stringstream insert_columns;
+    insert_columns << "INSERT INTO " << table << " (";
+    for (std::size_t n{0}; n < columns.size(); n++) {
+	insert_columns << (n > 0 ? ", " : "") << columns[n].name;
+    }
+    insert_columns << ") VALUES ";
+
+    connection.execute("BEGIN TRANSACTION");
+    std::size_t num_rows{0};
+    while (not row.end()) {
+	std::stringstream insert;
+	insert << insert_columns.str();
+	for (std::size_t n{0}; n < batch_size and not row.end(); n++) {
+	    insert << (n > 0 ? ", (" : "(");
+	    for (std::size_t c{0}; c < columns.size(); c++) {
+		if (c > 0) {
+		    insert << ", ";
+		}
+		write_sql_literal(insert, row, columns[c]);
+	    }
+	    insert << ")";
+	    num_rows++;
+	    row.try_fetch_next_row();
+	}
+	connection.execute(insert.str());
+    }
+    connection.execute("COMMIT");
+    return num_rows;
+}
+
+#endif
@@ -2,7 +2,50 @@
 #define SQL_QUERY
 
 #include "yaml.h"
+#include "sql_types.h"
+#include "stmt_handle.h"
 #include <optional>
+#include <sstream>
+#include <vector>
+
+/// Separates the codes in a packed code column (see make_acs_sql_query)
+const char packed_code_separator{'|'};
+
+/// Whether the "sql_query" block asks for packed code columns
+bool packed_codes(const YAML::Node & config) {
+    return config["packed_codes"] and config["packed_codes"].as<bool>();
+}
+
+/// Write the secondary code columns, either as one column each (named
+/// prefix<n>), or packed into one column (named packed_name) holding
+/// the codes joined by packed_code_separator. A null code is packed as
+/// an empty string, so that each code keeps its position.
+void write_code_columns(std::ostream & query, const YAML::Node & columns,
+			const std::string & prefix, const std::string & packed_name,
+			bool packed) {
+    if (not packed) {
+	std::size_t count{0};
+	for (const auto & column : columns) {
+	    query <<  "," << column << " as " << prefix << count++ << std::endl;
+	}
+	return;
+    }
+    if (columns.size() == 0) {
+	return;
+    }
+    // concat_ws needs at least two values after the separator
+    query << ",";
+    if (columns.size() == 1) {
+	query << "coalesce(" << columns[0] << ", '')";
+    } else {
+	query << "concat_ws('" << packed_code_separator << "'";
+	for (const auto & column : columns) {
+	    query << ", coalesce(" << column << ", '')";
+	}
+	query << ")";
+    }
+    query << " as " << packed_name << std::endl;
+}
 
 /**
  * \brief Make the SQL query for the ACS dataset
@@ -10,10 +53,21 @@
  * The config file is the "sql_query" block. It should contains primary_diagnosis
  * and primary_procedure keys, and secondary_diagnoses and secondary_procedures
  * lists. These are all column names, that will be mapped to the names used
- * by the Episode constructor
+ * by the Episode constructor. With packed_codes: true, the secondary
+ * diagnoses and procedures are each packed by the server into one
+ * column of codes separated by packed_code_separator (see
+ * unpack_code_columns), instead of one column per code, which saves
+ * binding, converting and sending the many null columns of most rows.
+ * The codes read back are the same as from the separate columns.
+ * If by_nhs_number is true, the query is for
+ * one patient, with the NHS number as its ? parameter (see
+ * SQLConnection::execute_prepared). Otherwise, the optional condition (in
+ * terms of the output column names, and possibly with its own ?
+ * parameters) restricts the rows.
  */
 std::string make_acs_sql_query(const YAML::Node & config, bool with_mortality,
-			       const std::optional<std::string> & nhs_number) {
+			       bool by_nhs_number,
+			       const std::optional<std::string> & condition = std::nullopt) {
 
     std::stringstream query;
 
@@ -45,16 +99,11 @@ std::string make_acs_sql_query(const YAML::Node & config, bool with_mortality,
     query << config["primary_diagnosis"] << " as primary_diagnosis," << std::endl;
     query << config["primary_procedure"] << " as primary_procedure " << std::endl;
 
-    // Get all the secondary diagnosis columns
-    std::size_t count{0};
-    for (const auto & diagnosis : config["secondary_diagnoses"]) {
-	query <<  "," << diagnosis << " as secondary_diagnosis_" << count++ << std::endl;
-    }
-    count = 0;
-    for (const auto & procedure : config["secondary_procedures"]) {
-	query << "," << procedure << " as secondary_procedure_" << count++
-	      << std::endl;
-    }
+    // Get all the secondary diagnosis and procedure columns
+    write_code_columns(query, config["secondary_diagnoses"], "secondary_diagnosis_",
+		       "secondary_diagnoses", packed_codes(config));
+    write_code_columns(query, config["secondary_procedures"], "secondary_procedure_",
+		       "secondary_procedures", packed_codes(config));
 
     query << " from abi.dbo.vw_apc_sem_001 "
 	  << "where datalength(AIMTC_Pseudo_NHS) > 0 "
@@ -65,8 +114,10 @@ std::string make_acs_sql_query(const YAML::Node & config, bool with_mortality,
 	      << "on episodes.nhs_number = mort.derived_pseudo_nhs ";
     }
 
-    if (nhs_number.has_value()) {
-	query << "where nhs_number = '" << *nhs_number << "' ";
+    if (by_nhs_number) {
+	query << "where nhs_number = ? ";
+    } else if (condition.has_value()) {
+	query << "where " << *condition << " ";
     }
 
     query << "order by nhs_number, spell_id ";
@@ -74,6 +125,131 @@ std::string make_acs_sql_query(const YAML::Node & config, bool with_mortality,
     return query.str();
 }
 
+/// Read the packed code columns of the result of make_acs_sql_query
+/// (if packed_codes is set in the "sql_query" block) as the normal
+/// secondary_diagnosis_<n> and secondary_procedure_<n> columns (see
+/// SqlRowBuffer::unpack_column). Call it before reading the rows.
+void unpack_code_columns(auto & row, const YAML::Node & config) {
+    if (not packed_codes(config)) {
+	return;
+    }
+    if (auto size{config["secondary_diagnoses"].size()}; size > 0) {
+	row.unpack_column("secondary_diagnoses", "secondary_diagnosis_", size,
+			  packed_code_separator);
+    }
+    if (auto size{config["secondary_procedures"].size()}; size > 0) {
+	row.unpack_column("secondary_procedures", "secondary_procedure_", size,
+			  packed_code_separator);
+    }
+}
+
+/// Add a term to an optional condition (for make_acs_sql_query), with
+/// "and" if there is one already
+void add_condition(std::optional<std::string> & condition, const std::string & term) {
+    condition = condition ? *condition + " and " + term : term;
+}
 
+/// Add the range [first, end) of spell start dates (see
+/// AcsDataset::spell_date_range) to an optional condition for
+/// make_acs_sql_query. Like Spell::start_date, the first episode start
+/// is used for a spell with no start date. The start date is found over
+/// all the episodes of the spell, so that a spell is either fetched
+/// whole or not at all. The bounds are ? parameters, whose values are
+/// added to parameters. A missing bound adds nothing.
+void add_spell_date_range(std::optional<std::string> & condition,
+			  std::vector<SqlParameter> & parameters,
+			  const std::optional<Timestamp> & first,
+			  const std::optional<Timestamp> & end) {
+    if (not first and not end) {
+	return;
+    }
+    const std::string spell_start{"coalesce(min(AIMTC_ProviderSpell_Start_Date), "
+				  "min(StartDate_ConsultantEpisode))"};
+    std::stringstream term;
+    term << "spell_id in (select PBRspellID from abi.dbo.vw_apc_sem_001 "
+	 << "group by PBRspellID having ";
+    if (first) {
+	term << spell_start << " >= ?";
+	parameters.push_back(*first);
+    }
+    if (first and end) {
+	term << " and ";
+    }
+    if (end) {
+	term << spell_start << " < ?";
+	parameters.push_back(*end);
+    }
+    term << ")";
+    add_condition(condition, term.str());
+}
+
+/**
+ * \brief Make the query for an incremental refresh of the ACS extract
+ *
+ * Returns the same columns as make_acs_sql_query (with mortality), but
+ * only for patients with an episode starting, or a spell ending, after
+ * episode_watermark, or with a death after death_watermark. All the
+ * rows of those patients are returned (not only the new ones), so that
+ * they can replace the patients' rows in the extract. The watermarks are
+ * ? parameters, whose values are added to parameters.
+ */
+std::string make_acs_refresh_sql_query(const YAML::Node & config,
+				       const Timestamp & episode_watermark,
+				       const Timestamp & death_watermark,
+				       std::vector<SqlParameter> & parameters) {
+    std::stringstream condition;
+    condition << "nhs_number in (select AIMTC_Pseudo_NHS "
+	      << "from abi.dbo.vw_apc_sem_001 "
+	      << "where StartDate_ConsultantEpisode > ? "
+	      << "or AIMTC_ProviderSpell_End_Date > ? "
+	      << "union select derived_pseudo_nhs "
+	      << "from abi.civil_registration.mortality "
+	      << "where REG_DATE_OF_DEATH > ?)";
+    parameters.insert(parameters.end(), {episode_watermark, episode_watermark,
+					 death_watermark});
+    return make_acs_sql_query(config, true, false, condition.str());
+}
+
+/// Whether the "sql_query" block asks for the mortality table to be
+/// fetched separately (with make_mortality_sql_query) instead of being
+/// joined onto the episodes
+bool separate_mortality(const YAML::Node & config) {
+    return config["separate_mortality"] and config["separate_mortality"].as<bool>();
+}
+
+/**
+ * \brief Make the query for the mortality table on its own
+ *
+ * Returns the mortality columns of make_acs_sql_query (with mortality),
+ * and the nhs_number, with one row per death, to be read into a
+ * MortalityTable. Use it with make_acs_sql_query without mortality.
+ */
+std::string make_mortality_sql_query() {
+    std::stringstream query;
+    query << "select derived_pseudo_nhs as nhs_number"
+	  << ", REG_DATE_OF_DEATH as date_of_death"
+	  << ", S_UNDERLYING_COD_ICD10 as cause_of_death"
+	  << ", Dec_Age_At_Death as age_at_death "
+	  << "from abi.civil_registration.mortality "
+	  << "where datalength(derived_pseudo_nhs) > 0 ";
+    return query.str();
+}
+
+/// The session temp table of NHS numbers for make_acs_batch_sql_query()
+const std::string patient_batch_table{"#rdb_patient_batch"};
+
+/**
+ * \brief Make the query for a batch of patients
+ *
+ * Returns the same columns as make_acs_sql_query, for the patients whose
+ * NHS numbers are in the nhs_number column of patient_batch_table. Load
+ * the table first on the same connection (see
+ * SQLConnection::load_temp_table), so that all the patients come back
+ * from one query, in nhs_number order.
+ */
+std::string make_acs_batch_sql_query(const YAML::Node & config, bool with_mortality) {
+    return make_acs_sql_query(config, with_mortality, false,
+			      "nhs_number in (select nhs_number from " + patient_batch_table + ")");
+}
 
 #endif
@@ -2,12 +2,121 @@
 #define SQL_ROW_BUFFER_HPP
 
 #include <functional>
+#include <string_view>
+#include <charconv>
+#include <concepts>
+#include <optional>
+#include <algorithm>
+#include <vector>
 
 #include "stmt_handle.h"
 #include "yaml.h"
 #include "category.h"
 #include "random.h"
 #include "row_buffer.h"
+#include "trace.h"
+
+/// Split a packed column value at each separator, in one pass. The
+/// parts are views into packed. An empty value has no parts.
+inline void split_packed(std::string_view packed, char separator,
+			 std::vector<std::string_view> & parts) {
+    parts.clear();
+    if (packed.empty()) {
+	return;
+    }
+    while (true) {
+	auto end{packed.find(separator)};
+	parts.push_back(packed.substr(0, end));
+	if (end == std::string_view::npos) {
+	    return;
+	}
+	packed.remove_prefix(end + 1);
+    }
+}
+
+/**
+ * \brief Reads one packed column as several varchar columns
+ *
+ * The packed column holds the values of the columns prefix<n>, for n
+ * from 0 to num_columns - 1, joined by the separator. A null value is
+ * written as an empty part, so that every value keeps its position
+ * (see write_code_columns in sql_query.h). An empty part is read as
+ * null, as are the columns after the last part, and all the columns
+ * of a null packed value.
+ */
+class PackedColumn {
+public:
+    PackedColumn(const std::string & column, const std::string & prefix,
+		 std::size_t num_columns, char separator)
+	: column_{column}, prefix_{prefix}, num_columns_{num_columns},
+	  separator_{separator} {}
+
+    /// The name of the packed column
+    const std::string & column() const {
+	return column_;
+    }
+
+    /// The names of the columns read from the packed column
+    std::vector<std::string> column_names() const {
+	std::vector<std::string> names;
+	for (std::size_t n{0}; n < num_columns_; n++) {
+	    names.push_back(prefix_ + std::to_string(n));
+	}
+	return names;
+    }
+
+    /// Whether column_name could be one of the columns prefix<n>
+    bool matches(const std::string & column_name) const {
+	return column_name.starts_with(prefix_);
+    }
+
+    /// Read the column prefix<n> of the current row. The packed value
+    /// (a Varchar returned by read_packed) is read and split once per
+    /// row, when the first of its columns is read. Throws ColumnNotFound
+    /// if n is out of range, and WrongColumnType if T is not Varchar.
+    template<typename T>
+    T at(const std::string & column_name, std::size_t row_number,
+	 std::invocable auto && read_packed) const {
+	if constexpr (not std::is_same_v<T, Varchar>) {
+	    throw RowBufferException::WrongColumnType{};
+	} else {
+	    std::size_t n{0};
+	    auto first{column_name.data() + prefix_.size()};
+	    auto last{column_name.data() + column_name.size()};
+	    auto [end, error] = std::from_chars(first, last, n);
+	    if (error != std::errc{} or end != last or n >= num_columns_) {
+		throw RowBufferException::ColumnNotFound{};
+	    }
+	    if (split_row_ != row_number) {
+		Varchar packed{read_packed()};
+		value_ = packed.null() ? std::string{} : packed.read();
+		split_packed(value_, separator_, split_parts_);
+		parts_.clear();
+		for (auto part : split_parts_) {
+		    parts_.emplace_back(part.data() - value_.data(), part.size());
+		}
+		split_row_ = row_number;
+	    }
+	    if (n >= parts_.size() or parts_[n].second == 0) {
+		return Varchar{};
+	    }
+	    auto [offset, length] = parts_[n];
+	    return Varchar{value_.substr(offset, length)};
+	}
+    }
+
+private:
+    std::string column_;
+    std::string prefix_;
+    std::size_t num_columns_;
+    char separator_;
+    // The value in the row last split, and the offsets and lengths of
+    // its parts (not views, which a move of the value would break)
+    mutable std::string value_;
+    mutable std::vector<std::pair<std::size_t, std::size_t>> parts_;
+    mutable std::vector<std::string_view> split_parts_;
+    mutable std::optional<std::size_t> split_row_;
+};
 
 /// Holds the column bindings for an in-progress query. Allows
 /// rows to be fetched one at a time.
@@ -15,8 +124,8 @@ class SqlRowBuffer {
 public:
     
     /// Make sure you only do this after executing the statement.
-    /// This constructor also fetches the first row, which throws
-    /// std::logic_error if there are no rows
+    /// This constructor also fetches the first row. If there are
+    /// no rows, end() is true straight away.
     SqlRowBuffer(const std::shared_ptr<StmtHandle> & stmt)
 	: stmt_{stmt}
     {
@@ -32,7 +141,7 @@ public:
 	}
 
 	/// Try to fetch the first row
-	fetch_next_row();
+	try_fetch_next_row();
 	/// Special case, reset the current row to 0
 	/// TODO fix this
 	current_row_ = 0;
@@ -43,11 +152,48 @@ public:
 	return column_buffers_.size();
     }
 
+    /// The names and types of the columns
+    std::vector<ColumnSpec> columns() const {
+	std::vector<ColumnSpec> columns;
+	for (const auto & [name, buffer] : column_buffers_) {
+	    // BufferType has the same order of alternatives as ColumnType
+	    if (not unpacked(name)) {
+		columns.push_back({name, static_cast<ColumnType>(buffer.index())});
+	    }
+	}
+	for (const auto & packed : packed_columns_) {
+	    for (const auto & name : packed.column_names()) {
+		columns.push_back({name, ColumnType::Varchar});
+	    }
+	}
+	return columns;
+    }
+
+    /// Read the packed column (a varchar of values joined by the
+    /// separator, see make_acs_sql_query) as the varchar columns
+    /// prefix<n> for n from 0 to num_columns - 1, instead of as
+    /// itself (see PackedColumn). Call this before reading any rows.
+    void unpack_column(const std::string & packed_column, const std::string & prefix,
+		       std::size_t num_columns, char separator) {
+	if (not column_buffers_.contains(packed_column)) {
+	    throw std::runtime_error("Missing packed column '" + packed_column + "'");
+	}
+	packed_columns_.emplace_back(packed_column, prefix, num_columns, separator);
+    }
+
     /// Throws out_of_range if column does not exist, and
     /// bad_variant_access if T is not this column's type
     template<typename T>
     T at(std::string column_name) const {
 
+	for (const auto & packed : packed_columns_) {
+	    if (packed.matches(column_name)) {
+		return packed.template at<T>(column_name, current_row_, [&] {
+		    return std::get<VarcharBuffer>(column_buffers_.at(packed.column())).read();
+		});
+	    }
+	}
+
 	try {
 	    const auto & column_contents{column_buffers_.at(column_name)};
 	    auto & buffer {std::get<typename T::Buffer>(column_contents)};
@@ -64,13 +210,30 @@ public:
     
     /// Fetch the next row of data into an internal state
     /// variable. Use get() to access items from the current
-    /// row. This function throws a logic error if there are
+    /// row. This function throws NoMoreRows if there are
     /// not more rows.
     void fetch_next_row() {
-	if(not stmt_->fetch()) {
+	if (not try_fetch_next_row()) {
 	    throw RowBufferException::NoMoreRows{};
 	}
+    }
+
+    /// Fetch the next row, or return false if there are no
+    /// more rows. After that, end() is true and the current
+    /// row must not be read.
+    bool try_fetch_next_row() {
+	RDB_TRACE_SPAN("fetch");
+	if (not stmt_->fetch()) {
+	    end_ = true;
+	    return false;
+	}
 	current_row_++;
+	return true;
+    }
+
+    /// True when all the rows have been fetched
+    bool end() const {
+	return end_;
     }
 
     auto current_row_number() const {
@@ -78,9 +241,17 @@ public:
     }
     
 private:
+    bool unpacked(const std::string & column_name) const {
+	return std::ranges::any_of(packed_columns_, [&](const auto & packed) {
+	    return packed.column() == column_name;
+	});
+    }
+
     std::size_t current_row_{0};
+    bool end_{false};
     std::shared_ptr<StmtHandle> stmt_;
     std::map<std::string, BufferType> column_buffers_;
+    std::vector<PackedColumn> packed_columns_;
 };
 
 #endif
@@ -1,10 +1,34 @@
 #include "sql_types.h"
 
+#include <sstream>
+
 std::ostream &operator<<(std::ostream &os, const Integer &integer) {
     integer.print(os);
     return os;
 }
 
+std::tm local_time(std::time_t time) {
+    std::tm tm{};
+#ifdef _WIN64
+    localtime_s(&tm, &time);
+#else
+    localtime_r(&time, &tm);
+#endif
+    return tm;
+}
+
+SQL_TIMESTAMP_STRUCT to_sql_timestamp(const Timestamp & timestamp) {
+    auto tm{local_time(static_cast<std::time_t>(timestamp.read()))};
+    SQL_TIMESTAMP_STRUCT datetime{};
+    datetime.year = static_cast<SQLSMALLINT>(tm.tm_year + 1900);
+    datetime.month = static_cast<SQLUSMALLINT>(tm.tm_mon + 1);
+    datetime.day = static_cast<SQLUSMALLINT>(tm.tm_mday);
+    datetime.hour = static_cast<SQLUSMALLINT>(tm.tm_hour);
+    datetime.minute = static_cast<SQLUSMALLINT>(tm.tm_min);
+    datetime.second = static_cast<SQLUSMALLINT>(tm.tm_sec);
+    return datetime;
+}
+
 std::ostream &operator<<(std::ostream &os, const Timestamp &timestamp) {
     timestamp.print(os);
     return os;
@@ -19,10 +43,44 @@ TimestampOffset operator-(const Timestamp & a, const Timestamp & b) {
     return TimestampOffset{a_time - b_time};
 }
 
+namespace {
+
+/// The number of days in a month (from 1 to 12) of a year
+int days_in_month(int year, int month) {
+    static const int days[]{31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    auto leap{(year % 4 == 0 and year % 100 != 0) or year % 400 == 0};
+    return month == 2 and leap ? 29 : days[month - 1];
+}
+
+}
+
+Timestamp parse_date(const std::string & date) {
+    std::istringstream is{date};
+    int year, month, day;
+    char sep1, sep2;
+    // mktime would silently move an out-of-range month or day into
+    // another month, so they are checked here
+    if (not (is >> year >> sep1 >> month >> sep2 >> day) or sep1 != '-' or sep2 != '-'
+	or not (is >> std::ws).eof() or month < 1 or month > 12
+	or day < 1 or day > days_in_month(year, month)) {
+	throw std::runtime_error("Expected a date of the form year-month-day, not '"
+				 + date + "'");
+    }
+    SQL_TIMESTAMP_STRUCT datetime{};
+    datetime.year = static_cast<SQLSMALLINT>(year);
+    datetime.month = static_cast<SQLUSMALLINT>(month);
+    datetime.day = static_cast<SQLUSMALLINT>(day);
+    return Timestamp{datetime};
+}
+
 TimestampOffset years(long long value) {
     return TimestampOffset{365*24*60*60*value};
 }
 
+TimestampOffset days(long long value) {
+    return TimestampOffset{24*60*60*value};
+}
+
 std::ostream & operator << (std::ostream & os, const TimestampOffset & offset) {
     auto value{offset.value()};
     if (value > 0) {
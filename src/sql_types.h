@@ -31,6 +31,8 @@ private:
 
 TimestampOffset years(long long value);
 
+TimestampOffset days(long long value);
+
 std::ostream & operator << (std::ostream & os, const TimestampOffset & offset);
 
 class Varchar {
@@ -93,6 +95,11 @@ private:
 
 std::ostream &operator<<(std::ostream &os, const Integer &integer);
 
+/// Convert a unix time to local time (the inverse of the conversion in
+/// the Timestamp constructor). Unlike std::localtime, this is safe to
+/// call from more than one thread.
+std::tm local_time(std::time_t time);
+
 // Stores an absolute time as a unix timestamp, constructed from
 // date components assuming that BST may be in effect.
 class Timestamp {
@@ -161,8 +168,8 @@ public:
 	if (null_) {
 	    os << "NULL";
 	} else {
-	    auto t{static_cast<std::time_t>(unix_timestamp_)};
-	    os << std::put_time(std::localtime(&t), "%F %T");
+	    auto tm{local_time(static_cast<std::time_t>(unix_timestamp_))};
+	    os << std::put_time(&tm, "%F %T");
 	}
     }
     bool null() const { return null_; }
@@ -180,6 +187,16 @@ Timestamp operator+(const Timestamp & time, T offset_seconds) {
 
 TimestampOffset operator-(const Timestamp & a, const Timestamp & b);
 
+/// The local date and time of a non-null Timestamp, as bound to an SQL
+/// timestamp parameter (the inverse of the Timestamp constructor)
+SQL_TIMESTAMP_STRUCT to_sql_timestamp(const Timestamp & timestamp);
+
+/// Read a date written as year-month-day (e.g. "2015-1-1", as in the
+/// config file) as the Timestamp of midnight (local time) at the start
+/// of that day. Throws std::runtime_error if the date is not in that
+/// form.
+Timestamp parse_date(const std::string & date);
+
 using SqlType = std::variant<Varchar,
 			     Integer,
 			     Timestamp>;
@@ -1,6 +1,11 @@
 #ifndef STMT_HANDLE_HPP
 #define STMT_HANDLE_HPP
 
+#include <variant>
+#include <vector>
+#include <string>
+#include <algorithm>
+
 #include "con_handle.h"
 #include "sql_types.h"
 
@@ -36,6 +41,9 @@ BufferType make_timestamp_binding(std::size_t index,
 }
 
 
+/// The value of a ? parameter marker in a prepared statement
+using SqlParameter = std::variant<std::string, long long, Timestamp>;
+
 class StmtHandle {
 public:
     StmtHandle(std::shared_ptr<ConHandle> hdbc)
@@ -49,10 +57,90 @@ public:
 	return Handle{hstmt_, SQL_HANDLE_STMT};
     }
     void exec_direct(const std::string & query) {
+	close_cursor();
     	// SQL_NTS for null-terminated string (query)
 	SQLRETURN r = SQLExecDirect(hstmt_, (SQLCHAR*)query.c_str(), SQL_NTS);
 	ok_or_throw(get_handle(), r, "Adding query for direct execution");
     }
+    /// Prepare a statement with ? parameter markers, to be run by
+    /// execute() after binding the parameters
+    void prepare(const std::string & statement) {
+	close_cursor();
+	SQLRETURN r = SQLPrepare(hstmt_, (SQLCHAR*)statement.c_str(), SQL_NTS);
+	ok_or_throw(get_handle(), r, "Preparing statement");
+    }
+    /// Run the prepared statement with the bound parameters. The
+    /// cursor of the last execution is closed first, so the statement
+    /// can be run again with new parameters without preparing it again.
+    void execute() {
+	close_cursor();
+	SQLRETURN r = SQLExecute(hstmt_);
+	ok_or_throw(get_handle(), r, "Executing prepared statement");
+    }
+    /// Bind the values of the ? parameter markers of the prepared
+    /// statement, in order. Strings are bound as varchar, integers
+    /// as bigint, and timestamps as timestamp (in local time, see
+    /// to_sql_timestamp). The values are copied into the handle, where
+    /// they stay until the next call.
+    void bind_parameters(const std::vector<SqlParameter> & parameters) {
+	SQLFreeStmt(hstmt_, SQL_RESET_PARAMS);
+	parameters_ = parameters;
+	parameter_lengths_.assign(parameters_.size(), 0);
+	timestamp_values_.assign(parameters_.size(), SQL_TIMESTAMP_STRUCT{});
+	for (std::size_t n{0}; n < parameters_.size(); n++) {
+	    SQLRETURN r;
+	    if (auto * value{std::get_if<std::string>(&parameters_[n])}) {
+		parameter_lengths_[n] = value->size();
+		r = SQLBindParameter(hstmt_, n + 1, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR,
+				     std::max<std::size_t>(value->size(), 1), 0,
+				     value->data(), value->size(), &parameter_lengths_[n]);
+	    } else if (auto * value{std::get_if<Timestamp>(&parameters_[n])}) {
+		if (value->null()) {
+		    parameter_lengths_[n] = SQL_NULL_DATA;
+		} else {
+		    timestamp_values_[n] = to_sql_timestamp(*value);
+		    parameter_lengths_[n] = sizeof(SQL_TIMESTAMP_STRUCT);
+		}
+		// A column size of 19 is yyyy-mm-dd hh:mm:ss, with no fraction
+		r = SQLBindParameter(hstmt_, n + 1, SQL_PARAM_INPUT, SQL_C_TYPE_TIMESTAMP,
+				     SQL_TYPE_TIMESTAMP, 19, 0, &timestamp_values_[n],
+				     sizeof(SQL_TIMESTAMP_STRUCT), &parameter_lengths_[n]);
+	    } else {
+		parameter_lengths_[n] = sizeof(long long);
+		r = SQLBindParameter(hstmt_, n + 1, SQL_PARAM_INPUT, SQL_C_SBIGINT, SQL_BIGINT,
+				     0, 0, &std::get<long long>(parameters_[n]), 0,
+				     &parameter_lengths_[n]);
+	    }
+	    ok_or_throw(get_handle(), r, "Binding parameter " + std::to_string(n + 1));
+	}
+    }
+    /// Bind parameter index (numbered from 1) to an array of
+    /// num_values varchar values, so that execute() runs the statement
+    /// once for each value in one round-trip. The values are width
+    /// bytes apart in buffer (column-wise binding), with their lengths
+    /// in lengths. The buffers must outlive the execute().
+    void bind_varchar_array(std::size_t index, char * buffer, std::size_t width,
+			    SQLLEN * lengths, std::size_t num_values) {
+	SQLRETURN r = SQLSetStmtAttr(hstmt_, SQL_ATTR_PARAMSET_SIZE,
+				     (SQLPOINTER)num_values, 0);
+	ok_or_throw(get_handle(), r, "Setting the parameter array size");
+	r = SQLBindParameter(hstmt_, index, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR,
+			     width, 0, buffer, width, lengths);
+	ok_or_throw(get_handle(), r, "Binding parameter array");
+    }
+    /// Unbind the parameters, and go back to one set of parameters
+    /// for each execute()
+    void reset_parameters() {
+	SQLFreeStmt(hstmt_, SQL_RESET_PARAMS);
+	SQLSetStmtAttr(hstmt_, SQL_ATTR_PARAMSET_SIZE, (SQLPOINTER)1, 0);
+    }
+    /// Close the cursor of the last query (if it is open) and unbind
+    /// its columns, so that the statement can be executed again. The
+    /// buffers of the last query must not be read after this.
+    void close_cursor() {
+	SQLFreeStmt(hstmt_, SQL_CLOSE);
+	SQLFreeStmt(hstmt_, SQL_UNBIND);
+    }
     /// Get the number of returned columns (sql_direct comes first)
     std::size_t num_columns() {
 	// Obtain the results
@@ -155,6 +243,9 @@ public:
 private:
     std::shared_ptr<ConHandle> hdbc_; /// Keep alive for this
     SQLHSTMT hstmt_; ///< Statement handle
+    std::vector<SqlParameter> parameters_; ///< Bound parameter values
+    std::vector<SQLLEN> parameter_lengths_; ///< Their lengths
+    std::vector<SQL_TIMESTAMP_STRUCT> timestamp_values_; ///< Bound timestamps
 };
 
 #endif
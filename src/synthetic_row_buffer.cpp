@@ -0,0 +1,293 @@
+#include "synthetic_row_buffer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <limits>
+
+namespace {
+
+/// The columns that every row has, in the order they are added
+/// (the secondary columns come after these)
+enum FixedColumn : std::size_t {
+    NhsNumber,
+    AgeAtEpisode,
+    SpellId,
+    EpisodeStart,
+    EpisodeEnd,
+    SpellStart,
+    SpellEnd,
+    PrimaryDiagnosis,
+    PrimaryProcedure,
+    DateOfDeath,
+    CauseOfDeath,
+    AgeAtDeath,
+};
+
+/// The generator stream for the code pools (patients use the streams
+/// numbered by their position)
+constexpr std::uint64_t pool_stream{std::numeric_limits<std::uint64_t>::max()};
+
+constexpr unsigned long long seconds_per_day{24*60*60};
+constexpr unsigned long long seconds_per_year{365*seconds_per_day};
+
+template<typename T>
+void read_optional(const YAML::Node & node, const std::string & key, T & value) {
+    if (node[key]) {
+	value = node[key].as<T>();
+    }
+}
+
+}
+
+SyntheticConfig read_synthetic_config(const YAML::Node & config) {
+    SyntheticConfig synthetic;
+    if (config["sql_query"]) {
+	synthetic.secondary_diagnosis_columns = config["sql_query"]["secondary_diagnoses"].size();
+	synthetic.secondary_procedure_columns = config["sql_query"]["secondary_procedures"].size();
+    }
+    const auto & node{config["synthetic"]};
+    if (not node) {
+	return synthetic;
+    }
+    read_optional(node, "seed", synthetic.seed);
+    read_optional(node, "num_patients", synthetic.num_patients);
+    read_optional(node, "first_patient", synthetic.first_patient);
+    read_optional(node, "first_nhs_number", synthetic.first_nhs_number);
+    read_optional(node, "secondary_diagnosis_columns", synthetic.secondary_diagnosis_columns);
+    read_optional(node, "secondary_procedure_columns", synthetic.secondary_procedure_columns);
+    read_optional(node, "spells_per_patient", synthetic.spells_per_patient);
+    read_optional(node, "episodes_per_spell", synthetic.episodes_per_spell);
+    read_optional(node, "episode_days", synthetic.episode_days);
+    read_optional(node, "days_between_spells", synthetic.days_between_spells);
+    read_optional(node, "secondary_diagnoses", synthetic.secondary_diagnoses);
+    read_optional(node, "secondary_procedures", synthetic.secondary_procedures);
+    read_optional(node, "procedure_probability", synthetic.procedure_probability);
+    read_optional(node, "blank_probability", synthetic.blank_probability);
+    read_optional(node, "invalid_probability", synthetic.invalid_probability);
+    read_optional(node, "index_probability", synthetic.index_probability);
+    read_optional(node, "index_diagnoses", synthetic.index_diagnoses);
+    read_optional(node, "death_probability", synthetic.death_probability);
+    read_optional(node, "days_to_death", synthetic.days_to_death);
+    read_optional(node, "code_pool_size", synthetic.code_pool_size);
+    read_optional(node, "code_skew", synthetic.code_skew);
+    read_optional(node, "first_year", synthetic.first_year);
+    read_optional(node, "num_years", synthetic.num_years);
+    read_optional(node, "min_age", synthetic.min_age);
+    read_optional(node, "max_age", synthetic.max_age);
+    if (synthetic.spells_per_patient < 1 or synthetic.episodes_per_spell < 1) {
+	throw std::runtime_error("The synthetic spells_per_patient and episodes_per_spell "
+				 "must be at least 1");
+    }
+    if (synthetic.min_age > synthetic.max_age or synthetic.code_pool_size == 0) {
+	throw std::runtime_error("Invalid synthetic ages or code_pool_size");
+    }
+    return synthetic;
+}
+
+SyntheticRowBuffer::SyntheticRowBuffer(const SyntheticConfig & config,
+				       std::shared_ptr<ClinicalCodeParser> parser)
+    : config_{config}, parser_{parser}, gen_{config.seed, pool_stream},
+      patient_{config.first_patient} {
+
+    // The pools are taken from the codes files once, so the cost of
+    // making a row does not depend on the size of the codes files
+    double total_weight{0};
+    for (std::size_t n{0}; n < config_.code_pool_size; n++) {
+	diagnosis_pool_.push_back(parser_->random_code(CodeType::Diagnosis, gen_));
+	procedure_pool_.push_back(parser_->random_code(CodeType::Procedure, gen_));
+	total_weight += 1 / std::pow(n + 1, config_.code_skew);
+	pool_weights_.push_back(total_weight);
+    }
+    for (std::size_t n{0}; n < 100; n++) {
+	invalid_pool_.push_back("XX" + std::to_string(n));
+    }
+
+    add_column("nhs_number", Integer{});
+    add_column("age_at_episode", Integer{});
+    add_column("spell_id", Varchar{});
+    add_column("episode_start", Timestamp{});
+    add_column("episode_end", Timestamp{});
+    add_column("spell_start", Timestamp{});
+    add_column("spell_end", Timestamp{});
+    add_column("primary_diagnosis", Varchar{});
+    add_column("primary_procedure", Varchar{});
+    add_column("date_of_death", Timestamp{});
+    add_column("cause_of_death", Varchar{});
+    add_column("age_at_death", Integer{});
+    for (std::size_t n{0}; n < config_.secondary_diagnosis_columns; n++) {
+	secondary_diagnosis_columns_.push_back(
+	    add_column("secondary_diagnosis_" + std::to_string(n), Varchar{}));
+    }
+    for (std::size_t n{0}; n < config_.secondary_procedure_columns; n++) {
+	secondary_procedure_columns_.push_back(
+	    add_column("secondary_procedure_" + std::to_string(n), Varchar{}));
+    }
+
+    if (config_.num_patients == 0) {
+	end_ = true;
+    } else {
+	next_patient();
+	fill_row();
+    }
+}
+
+std::size_t SyntheticRowBuffer::add_column(const std::string & name, SqlType value) {
+    column_index_[name] = values_.size();
+    values_.push_back(value);
+    return values_.size() - 1;
+}
+
+std::vector<ColumnSpec> SyntheticRowBuffer::columns() const {
+    std::vector<ColumnSpec> columns(values_.size());
+    for (const auto & [name, index] : column_index_) {
+	// SqlType has the same order of alternatives as ColumnType
+	columns[index] = {name, static_cast<ColumnType>(values_[index].index())};
+    }
+    return columns;
+}
+
+bool SyntheticRowBuffer::try_fetch_next_row() {
+    if (end_) {
+	return false;
+    }
+    if (++episode_ == episodes_.size()) {
+	if (++patient_ == config_.first_patient + config_.num_patients) {
+	    end_ = true;
+	    return false;
+	}
+	next_patient();
+    }
+    fill_row();
+    current_row_++;
+    return true;
+}
+
+double SyntheticRowBuffer::uniform() {
+    return uniform_real(gen_);
+}
+
+bool SyntheticRowBuffer::chance(double probability) {
+    return uniform() < probability;
+}
+
+std::size_t SyntheticRowBuffer::geometric(double mean) {
+    // The number of failures before a success, with the given mean
+    if (mean <= 0) {
+	return 0;
+    }
+    auto p{1 / (1 + mean)};
+    return static_cast<std::size_t>(std::floor(std::log1p(-uniform()) / std::log1p(-p)));
+}
+
+std::string SyntheticRowBuffer::draw_code(CodeType type) {
+    if (chance(config_.invalid_probability)) {
+	return invalid_pool_[uniform_below(gen_, invalid_pool_.size())];
+    }
+    auto target{uniform() * pool_weights_.back()};
+    auto rank{static_cast<std::size_t>(std::ranges::upper_bound(pool_weights_, target)
+				       - pool_weights_.begin())};
+    rank = std::min(rank, pool_weights_.size() - 1);
+    return type == CodeType::Diagnosis ? diagnosis_pool_[rank] : procedure_pool_[rank];
+}
+
+void SyntheticRowBuffer::next_patient() {
+    gen_ = CounterGenerator{config_.seed, patient_};
+    spells_.clear();
+    episodes_.clear();
+    episode_ = 0;
+
+    age_ = config_.min_age + uniform_below(gen_, config_.max_age - config_.min_age + 1);
+    // In UTC (not through mktime), so that the rows do not depend on the
+    // time zone of the machine
+    std::chrono::sys_seconds first_day{
+	std::chrono::sys_days{std::chrono::year{config_.first_year}
+			      / std::chrono::January / 1}};
+    auto period{static_cast<unsigned long long>(config_.num_years) * seconds_per_year};
+    first_start_ = static_cast<unsigned long long>(first_day.time_since_epoch().count())
+	+ uniform_below(gen_, period + 1);
+
+    auto time{first_start_};
+    auto num_spells{1 + geometric(config_.spells_per_patient - 1)};
+    for (std::size_t s{0}; s < num_spells; s++) {
+	if (s > 0) {
+	    time += (1 + geometric(config_.days_between_spells)) * seconds_per_day;
+	}
+	// Zero-padded, so that the order of the ids is the order of the spells
+	std::stringstream id;
+	id << std::setw(12) << std::setfill('0') << patient_
+	   << std::setw(4) << std::setfill('0') << s;
+	SpellPlan spell{id.str(), time, time};
+	auto num_episodes{1 + geometric(config_.episodes_per_spell - 1)};
+	for (std::size_t e{0}; e < num_episodes; e++) {
+	    auto end{time + geometric(config_.episode_days) * seconds_per_day};
+	    episodes_.push_back({time, end, s, e == 0});
+	    time = end;
+	}
+	spell.end = time;
+	spells_.push_back(spell);
+    }
+
+    // Deaths come after the last spell
+    date_of_death_ = Timestamp{};
+    age_at_death_ = Integer{};
+    cause_of_death_ = Varchar{};
+    if (chance(config_.death_probability)) {
+	auto death{time + (1 + geometric(config_.days_to_death)) * seconds_per_day};
+	date_of_death_ = Timestamp{death};
+	age_at_death_ = Integer{age_ + (death - first_start_) / seconds_per_year};
+	cause_of_death_ = Varchar{draw_code(CodeType::Diagnosis)};
+    }
+}
+
+void SyntheticRowBuffer::fill_row() {
+    const auto & episode{episodes_[episode_]};
+    const auto & spell{spells_[episode.spell]};
+
+    values_[NhsNumber] = Integer{config_.first_nhs_number + patient_};
+    values_[AgeAtEpisode] = Integer{age_ + (episode.start - first_start_) / seconds_per_year};
+    values_[SpellId] = Varchar{spell.id};
+    values_[EpisodeStart] = Timestamp{episode.start};
+    values_[EpisodeEnd] = Timestamp{episode.end};
+    values_[SpellStart] = Timestamp{spell.start};
+    values_[SpellEnd] = Timestamp{spell.end};
+
+    if (episode.first_in_spell and not config_.index_diagnoses.empty()
+	and chance(config_.index_probability)) {
+	const auto & index_diagnoses{config_.index_diagnoses};
+	values_[PrimaryDiagnosis] = Varchar{index_diagnoses[uniform_below(gen_, index_diagnoses.size())]};
+    } else {
+	values_[PrimaryDiagnosis] = Varchar{draw_code(CodeType::Diagnosis)};
+    }
+    if (chance(config_.procedure_probability)) {
+	values_[PrimaryProcedure] = Varchar{draw_code(CodeType::Procedure)};
+    } else {
+	values_[PrimaryProcedure] = Varchar{};
+    }
+
+    values_[DateOfDeath] = date_of_death_;
+    values_[CauseOfDeath] = cause_of_death_;
+    values_[AgeAtDeath] = age_at_death_;
+
+    // The filled secondary columns come first, and the rest are blank
+    // or NULL (blank columns are whitespace in the real data)
+    auto fill_secondaries = [&](const std::vector<std::size_t> & columns,
+				double mean, CodeType type) {
+	auto num_filled{std::min(geometric(mean), columns.size())};
+	for (std::size_t n{0}; n < columns.size(); n++) {
+	    if (n < num_filled) {
+		values_[columns[n]] = Varchar{draw_code(type)};
+	    } else if (chance(config_.blank_probability)) {
+		values_[columns[n]] = Varchar{"  "};
+	    } else {
+		values_[columns[n]] = Varchar{};
+	    }
+	}
+    };
+    fill_secondaries(secondary_diagnosis_columns_, config_.secondary_diagnoses,
+		     CodeType::Diagnosis);
+    fill_secondaries(secondary_procedure_columns_, config_.secondary_procedures,
+		     CodeType::Procedure);
+}
@@ -0,0 +1,178 @@
+#ifndef SYNTHETIC_ROW_BUFFER_HPP
+#define SYNTHETIC_ROW_BUFFER_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+
+#include "yaml.h"
+#include "sql_types.h"
+#include "row_buffer.h"
+#include "clinical_code.h"
+#include "random.h"
+
+/**
+ * \brief The shape of the rows made by SyntheticRowBuffer
+ *
+ * The means are for geometric distributions (so most patients have
+ * few spells, and a few have many). Codes are drawn from a pool of
+ * code_pool_size codes taken at random from the codes files, with
+ * Zipf-like frequencies: the code of rank r (from 0) is drawn with
+ * weight 1/(r + 1)^code_skew.
+ */
+struct SyntheticConfig {
+    unsigned long long seed{0};
+    std::size_t num_patients{1000};
+    /// The position of the first patient made. The rows of a patient
+    /// depend only on the seed and its position, so a range of the
+    /// patients can be made on its own (for example by one thread).
+    std::size_t first_patient{0};
+    /// The nhs_number of the first patient (they are consecutive)
+    unsigned long long first_nhs_number{1000000000};
+    /// The number of secondary columns of each type
+    std::size_t secondary_diagnosis_columns{23};
+    std::size_t secondary_procedure_columns{23};
+    double spells_per_patient{3};
+    double episodes_per_spell{1.5};
+    double episode_days{2};
+    double days_between_spells{200};
+    /// The mean number of filled secondary columns in an episode
+    double secondary_diagnoses{4};
+    double secondary_procedures{1};
+    /// The chance that an episode has a primary procedure
+    double procedure_probability{0.4};
+    /// The chance that an unfilled secondary column is blank rather
+    /// than NULL
+    double blank_probability{0.5};
+    /// The chance that any code is not a valid code
+    double invalid_probability{0.01};
+    /// The chance that the first episode of a spell has one of the
+    /// index_diagnoses as its primary diagnosis
+    double index_probability{0.05};
+    std::vector<std::string> index_diagnoses;
+    double death_probability{0.1};
+    double days_to_death{365};
+    std::size_t code_pool_size{2000};
+    double code_skew{1.0};
+    int first_year{2005};
+    int num_years{15};
+    unsigned long long min_age{18};
+    unsigned long long max_age{90};
+};
+
+/// Read the synthetic block of the config file (all keys optional).
+/// The number of secondary columns defaults to the number in the
+/// sql_query block, so the rows have the same columns as the query.
+SyntheticConfig read_synthetic_config(const YAML::Node & config);
+
+/**
+ * \brief A row buffer that makes up HES rows
+ *
+ * The rows have the same columns as the result of make_acs_sql_query
+ * (with mortality), and are in the same order (by nhs_number, then
+ * spell_id). Rows are made one patient at a time as they are
+ * fetched, so memory use does not depend on the number of rows. Each
+ * patient's rows come from its own stream of a CounterGenerator, so
+ * the same seed always gives the same rows on every platform (and in
+ * every time zone, since the dates are made in UTC), and
+ * the rows of a patient do not depend on the patients before it.
+ * Like SqlRowBuffer, the first row is fetched by the constructor.
+ */
+class SyntheticRowBuffer {
+public:
+    SyntheticRowBuffer(const SyntheticConfig & config,
+		       std::shared_ptr<ClinicalCodeParser> parser);
+
+    template<typename T>
+    T at(const std::string & column_name) const {
+	auto it{column_index_.find(column_name)};
+	if (it == column_index_.end()) {
+	    throw RowBufferException::ColumnNotFound{};
+	}
+	const auto * value{std::get_if<T>(&values_[it->second])};
+	if (value == nullptr) {
+	    throw RowBufferException::WrongColumnType{};
+	}
+	return *value;
+    }
+
+    void fetch_next_row() {
+	if (not try_fetch_next_row()) {
+	    throw RowBufferException::NoMoreRows{};
+	}
+    }
+
+    bool try_fetch_next_row();
+
+    bool end() const {
+	return end_;
+    }
+
+    auto current_row_number() const {
+	return current_row_;
+    }
+
+    /// The names and types of the columns
+    std::vector<ColumnSpec> columns() const;
+
+private:
+
+    /// The times of an episode of the current patient
+    struct EpisodePlan {
+	unsigned long long start;
+	unsigned long long end;
+	std::size_t spell;
+	bool first_in_spell;
+    };
+
+    struct SpellPlan {
+	std::string id;
+	unsigned long long start;
+	unsigned long long end;
+    };
+
+    std::size_t add_column(const std::string & name, SqlType value);
+
+    /// Plan the spells and episodes of the patient at patient_
+    void next_patient();
+
+    /// Fill the values of the next episode of the current patient
+    void fill_row();
+
+    double uniform();
+    bool chance(double probability);
+    std::size_t geometric(double mean);
+    std::string draw_code(CodeType type);
+
+    SyntheticConfig config_;
+    std::shared_ptr<ClinicalCodeParser> parser_;
+    CounterGenerator gen_;
+
+    // Pools of codes, and cumulative weights for choosing one
+    std::vector<std::string> diagnosis_pool_;
+    std::vector<std::string> procedure_pool_;
+    std::vector<double> pool_weights_;
+    std::vector<std::string> invalid_pool_;
+
+    std::unordered_map<std::string, std::size_t> column_index_;
+    std::vector<SqlType> values_;
+    std::vector<std::size_t> secondary_diagnosis_columns_;
+    std::vector<std::size_t> secondary_procedure_columns_;
+
+    // The current patient
+    std::size_t patient_{0};
+    unsigned long long age_{0};
+    unsigned long long first_start_{0};
+    std::vector<SpellPlan> spells_;
+    std::vector<EpisodePlan> episodes_;
+    std::size_t episode_{0};
+    Timestamp date_of_death_;
+    Integer age_at_death_;
+    Varchar cause_of_death_;
+
+    std::size_t current_row_{0};
+    bool end_{false};
+};
+
+#endif
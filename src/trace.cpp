@@ -0,0 +1,83 @@
+#include "trace.h"
+
+#ifdef RDB_TRACE
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+namespace {
+
+/// All the buffers made so far. Buffers are shared with the threads,
+/// so they outlive the threads that wrote them
+struct TraceRegistry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<TraceBuffer>> buffers;
+};
+
+TraceRegistry & trace_registry() {
+    static TraceRegistry registry;
+    return registry;
+}
+
+}
+
+std::vector<TraceEvent> TraceBuffer::snapshot() const {
+    auto head{head_.load(std::memory_order_acquire)};
+    auto count{std::min<std::uint64_t>(head, trace_buffer_size)};
+    std::vector<TraceEvent> events;
+    events.reserve(count);
+    for (auto n{head - count}; n < head; n++) {
+	events.push_back(events_[n & (trace_buffer_size - 1)]);
+    }
+    return events;
+}
+
+TraceBuffer & this_thread_trace_buffer() {
+    thread_local std::shared_ptr<TraceBuffer> buffer{[] {
+	auto & registry{trace_registry()};
+	std::lock_guard lock{registry.mutex};
+	auto new_buffer{std::make_shared<TraceBuffer>(registry.buffers.size() + 1)};
+	registry.buffers.push_back(new_buffer);
+	return new_buffer;
+    }()};
+    return *buffer;
+}
+
+void write_chrome_trace(std::ostream & os) {
+    auto & registry{trace_registry()};
+    std::lock_guard lock{registry.mutex};
+    os << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    auto first{true};
+    for (const auto & buffer : registry.buffers) {
+	for (const auto & event : buffer->snapshot()) {
+	    // Chrome trace times are in microseconds
+	    os << (first ? "\n" : ",\n")
+	       << "{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1, "
+	       << "\"tid\": " << buffer->thread_id() << ", "
+	       << "\"ts\": " << event.start_ns / 1000 << "." << event.start_ns % 1000 / 100
+	       << ", \"dur\": " << event.duration_ns / 1000 << "."
+	       << event.duration_ns % 1000 / 100 << "}";
+	    first = false;
+	}
+    }
+    os << "\n]}\n";
+}
+
+void clear_trace() {
+    auto & registry{trace_registry()};
+    std::lock_guard lock{registry.mutex};
+    for (const auto & buffer : registry.buffers) {
+	buffer->clear();
+    }
+}
+
+#else
+
+void write_chrome_trace(std::ostream & os) {
+    os << "{\"traceEvents\": []}\n";
+}
+
+void clear_trace() {}
+
+#endif
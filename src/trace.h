@@ -0,0 +1,130 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+/**
+ * \file trace.h
+ * \brief Timeline tracing, compiled in only if RDB_TRACE is defined
+ *
+ * Put RDB_TRACE_SPAN("name") at the top of a block to record the
+ * time spent in the block. Spans are stored in a ring buffer for each
+ * thread (holding the most recent trace_buffer_size spans), without
+ * locking, and write_chrome_trace() writes them all in the Chrome
+ * trace event format, which can be opened in chrome://tracing or
+ * https://ui.perfetto.dev. The name must be a string literal (only
+ * the pointer is stored).
+ *
+ * Without RDB_TRACE (the default), RDB_TRACE_SPAN expands to nothing
+ * and write_chrome_trace() writes an empty trace, so the spans cost
+ * nothing. Build with -DWITH_TRACE=ON in cmake, or add -DRDB_TRACE to
+ * PKG_CXXFLAGS in Makevars for the R package.
+ */
+
+#include <ostream>
+
+#ifdef RDB_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+/// True if spans are recorded in this build
+constexpr bool tracing_enabled{true};
+
+/// The number of spans kept for each thread (a power of two)
+constexpr std::size_t trace_buffer_size{1 << 18};
+
+/// One finished span
+struct TraceEvent {
+    const char * name;
+    std::int64_t start_ns;
+    std::int64_t duration_ns;
+};
+
+/**
+ * \brief The spans recorded by one thread
+ *
+ * Only the owning thread pushes events. The head is published with a
+ * release store, so another thread can take a snapshot at any time,
+ * but if the owner is still running, the oldest events in the
+ * snapshot may have been overwritten while they were copied.
+ */
+class TraceBuffer {
+public:
+    explicit TraceBuffer(std::size_t thread_id)
+	: events_(trace_buffer_size), thread_id_{thread_id} {}
+
+    void push(const TraceEvent & event) noexcept {
+	auto head{head_.load(std::memory_order_relaxed)};
+	events_[head & (trace_buffer_size - 1)] = event;
+	head_.store(head + 1, std::memory_order_release);
+    }
+
+    /// The events still in the buffer, oldest first
+    std::vector<TraceEvent> snapshot() const;
+
+    /// Drop all the events
+    void clear() noexcept {
+	head_.store(0, std::memory_order_release);
+    }
+
+    std::size_t thread_id() const {
+	return thread_id_;
+    }
+
+private:
+    std::vector<TraceEvent> events_;
+    std::atomic<std::uint64_t> head_{0};
+    std::size_t thread_id_;
+};
+
+/// The buffer for the calling thread (registered on first use, and
+/// kept after the thread exits so that its spans can be written)
+TraceBuffer & this_thread_trace_buffer();
+
+/// Nanoseconds since the first call in this process
+inline std::int64_t trace_now_ns() {
+    using Clock = std::chrono::steady_clock;
+    static const auto start{Clock::now()};
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+/// Records the time from construction to destruction as a span
+class TraceSpan {
+public:
+    explicit TraceSpan(const char * name)
+	: name_{name}, start_ns_{trace_now_ns()} {}
+
+    ~TraceSpan() {
+	this_thread_trace_buffer().push({name_, start_ns_, trace_now_ns() - start_ns_});
+    }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan & operator=(const TraceSpan &) = delete;
+
+private:
+    const char * name_;
+    std::int64_t start_ns_;
+};
+
+#define RDB_TRACE_CONCAT_IMPL(a, b) a##b
+#define RDB_TRACE_CONCAT(a, b) RDB_TRACE_CONCAT_IMPL(a, b)
+#define RDB_TRACE_SPAN(name) TraceSpan RDB_TRACE_CONCAT(trace_span_, __LINE__){name}
+
+#else
+
+constexpr bool tracing_enabled{false};
+
+#define RDB_TRACE_SPAN(name)
+
+#endif
+
+/// Write the spans of all threads in the Chrome trace event format
+/// (an empty trace if tracing is compiled out). Call this when the
+/// other threads are not recording spans.
+void write_chrome_trace(std::ostream & os);
+
+/// Drop the spans recorded so far by all threads
+void clear_trace();
+
+#endif